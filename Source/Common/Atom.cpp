@@ -0,0 +1,90 @@
+/**************************************************************************************************
+	Module:       Atom.cpp
+
+	Global string interning table. Each distinct string is stored once and identified by a 32-bit
+	atom, so strings used as identifiers (entity names, template names and types) can be copied and
+	compared as integers. Atoms are never released, the table only grows
+**************************************************************************************************/
+
+#include <map>
+#include <vector>
+using namespace std;
+
+#include "Atom.h"
+#include "Error.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Atom table
+ ------------------------------------------------------------------------------------------------*/
+
+namespace
+{
+	// Each string is held once, as a map key (map nodes do not move so the key can be referenced).
+	// The vector indexes the strings by atom
+	struct SAtomTable
+	{
+		SAtomTable()
+		{
+			// Atom 0 is the empty string
+			m_Strings.push_back( &m_Atoms.insert( make_pair( string(), NoAtom ) ).first->first );
+		}
+
+		map<string, TAtom>    m_Atoms;
+		vector<const string*> m_Strings;
+	};
+
+	// Table is a function static so it is constructed before first use, even when atoms are
+	// created during the construction of other globals
+	SAtomTable& AtomTable()
+	{
+		static SAtomTable atomTable;
+		return atomTable;
+	}
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Atom functions
+ ------------------------------------------------------------------------------------------------*/
+
+// Return the atom for the given string, adding the string to the table if it is new
+TAtom Atom( const string& str )
+{
+	SAtomTable& table = AtomTable();
+	TAtom newAtom = static_cast<TAtom>(table.m_Strings.size());
+	pair<map<string, TAtom>::iterator, bool> inserted = table.m_Atoms.insert( make_pair( str, newAtom ) );
+	if (inserted.second)
+	{
+		table.m_Strings.push_back( &inserted.first->first );
+	}
+	return inserted.first->second;
+}
+
+// Return the atom for the given string if it has been interned, or InvalidAtom if not. The empty
+// string always returns NoAtom. Use for queries so that lookups do not grow the table
+TAtom FindAtom( const string& str )
+{
+	SAtomTable& table = AtomTable();
+	map<string, TAtom>::iterator atom = table.m_Atoms.find( str );
+	return (atom != table.m_Atoms.end()) ? atom->second : InvalidAtom;
+}
+
+// Return the string for the given atom. The reference remains valid for the life of the program
+const string& AtomString( TAtom atom )
+{
+	SAtomTable& table = AtomTable();
+	GEN_ASSERT_OPT( atom < table.m_Strings.size(), "Invalid atom" );
+	return *table.m_Strings[atom];
+}
+
+// Return the number of distinct strings interned
+TUInt32 NumAtoms()
+{
+	return static_cast<TUInt32>(AtomTable().m_Strings.size());
+}
+
+
+} // namespace gen
@@ -0,0 +1,58 @@
+/**************************************************************************************************
+	Module:       Atom.h
+
+	Global string interning table. Each distinct string is stored once and identified by a 32-bit
+	atom, so strings used as identifiers (entity names, template names and types) can be copied and
+	compared as integers. Atoms are never released, the table only grows
+
+	Interning a new string is not thread-safe. Looking up the string for an existing atom is safe
+	provided no other thread is interning at the same time
+**************************************************************************************************/
+
+#ifndef GEN_ATOM_H_INCLUDED
+#define GEN_ATOM_H_INCLUDED
+
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Types and constants
+ ------------------------------------------------------------------------------------------------*/
+
+// An interned string
+typedef TUInt32 TAtom;
+
+// Atom for the empty string. Used by queries to mean "match anything"
+const TAtom NoAtom = 0;
+
+// Atom returned when looking up a string that has never been interned. No entity or template
+// will ever have this atom, so queries using it match nothing
+const TAtom InvalidAtom = 0xffffffff;
+
+
+/*------------------------------------------------------------------------------------------------
+	Atom functions
+ ------------------------------------------------------------------------------------------------*/
+
+// Return the atom for the given string, adding the string to the table if it is new
+TAtom Atom( const string& str );
+
+// Return the atom for the given string if it has been interned, or InvalidAtom if not. The empty
+// string always returns NoAtom. Use for queries so that lookups do not grow the table
+TAtom FindAtom( const string& str );
+
+// Return the string for the given atom. The reference remains valid for the life of the program
+const string& AtomString( TAtom atom );
+
+// Return the number of distinct strings interned
+TUInt32 NumAtoms();
+
+
+} // namespace gen
+
+#endif // GEN_ATOM_H_INCLUDED
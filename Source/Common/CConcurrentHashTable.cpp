@@ -0,0 +1,159 @@
+/*******************************************
+	CConcurrentHashTable.cpp
+
+	Concurrent hash table stress test and
+	benchmark
+********************************************/
+
+#include <thread>
+using namespace std;
+
+#include "CConcurrentHashTable.h"
+#include "CTimer.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Benchmark
+
+// Tables used by the benchmark, wrapped to give the same interface. The CHashTable is protected
+// by a mutex for lookups as well as changes
+class CConcurrentTableWrapper
+{
+public:
+	CConcurrentTableWrapper() : m_Table( 16 ) {}
+
+	bool LookUpKey( TUInt32 key, TUInt32* value )
+	{
+		return m_Table.LookUpKey( key, value );
+	}
+	void SetKeyValue( TUInt32 key, TUInt32 value )
+	{
+		m_Table.SetKeyValue( key, value );
+	}
+	bool RemoveKey( TUInt32 key )
+	{
+		return m_Table.RemoveKey( key );
+	}
+
+private:
+	CConcurrentHashTable<TUInt32, TUInt32> m_Table;
+};
+
+class CLockedTableWrapper
+{
+public:
+	CLockedTableWrapper() : m_Table( 16 ) {}
+
+	bool LookUpKey( TUInt32 key, TUInt32* value )
+	{
+		lock_guard<mutex> lock( m_Mutex );
+		return m_Table.LookUpKey( key, value );
+	}
+	void SetKeyValue( TUInt32 key, TUInt32 value )
+	{
+		lock_guard<mutex> lock( m_Mutex );
+		m_Table.SetKeyValue( key, value );
+	}
+	bool RemoveKey( TUInt32 key )
+	{
+		lock_guard<mutex> lock( m_Mutex );
+		return m_Table.RemoveKey( key );
+	}
+
+private:
+	mutex                        m_Mutex;
+	CHashTable<TUInt32, TUInt32> m_Table;
+};
+
+// Value stored for each key, so readers can check the values they find
+static TUInt32 BenchmarkValue( TUInt32 key )
+{
+	return key * 2 + 1;
+}
+
+// Run the benchmark on one table type. The first half of the keys are always in the table and
+// must always be found with the right value. The second half are repeatedly inserted and removed
+// by the writer thread - they may or may not be found, but must have the right value if they are
+template <class TTable>
+static void BenchmarkConcurrentTable( const char* name, TUInt32 numReaders, TUInt32 numKeys,
+                                      TFloat32 testTime )
+{
+	TTable table;
+	TUInt32 numFixedKeys = numKeys / 2;
+	for (TUInt32 key = 0; key < numFixedKeys; ++key)
+	{
+		table.SetKeyValue( key, BenchmarkValue( key ) );
+	}
+
+	atomic<bool> stop( false );
+	atomic<TUInt64> numLookUps( 0 );
+	atomic<TUInt32> numErrors( 0 );
+	TUInt32 numChanges = 0;
+
+	// Readers look up keys in a different order on each thread
+	vector<thread> readers;
+	for (TUInt32 reader = 0; reader < numReaders; ++reader)
+	{
+		readers.push_back( thread( [&, reader]()
+		{
+			TUInt64 lookUps = 0;
+			TUInt32 errors = 0;
+			TUInt32 key = reader * 7919;
+			TUInt32 value;
+			while (!stop.load( memory_order_relaxed ))
+			{
+				key = (key + 104729) % numKeys;
+				bool found = table.LookUpKey( key, &value );
+				if ((key < numFixedKeys && !found) || (found && value != BenchmarkValue( key )))
+				{
+					++errors;
+				}
+				++lookUps;
+			}
+			numLookUps += lookUps;
+			numErrors += errors;
+		} ) );
+	}
+
+	// This thread inserts and removes the second half of the keys
+	CTimer timer;
+	timer.Reset();
+	while (timer.GetTime() < testTime)
+	{
+		for (TUInt32 key = numFixedKeys; key < numKeys; ++key)
+		{
+			table.SetKeyValue( key, BenchmarkValue( key ) );
+		}
+		for (TUInt32 key = numFixedKeys; key < numKeys; ++key)
+		{
+			table.RemoveKey( key );
+		}
+		numChanges += (numKeys - numFixedKeys) * 2;
+	}
+	stop = true;
+	TFloat32 time = timer.GetTime();
+	for (TUInt32 reader = 0; reader < numReaders; ++reader)
+	{
+		readers[reader].join();
+	}
+
+	cout << "  " << name << ": " << numLookUps / time / 1e6f << "M lookups/s, "
+	     << numChanges / time / 1e6f << "M changes/s, " << numErrors.load() << " errors" << endl;
+}
+
+// Stress test and benchmark: the given number of reader threads look up keys for the given time
+// while one thread inserts and removes keys, making the table grow. Outputs any lookups that gave
+// wrong results, and the lookup and change rates compared with a CHashTable protected by a mutex
+void OutputConcurrentHashTableBenchmark( TUInt32 numReaders /*= 4*/, TUInt32 numKeys /*= 10000*/,
+                                         TFloat32 testTime /*= 1.0f*/ )
+{
+	cout << "Concurrent hash table benchmark, " << numReaders << " readers, 1 writer, "
+	     << numKeys << " keys" << endl;
+	BenchmarkConcurrentTable<CConcurrentTableWrapper>( "Sequence locked table", numReaders, numKeys, testTime );
+	BenchmarkConcurrentTable<CLockedTableWrapper>( "CHashTable with mutex", numReaders, numKeys, testTime );
+}
+
+
+} // namespace gen
@@ -0,0 +1,377 @@
+/*******************************************
+	CConcurrentHashTable.h
+
+	Hash table with lock-free lookups from
+	any thread and serialised writers
+********************************************/
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+#include "Defines.h"
+#include "Error.h"
+#include "CHashTable.h" // For the hash policies
+
+namespace gen
+{
+
+// Hash table for read-mostly data shared between threads, e.g. a UID to entity pointer map read
+// by entity updates running on worker threads. Has the same interface and hash policies as
+// CHashTable. Any number of threads may look up keys at the same time without locking, while
+// insertions and removals take a lock so only one is made at a time
+//
+// Lookups are protected by a sequence lock: each change to the table increments a sequence
+// number before and after it is made. A lookup reads the sequence number, searches the table
+// and then reads the number again. If the number was odd (a change was being made) or has
+// changed, the lookup may have seen a partly made change and is repeated. Lookups never block
+// a writer and only repeat when a change overlaps them, so they are fast when changes are rare
+//
+// Keys are stored in a single array with linear probing (see CFlatHashTable). When the table
+// grows, a new array is filled and then swapped in, lookups already searching the old array
+// carry on safely as it is not changed or freed. Replaced arrays are kept until FreeOldTables
+// is called at a point where no lookups are running, or until the table is destroyed
+//
+// Keys and values are read and written as atomics while lookups are running, so they must be
+// types that std::atomic supports without a lock, i.e. integers and pointers
+template <class TKeyType, class TValueType, class THashPolicy = SHash<TKeyType> >
+class CConcurrentHashTable
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor takes the initial table size (rounded up to a power of 2), the hash policy
+	// object, and the maximum load factor before the table is resized (less than 1)
+	CConcurrentHashTable
+	(
+		const TUInt32      initialSize,
+		const THashPolicy& hashPolicy = THashPolicy(),
+		const TFloat32     maxLoadFactor = 0.7f
+	) : m_HashPolicy( hashPolicy ), m_MaxLoadFactor( maxLoadFactor )
+	{
+		GEN_GUARD;
+		GEN_ASSERT( maxLoadFactor > 0.0f && maxLoadFactor < 1.0f, "Invalid maximum load factor" );
+
+		TUInt32 size = 8;
+		while (size < initialSize)
+		{
+			size *= 2;
+		}
+		m_Table.store( NewTable( size ), memory_order_relaxed );
+		m_Sequence.store( 0, memory_order_relaxed );
+		m_NumEntries = 0;
+
+		GEN_ENDGUARD;
+	}
+
+	~CConcurrentHashTable()
+	{
+		FreeOldTables();
+		DeleteTable( m_Table.load( memory_order_relaxed ) );
+	}
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CConcurrentHashTable( const CConcurrentHashTable& );
+	CConcurrentHashTable& operator=( const CConcurrentHashTable& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	// Looks up value associated with given key and puts in in given pointer. Returns true if
+	// the key was found. May be called from any thread at any time, does not lock
+	bool LookUpKey
+	(
+		const TKeyType& key,
+		TValueType*     value
+	) const
+	{
+		TUInt32 hash = m_HashPolicy( key );
+		while (true)
+		{
+			// Wait for any change in progress to complete, giving up the processor in case the
+			// writer is waiting for it
+			TUInt32 sequence = m_Sequence.load( memory_order_acquire );
+			if (sequence & 1)
+			{
+				this_thread::yield();
+				continue;
+			}
+
+			// Search the table. The result is only used if no change was made during the search.
+			// Limit the search to the table size as a partly made change may leave no empty slot
+			const STable* table = m_Table.load( memory_order_acquire );
+			bool found = false;
+			TValueType foundValue = TValueType();
+			TUInt32 slot = hash & table->mask;
+			for (TUInt32 probe = 0; probe <= table->mask; ++probe)
+			{
+				const SSlot& tableSlot = table->slots[slot];
+				if (!tableSlot.isUsed.load( memory_order_relaxed ))
+				{
+					break;
+				}
+				if (tableSlot.key.load( memory_order_relaxed ) == key)
+				{
+					foundValue = tableSlot.value.load( memory_order_relaxed );
+					found = true;
+					break;
+				}
+				slot = (slot + 1) & table->mask;
+			}
+
+			atomic_thread_fence( memory_order_acquire );
+			if (m_Sequence.load( memory_order_relaxed ) == sequence)
+			{
+				if (found)
+				{
+					*value = foundValue;
+				}
+				return found;
+			}
+		}
+	}
+
+	// Add the given key-value pair to the table, if the key already exists, just update its value.
+	// Takes the writer lock
+	void SetKeyValue
+	(
+		const TKeyType&   key,
+		const TValueType& value
+	)
+	{
+		lock_guard<mutex> lock( m_WriterMutex );
+		STable* table = m_Table.load( memory_order_relaxed );
+		TUInt32 slot = FindSlot( table, key );
+		if (slot != NotFound)
+		{
+			BeginChange();
+			table->slots[slot].value.store( value, memory_order_relaxed );
+			EndChange();
+			return;
+		}
+
+		// Check loading of table - if too full, then swap in a table double the size
+		if (m_NumEntries + 1 > (table->mask + 1) * m_MaxLoadFactor)
+		{
+			table = Resize( (table->mask + 1) * 2 );
+		}
+
+		// Find the first empty slot from the key's hash index
+		slot = m_HashPolicy( key ) & table->mask;
+		while (table->slots[slot].isUsed.load( memory_order_relaxed ))
+		{
+			slot = (slot + 1) & table->mask;
+		}
+
+		BeginChange();
+		table->slots[slot].key.store( key, memory_order_relaxed );
+		table->slots[slot].value.store( value, memory_order_relaxed );
+		table->slots[slot].isUsed.store( true, memory_order_relaxed );
+		EndChange();
+		++m_NumEntries;
+	}
+
+	// Remove the given key (and associated value) from the table, returns false if not found.
+	// Takes the writer lock
+	bool RemoveKey( const TKeyType& key )
+	{
+		lock_guard<mutex> lock( m_WriterMutex );
+		STable* table = m_Table.load( memory_order_relaxed );
+		TUInt32 slot = FindSlot( table, key );
+		if (slot == NotFound)
+		{
+			return false;
+		}
+
+		// Move later keys in the same run of used slots back into the gap if the gap lies between
+		// their hash index and their slot, so every key can still be reached from its hash index
+		// without passing an empty slot. No "deleted" markers are needed
+		BeginChange();
+		TUInt32 gap = slot;
+		TUInt32 next = (slot + 1) & table->mask;
+		while (table->slots[next].isUsed.load( memory_order_relaxed ))
+		{
+			TKeyType nextKey = table->slots[next].key.load( memory_order_relaxed );
+			TUInt32 home = m_HashPolicy( nextKey ) & table->mask;
+			if (((next - home) & table->mask) >= ((next - gap) & table->mask))
+			{
+				table->slots[gap].key.store( nextKey, memory_order_relaxed );
+				table->slots[gap].value.store( table->slots[next].value.load( memory_order_relaxed ),
+				                               memory_order_relaxed );
+				gap = next;
+			}
+			next = (next + 1) & table->mask;
+		}
+		table->slots[gap].isUsed.store( false, memory_order_relaxed );
+		EndChange();
+
+		// The table is never resized downwards
+		--m_NumEntries;
+		return true;
+	}
+
+	// Remove all keys and associated values. Takes the writer lock
+	void RemoveAllKeys()
+	{
+		lock_guard<mutex> lock( m_WriterMutex );
+		STable* table = m_Table.load( memory_order_relaxed );
+		BeginChange();
+		for (TUInt32 slot = 0; slot <= table->mask; ++slot)
+		{
+			table->slots[slot].isUsed.store( false, memory_order_relaxed );
+		}
+		EndChange();
+		m_NumEntries = 0;
+	}
+
+	// Number of key/value pairs in the table. Takes the writer lock
+	TUInt32 NumEntries()
+	{
+		lock_guard<mutex> lock( m_WriterMutex );
+		return m_NumEntries;
+	}
+
+	// Free the arrays replaced when the table has grown. Must only be called when no thread is
+	// looking up a key
+	void FreeOldTables()
+	{
+		lock_guard<mutex> lock( m_WriterMutex );
+		for (TUInt32 table = 0; table < m_OldTables.size(); ++table)
+		{
+			DeleteTable( m_OldTables[table] );
+		}
+		m_OldTables.clear();
+	}
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	// A key/value pair held by the hash table, with whether the slot is in use
+	struct SSlot
+	{
+		atomic<TKeyType>   key;
+		atomic<TValueType> value;
+		atomic<bool>       isUsed;
+	};
+
+	// An array of slots, a power of 2 in size
+	struct STable
+	{
+		SSlot*  slots;
+		TUInt32 mask; // Number of slots - 1, to wrap slot indexes
+	};
+
+	// Slot index returned when a key is not in the table
+	static const TUInt32 NotFound = 0xffffffff;
+
+	// Allocate a table of the given size with all slots empty / free a table
+	static STable* NewTable( TUInt32 size )
+	{
+		STable* table = new STable;
+		table->slots = new SSlot[size];
+		table->mask = size - 1;
+		for (TUInt32 slot = 0; slot < size; ++slot)
+		{
+			table->slots[slot].isUsed.store( false, memory_order_relaxed );
+		}
+		return table;
+	}
+
+	static void DeleteTable( STable* table )
+	{
+		delete[] table->slots;
+		delete table;
+	}
+
+	// Return the slot holding the given key in the given table, or NotFound. Only called by
+	// writers, so the table cannot change during the search
+	TUInt32 FindSlot( const STable* table, const TKeyType& key ) const
+	{
+		TUInt32 slot = m_HashPolicy( key ) & table->mask;
+		while (table->slots[slot].isUsed.load( memory_order_relaxed ))
+		{
+			if (table->slots[slot].key.load( memory_order_relaxed ) == key)
+			{
+				return slot;
+			}
+			slot = (slot + 1) & table->mask;
+		}
+		return NotFound;
+	}
+
+	// Mark the start / end of a change to the current table (see sequence lock in class notes)
+	void BeginChange()
+	{
+		m_Sequence.store( m_Sequence.load( memory_order_relaxed ) + 1, memory_order_relaxed );
+		atomic_thread_fence( memory_order_release );
+	}
+
+	void EndChange()
+	{
+		m_Sequence.store( m_Sequence.load( memory_order_relaxed ) + 1, memory_order_release );
+	}
+
+	// Fill a new table of the given size with the current keys and swap it in, keeping the old
+	// table for lookups that are still searching it. Returns the new table
+	STable* Resize( const TUInt32 newSize )
+	{
+		STable* oldTable = m_Table.load( memory_order_relaxed );
+		STable* newTable = NewTable( newSize );
+		for (TUInt32 oldSlot = 0; oldSlot <= oldTable->mask; ++oldSlot)
+		{
+			if (oldTable->slots[oldSlot].isUsed.load( memory_order_relaxed ))
+			{
+				TKeyType key = oldTable->slots[oldSlot].key.load( memory_order_relaxed );
+				TUInt32 slot = m_HashPolicy( key ) & newTable->mask;
+				while (newTable->slots[slot].isUsed.load( memory_order_relaxed ))
+				{
+					slot = (slot + 1) & newTable->mask;
+				}
+				newTable->slots[slot].key.store( key, memory_order_relaxed );
+				newTable->slots[slot].value.store( oldTable->slots[oldSlot].value.load( memory_order_relaxed ),
+				                                   memory_order_relaxed );
+				newTable->slots[slot].isUsed.store( true, memory_order_relaxed );
+			}
+		}
+
+		// The new table is complete before it is published
+		m_Table.store( newTable, memory_order_release );
+		m_OldTables.push_back( oldTable );
+		return newTable;
+	}
+
+
+/////////////////////////////////////
+//	Data
+private:
+
+	atomic<STable*> m_Table;    // Current table
+	atomic<TUInt32> m_Sequence; // Odd while a change is being made to the current table
+
+	// Writers hold this lock. Number of entries and replaced tables are only used by writers
+	mutex           m_WriterMutex;
+	TUInt32         m_NumEntries;
+	vector<STable*> m_OldTables;
+
+	THashPolicy    m_HashPolicy;
+	const TFloat32 m_MaxLoadFactor;
+};
+
+
+// Stress test and benchmark: the given number of reader threads look up keys for the given time
+// while one thread inserts and removes keys, making the table grow. Outputs any lookups that gave
+// wrong results, and the lookup and change rates compared with a CHashTable protected by a mutex
+void OutputConcurrentHashTableBenchmark( TUInt32 numReaders = 4, TUInt32 numKeys = 10000,
+                                         TFloat32 testTime = 1.0f );
+
+
+} // namespace gen
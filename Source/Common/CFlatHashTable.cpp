@@ -0,0 +1,154 @@
+/*******************************************
+	CFlatHashTable.cpp
+
+	Open addressing hash table benchmark
+********************************************/
+
+#include <vector>
+using namespace std;
+
+#include "CFlatHashTable.h"
+#include "CTimer.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Benchmark
+
+// Timings for one table type in nanoseconds per operation, and a checksum of the values found
+struct SHashTableTimings
+{
+	TFloat32 insert;
+	TFloat32 reservedInsert; // Insert after reserving space for all keys
+	TFloat32 lookUpFound;
+	TFloat32 lookUpMissing;
+	TFloat32 remove;
+	TFloat32 mixed;
+	TUInt32  checksum;
+};
+
+// Run the benchmark operations on the given table type using the given keys, each half of the
+// array holds distinct keys - the first half is inserted and the second half is never inserted
+template <class TTable>
+static void BenchmarkTable( const vector<TUInt32>& keys, void (*reserve)( TTable&, TUInt32 ),
+                            SHashTableTimings& timings )
+{
+	TUInt32 numKeys = static_cast<TUInt32>(keys.size() / 2);
+	TFloat32 toNanoseconds = 1e9f / numKeys;
+	TUInt32 checksum = 0;
+	TUInt32 value;
+	CTimer timer;
+
+	// Table growing from a small size
+	{
+		TTable table( 1024 );
+		timer.Reset();
+		for (TUInt32 key = 0; key < numKeys; ++key)
+		{
+			table.SetKeyValue( keys[key], key );
+		}
+		timings.insert = timer.GetLapTime() * toNanoseconds;
+	}
+
+	// Table with space reserved for all keys (where supported)
+	TTable table( 1024 );
+	if (reserve)
+	{
+		reserve( table, numKeys );
+	}
+	timer.Reset();
+	for (TUInt32 key = 0; key < numKeys; ++key)
+	{
+		table.SetKeyValue( keys[key], key );
+	}
+	timings.reservedInsert = timer.GetLapTime() * toNanoseconds;
+
+	for (TUInt32 key = 0; key < numKeys; ++key)
+	{
+		if (table.LookUpKey( keys[key], &value ))
+		{
+			checksum += value;
+		}
+	}
+	timings.lookUpFound = timer.GetLapTime() * toNanoseconds;
+
+	for (TUInt32 key = numKeys; key < 2 * numKeys; ++key)
+	{
+		if (table.LookUpKey( keys[key], &value ))
+		{
+			checksum += value;
+		}
+	}
+	timings.lookUpMissing = timer.GetLapTime() * toNanoseconds;
+
+	// Remove every other key
+	for (TUInt32 key = 0; key < numKeys; key += 2)
+	{
+		checksum += table.RemoveKey( keys[key] ) ? 1 : 0;
+	}
+	timings.remove = timer.GetLapTime() * toNanoseconds * 2.0f;
+
+	// Mix of operations with the table half full: half lookups, a quarter inserts of the removed
+	// keys, a quarter removals of the remaining keys
+	for (TUInt32 key = 0; key < numKeys; ++key)
+	{
+		TUInt32 evenKey = key & ~1u;
+		switch (key & 3)
+		{
+			case 0:
+				table.SetKeyValue( keys[evenKey], key );
+				break;
+			case 1:
+				checksum += table.RemoveKey( keys[evenKey + 1] ) ? 1 : 0;
+				break;
+			default:
+				if (table.LookUpKey( keys[(key * 7) % numKeys], &value ))
+				{
+					checksum += value;
+				}
+				break;
+		}
+	}
+	timings.mixed = timer.GetLapTime() * toNanoseconds;
+	timings.checksum = checksum;
+}
+
+// Reserve space in a flat hash table (the list based table has no reserve)
+static void ReserveFlatTable( CFlatHashTable<TUInt32, TUInt32>& table, TUInt32 numEntries )
+{
+	table.Reserve( numEntries );
+}
+
+// Output timings comparing CFlatHashTable with CHashTable for 1k keys up to the given number of
+// keys (in steps of 10x), for inserts, lookups (found and not found), removals and a mix of all
+void OutputHashTableBenchmark( TUInt32 maxKeys /*= 1000000*/ )
+{
+	cout << "Hash table benchmark (ns per operation, list buckets / flat):" << endl;
+	for (TUInt32 numKeys = 1000; numKeys <= maxKeys; numKeys *= 10)
+	{
+		// Distinct keys spread over the whole range (multiplying by an odd number is a one-to-one
+		// mapping of 32-bit integers)
+		vector<TUInt32> keys( numKeys * 2 );
+		for (TUInt32 key = 0; key < numKeys * 2; ++key)
+		{
+			keys[key] = (key + 1) * 2654435761u;
+		}
+
+		SHashTableTimings listTimings, flatTimings;
+		BenchmarkTable<CHashTable<TUInt32, TUInt32> >( keys, 0, listTimings );
+		BenchmarkTable<CFlatHashTable<TUInt32, TUInt32> >( keys, ReserveFlatTable, flatTimings );
+
+		cout << "  " << numKeys << " keys:" << endl;
+		cout << "    Insert:         " << listTimings.insert << " / " << flatTimings.insert
+		     << " (reserved " << flatTimings.reservedInsert << ")" << endl;
+		cout << "    Look up found:  " << listTimings.lookUpFound << " / " << flatTimings.lookUpFound << endl;
+		cout << "    Look up absent: " << listTimings.lookUpMissing << " / " << flatTimings.lookUpMissing << endl;
+		cout << "    Remove:         " << listTimings.remove << " / " << flatTimings.remove << endl;
+		cout << "    Mixed:          " << listTimings.mixed << " / " << flatTimings.mixed
+		     << (listTimings.checksum == flatTimings.checksum ? "" : " (MISMATCH)") << endl;
+	}
+}
+
+
+} // namespace gen
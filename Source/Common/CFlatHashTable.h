@@ -0,0 +1,351 @@
+/*******************************************
+	CFlatHashTable.h
+
+	Open addressing hash table with Robin
+	Hood probing, same interface as CHashTable
+********************************************/
+
+#pragma once
+
+#include <iostream>
+using namespace std;
+
+#include "Defines.h"
+#include "Error.h"
+#include "CHashTable.h" // For the hash policies
+
+namespace gen
+{
+
+// Hash table storing key/value pairs in a single array rather than in a list per bucket, so
+// there is no allocation per entry and a lookup reads neighbouring memory. Each key is stored at
+// its hash index or in one of the slots following it (linear probing). Robin Hood insertion keeps
+// keys ordered by their distance from their hash index: an inserted key takes the place of any
+// key closer to its own hash index, which is then moved along. This keeps probe sequences short
+// and lets a lookup stop as soon as it passes the point where the key would be. Removal shifts
+// the following keys back one slot instead of leaving a "deleted" marker, so tables with many
+// removals do not slow down
+//
+// Has the same interface and hash policies as CHashTable and the same restrictions on key and
+// value types (see CHashTable.h). Keys and values must also be default constructible as the slot
+// array is allocated in one go. The capacity is always a power of 2
+template <class TKeyType, class TValueType, class THashPolicy = SHash<TKeyType> >
+class CFlatHashTable
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor takes the initial table size (rounded up to a power of 2), the hash policy
+	// object, and the maximum load factor before the table is resized (less than 1)
+	CFlatHashTable
+	(
+		const TUInt32      initialSize,
+		const THashPolicy& hashPolicy = THashPolicy(),
+		const TFloat32     maxLoadFactor = 0.8f
+	) : m_HashPolicy( hashPolicy ), m_MaxLoadFactor( maxLoadFactor )
+	{
+		GEN_GUARD;
+		GEN_ASSERT( maxLoadFactor > 0.0f && maxLoadFactor < 1.0f, "Invalid maximum load factor" );
+
+		m_Slots = 0;
+		m_Distances = 0;
+		m_Size = 0;
+		m_NumEntries = 0;
+		Resize( RoundUpSize( initialSize ) );
+
+		GEN_ENDGUARD;
+	}
+
+	~CFlatHashTable()
+	{
+		delete[] m_Slots;
+		delete[] m_Distances;
+	}
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CFlatHashTable( const CFlatHashTable& );
+	CFlatHashTable& operator=( const CFlatHashTable& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	// Looks up value associated with given key and puts in in given pointer. Returns true if
+	// the key was found
+	bool LookUpKey
+	(
+		const TKeyType& key,
+		TValueType*     value
+	) const
+	{
+		TUInt32 slot = FindSlot( key );
+		if (slot == NotFound)
+		{
+			return false;
+		}
+		*value = m_Slots[slot].value;
+		return true;
+	}
+
+	// Add the given key-value pair to the table, if the key already exists, just update its value
+	void SetKeyValue
+	(
+		const TKeyType&   key,
+		const TValueType& value
+	)
+	{
+		TUInt32 slot = FindSlot( key );
+		if (slot != NotFound)
+		{
+			m_Slots[slot].value = value;
+			return;
+		}
+
+		// Check loading of table - if too full, then double it in size
+		if (m_NumEntries + 1 > m_Size * m_MaxLoadFactor)
+		{
+			Resize( m_Size * 2 );
+		}
+		SSlot newSlot;
+		newSlot.key = key;
+		newSlot.value = value;
+		InsertNewKey( newSlot );
+	}
+
+	// Remove the given key (and associated value) from the table, returns false if not found
+	bool RemoveKey( const TKeyType& key )
+	{
+		TUInt32 slot = FindSlot( key );
+		if (slot == NotFound)
+		{
+			return false;
+		}
+
+		// Shift following keys back a slot until reaching an empty slot or a key that is already
+		// at its hash index. This leaves the table as if the removed key was never inserted
+		TUInt32 next = (slot + 1) & m_Mask;
+		while (m_Distances[next] > 1)
+		{
+			m_Slots[slot] = m_Slots[next];
+			m_Distances[slot] = m_Distances[next] - 1;
+			slot = next;
+			next = (next + 1) & m_Mask;
+		}
+		m_Distances[slot] = 0;
+
+		// The table is never resized downwards
+		--m_NumEntries;
+		return true;
+	}
+
+	// Remove all keys and associated values
+	void RemoveAllKeys()
+	{
+		for (TUInt32 slot = 0; slot < m_Size; ++slot)
+		{
+			m_Distances[slot] = 0;
+		}
+		m_NumEntries = 0;
+	}
+
+	// Make room for the given number of entries without further resizing
+	void Reserve( const TUInt32 numEntries )
+	{
+		TUInt32 newSize = m_Size;
+		while (numEntries > newSize * m_MaxLoadFactor)
+		{
+			newSize *= 2;
+		}
+		if (newSize != m_Size)
+		{
+			Resize( newSize );
+		}
+	}
+
+	// Number of key/value pairs in the table
+	TUInt32 NumEntries() const
+	{
+		return m_NumEntries;
+	}
+
+	// Number of slots in the table
+	TUInt32 Capacity() const
+	{
+		return m_Size;
+	}
+
+	// Output the number of keys at each distance from their hash index (the number of extra
+	// slots a lookup of the key must check). Ideally almost all keys are at distance 0 or 1, long
+	// probe sequences show a poor hashing function
+	void OutputDistribution() const
+	{
+		cout << "Hash Table Distribution:" << endl << endl;
+
+		const TUInt32 NumCounts = 10;
+		TUInt32 distanceCounts[NumCounts] = { 0 };
+		TUInt32 totalDistance = 0;
+		TUInt32 maxDistance = 0;
+		for (TUInt32 slot = 0; slot < m_Size; ++slot)
+		{
+			if (m_Distances[slot] != 0)
+			{
+				TUInt32 distance = m_Distances[slot] - 1;
+				++distanceCounts[distance < NumCounts - 1 ? distance : NumCounts - 1];
+				totalDistance += distance;
+				if (distance > maxDistance)
+				{
+					maxDistance = distance;
+				}
+			}
+		}
+		for (TUInt32 distance = 0; distance < NumCounts; ++distance)
+		{
+			cout << "Distance " << distance << (distance == NumCounts - 1 ? "+: " : ": ")
+			     << distanceCounts[distance] << endl;
+		}
+		cout << endl << "% used slots: " << 100.0f * static_cast<float>(m_NumEntries) / m_Size;
+		cout << endl << "Average distance: "
+		     << (m_NumEntries ? static_cast<float>(totalDistance) / m_NumEntries : 0.0f)
+		     << ", maximum: " << maxDistance << endl;
+		cout << endl;
+	}
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	// A key/value pair held by the hash table
+	struct SSlot
+	{
+		TKeyType   key;
+		TValueType value;
+	};
+
+	// Slot index returned when a key is not in the table
+	static const TUInt32 NotFound = 0xffffffff;
+
+	// Smallest power of 2 at least the given size (minimum 8)
+	static TUInt32 RoundUpSize( TUInt32 size )
+	{
+		TUInt32 roundedSize = 8;
+		while (roundedSize < size)
+		{
+			roundedSize *= 2;
+		}
+		return roundedSize;
+	}
+
+	// Find the hash index of the given key
+	TUInt32 HashIndex( const TKeyType& key ) const
+	{
+		return m_HashPolicy( key ) & m_Mask;
+	}
+
+	// Return the slot holding the given key, or NotFound
+	TUInt32 FindSlot( const TKeyType& key ) const
+	{
+		TUInt32 slot = HashIndex( key );
+		TUInt32 distance = 1;
+
+		// Keys are ordered by distance, so stop at the first key closer to its own hash index
+		// than this key would be (empty slots have distance 0)
+		while (m_Distances[slot] >= distance)
+		{
+			if (m_Distances[slot] == distance && m_Slots[slot].key == key)
+			{
+				return slot;
+			}
+			slot = (slot + 1) & m_Mask;
+			++distance;
+		}
+		return NotFound;
+	}
+
+	// Insert a key known not to be in the table, there must be a free slot
+	void InsertNewKey( SSlot newSlot )
+	{
+		TUInt32 slot = HashIndex( newSlot.key );
+		TUInt32 distance = 1;
+		while (m_Distances[slot] != 0)
+		{
+			// Take the place of a key closer to its hash index and carry on inserting that key
+			if (m_Distances[slot] < distance)
+			{
+				SSlot displacedSlot = m_Slots[slot];
+				m_Slots[slot] = newSlot;
+				newSlot = displacedSlot;
+
+				TUInt32 displacedDistance = m_Distances[slot];
+				m_Distances[slot] = distance;
+				distance = displacedDistance;
+			}
+			slot = (slot + 1) & m_Mask;
+			++distance;
+		}
+		m_Slots[slot] = newSlot;
+		m_Distances[slot] = distance;
+		++m_NumEntries;
+	}
+
+	// Resize the table to the given power of 2 - reinserts all keys
+	void Resize( const TUInt32 newSize )
+	{
+		GEN_GUARD;
+
+		SSlot*   oldSlots = m_Slots;
+		TUInt32* oldDistances = m_Distances;
+		TUInt32  oldSize = m_Size;
+
+		m_Size = newSize;
+		m_Mask = newSize - 1;
+		m_Slots = new SSlot[m_Size];
+		m_Distances = new TUInt32[m_Size];
+		GEN_ASSERT( m_Slots && m_Distances, "Fatal memory error reserving hash table memory" );
+		for (TUInt32 slot = 0; slot < m_Size; ++slot)
+		{
+			m_Distances[slot] = 0;
+		}
+
+		m_NumEntries = 0;
+		for (TUInt32 slot = 0; slot < oldSize; ++slot)
+		{
+			if (oldDistances[slot] != 0)
+			{
+				InsertNewKey( oldSlots[slot] );
+			}
+		}
+
+		delete[] oldSlots;
+		delete[] oldDistances;
+
+		GEN_ENDGUARD;
+	}
+
+
+/////////////////////////////////////
+//	Data
+private:
+
+	// Key/value pairs, and for each slot the distance of its key from the key's hash index plus
+	// one, 0 for an empty slot. Kept in a separate array so probing reads less memory
+	SSlot*   m_Slots;
+	TUInt32* m_Distances;
+
+	TUInt32 m_Size;       // Number of slots, a power of 2
+	TUInt32 m_Mask;       // m_Size - 1, to wrap slot indexes
+	TUInt32 m_NumEntries; // Number of key/value pairs in the table
+
+	THashPolicy    m_HashPolicy;
+	const TFloat32 m_MaxLoadFactor;
+};
+
+
+// Output timings comparing CFlatHashTable with CHashTable for 1k keys up to the given number of
+// keys (in steps of 10x), for inserts, lookups (found and not found), removals and a mix of all
+void OutputHashTableBenchmark( TUInt32 maxKeys = 1000000 );
+
+
+} // namespace gen
@@ -0,0 +1,117 @@
+/*******************************************
+	CFreeListPool.cpp
+
+	Fixed size block allocator using a free
+	list over chunks of blocks
+********************************************/
+
+#include <malloc.h>
+#include "CFreeListPool.h"
+#include "BaseMath.h"
+#include "Error.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Constructor takes the size of each block in bytes and the number of blocks to allocate in
+// each chunk taken from the heap
+CFreeListPool::CFreeListPool( TUInt32 blockSize, TUInt32 blocksPerChunk /*= 64*/ )
+{
+	// Blocks must be able to hold the free list link. Round the size up to a multiple of 16 so
+	// every block keeps the alignment of the chunk (suitable for any type including SSE vectors)
+	const TUInt32 BlockAlignment = 16;
+	blockSize = Max( blockSize, static_cast<TUInt32>(sizeof(SFreeBlock)) );
+	blockSize = (blockSize + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+
+	m_BlocksPerChunk = Max( blocksPerChunk, 1u );
+	m_FreeList = 0;
+
+	m_Stats.blockSize = blockSize;
+	m_Stats.numChunks = 0;
+	m_Stats.capacity = 0;
+	m_Stats.inUse = 0;
+	m_Stats.peakInUse = 0;
+	m_Stats.numAllocs = 0;
+}
+
+// Destructor frees all chunks - any blocks still allocated become invalid
+CFreeListPool::~CFreeListPool()
+{
+	for (TUInt32 chunk = 0; chunk < m_Chunks.size(); ++chunk)
+	{
+		_aligned_free( m_Chunks[chunk] );
+	}
+}
+
+
+/////////////////////////////////////
+// Allocation
+
+// Return an uninitialised block, taking a new chunk from the heap if there are no free blocks
+void* CFreeListPool::Allocate()
+{
+	if (!m_FreeList)
+	{
+		AddChunk( m_BlocksPerChunk );
+	}
+
+	SFreeBlock* block = m_FreeList;
+	m_FreeList = block->next;
+
+	++m_Stats.inUse;
+	++m_Stats.numAllocs;
+	m_Stats.peakInUse = Max( m_Stats.peakInUse, m_Stats.inUse );
+	return block;
+}
+
+// Return a block previously allocated from this pool to the free list
+void CFreeListPool::Free( void* block )
+{
+	if (!block)
+	{
+		return;
+	}
+	GEN_ASSERT_OPT( m_Stats.inUse > 0, "Freeing block to empty pool" );
+
+	SFreeBlock* freeBlock = static_cast<SFreeBlock*>(block);
+	freeBlock->next = m_FreeList;
+	m_FreeList = freeBlock;
+	--m_Stats.inUse;
+}
+
+// Ensure the given number of blocks can be allocated without taking memory from the heap
+void CFreeListPool::Reserve( TUInt32 numBlocks )
+{
+	TUInt32 numFree = m_Stats.capacity - m_Stats.inUse;
+	if (numBlocks > numFree)
+	{
+		AddChunk( Max( numBlocks - numFree, m_BlocksPerChunk ) );
+	}
+}
+
+// Take a new chunk with the given number of blocks from the heap and add its blocks to the
+// free list
+void CFreeListPool::AddChunk( TUInt32 numBlocks )
+{
+	// Chunks are 16-byte aligned to match the block size rounding
+	TUInt8* chunk = static_cast<TUInt8*>(_aligned_malloc( m_Stats.blockSize * numBlocks, 16 ));
+	GEN_ASSERT( chunk, "Fatal memory error allocating pool chunk" );
+	m_Chunks.push_back( chunk );
+
+	// Link the blocks in address order so early allocations are contiguous
+	for (TUInt32 block = numBlocks; block-- > 0; )
+	{
+		SFreeBlock* freeBlock = reinterpret_cast<SFreeBlock*>(chunk + block * m_Stats.blockSize);
+		freeBlock->next = m_FreeList;
+		m_FreeList = freeBlock;
+	}
+
+	++m_Stats.numChunks;
+	m_Stats.capacity += numBlocks;
+}
+
+
+} // namespace gen
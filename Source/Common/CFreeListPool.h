@@ -0,0 +1,95 @@
+/*******************************************
+	CFreeListPool.h
+
+	Fixed size block allocator using a free
+	list over chunks of blocks
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+
+namespace gen
+{
+
+// Occupancy statistics for a pool
+struct SPoolStats
+{
+	TUInt32 blockSize;   // Bytes per block
+	TUInt32 numChunks;   // Chunks allocated from the heap
+	TUInt32 capacity;    // Blocks in all chunks
+	TUInt32 inUse;       // Blocks currently allocated
+	TUInt32 peakInUse;   // Most blocks ever allocated at once
+	TUInt32 numAllocs;   // Total calls to Allocate
+};
+
+
+// Allocates blocks of a fixed size. Blocks are carved from chunks obtained from the heap; freed
+// blocks are put on a free list (linked through the blocks themselves) and reused before any new
+// chunk is taken. Memory is only returned to the heap when the pool is destroyed, so once a pool
+// has grown to the peak requirement, allocation and freeing make no heap calls. Not thread-safe
+class CFreeListPool
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor takes the size of each block in bytes and the number of blocks to allocate in
+	// each chunk taken from the heap
+	CFreeListPool( TUInt32 blockSize, TUInt32 blocksPerChunk = 64 );
+
+	// Destructor frees all chunks - any blocks still allocated become invalid
+	~CFreeListPool();
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CFreeListPool( const CFreeListPool& );
+	CFreeListPool& operator=( const CFreeListPool& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	// Return an uninitialised block, taking a new chunk from the heap if there are no free blocks
+	void* Allocate();
+
+	// Return a block previously allocated from this pool to the free list
+	void Free( void* block );
+
+	// Ensure the given number of blocks can be allocated without taking memory from the heap,
+	// taking a single chunk large enough for any shortfall
+	void Reserve( TUInt32 numBlocks );
+
+	// Get occupancy statistics
+	const SPoolStats& GetStats()
+	{
+		return m_Stats;
+	}
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	// Take a new chunk with the given number of blocks from the heap and add its blocks to the
+	// free list
+	void AddChunk( TUInt32 numBlocks );
+
+	// Freed blocks hold a pointer to the next free block
+	struct SFreeBlock
+	{
+		SFreeBlock* next;
+	};
+
+	TUInt32        m_BlocksPerChunk;
+	vector<TUInt8*> m_Chunks;
+	SFreeBlock*    m_FreeList;
+
+	SPoolStats m_Stats;
+};
+
+
+} // namespace gen
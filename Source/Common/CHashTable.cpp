@@ -11,7 +11,10 @@
 	Copyright 2007, University of Central Lancashire and Laurent Noel
 **************************************************************************************************/
 
+#include <vector>
+#include <sstream>
 #include "CHashTable.h"
+#include "CTimer.h"
 
 namespace gen
 {
@@ -56,4 +59,170 @@ TUInt32 JOneAtATimeHash( const TUInt8* pKey, const TUInt32 iKeyLen )
 }
 
 
+/*------------------------------------------------------------------------------------------------
+	Hash policy benchmark
+ ------------------------------------------------------------------------------------------------*/
+
+// Fill a table using the given hash policy with the given keys, output its distribution and the
+// average time to look up each key
+template <class TKeyType, class THashPolicy>
+static void BenchmarkHashPolicy
+(
+	const string&           sPolicyName,
+	const vector<TKeyType>& aKeys,
+	const THashPolicy&      hashPolicy
+)
+{
+	TUInt32 iNumKeys = static_cast<TUInt32>(aKeys.size());
+	CHashTable<TKeyType, TUInt32, THashPolicy> table( iNumKeys * 2, hashPolicy );
+	for (TUInt32 iKey = 0; iKey < iNumKeys; ++iKey)
+	{
+		table.SetKeyValue( aKeys[iKey], iKey );
+	}
+
+	// Look up every key several times
+	const TUInt32 kiNumPasses = 10;
+	TUInt32 iFound = 0;
+	TUInt32 iValue;
+	CTimer timer;
+	timer.Reset();
+	for (TUInt32 iPass = 0; iPass < kiNumPasses; ++iPass)
+	{
+		for (TUInt32 iKey = 0; iKey < iNumKeys; ++iKey)
+		{
+			iFound += table.LookUpKey( aKeys[iKey], &iValue ) ? 1 : 0;
+		}
+	}
+	float fLookUpTime = timer.GetTime() * 1e9f / (iNumKeys * kiNumPasses);
+
+	cout << sPolicyName << ": " << fLookUpTime << "ns per lookup"
+	     << (iFound == iNumKeys * kiNumPasses ? "" : " (KEYS MISSING)") << endl;
+	table.OutputDistribution( false );
+}
+
+// Output the bucket distribution and lookup time of each hash policy for sets of integer UIDs
+// (sequential and widely spaced) and of entity names, using tables with the given number of keys
+void OutputHashPolicyBenchmark( const TUInt32 iNumKeys /*= 100000*/ )
+{
+	// Sequential UIDs as issued by the entity manager, and UIDs a multiple of 1024 apart (all
+	// with the same low bits)
+	vector<TUInt32> aSequentialUIDs( iNumKeys );
+	vector<TUInt32> aSpacedUIDs( iNumKeys );
+	vector<string>  aNames( iNumKeys );
+	for (TUInt32 iKey = 0; iKey < iNumKeys; ++iKey)
+	{
+		aSequentialUIDs[iKey] = iKey;
+		aSpacedUIDs[iKey] = iKey * 1024;
+
+		stringstream name;
+		name << "Tank" << iKey;
+		aNames[iKey] = name.str();
+	}
+
+	cout << "Hash policy benchmark, " << iNumKeys << " keys" << endl << endl;
+	const vector<TUInt32>* apUIDSets[] = { &aSequentialUIDs, &aSpacedUIDs };
+	const char* asUIDSetNames[] = { "sequential", "spaced" };
+	for (TUInt32 iSet = 0; iSet < 2; ++iSet)
+	{
+		const vector<TUInt32>& aUIDs = *apUIDSets[iSet];
+		string sSet = string( " (" ) + asUIDSetNames[iSet] + " UIDs)";
+		BenchmarkHashPolicy( "Add up hash through function pointer" + sSet, aUIDs,
+		                     SFunctionHash<TUInt32>( AddUpHash ) );
+		BenchmarkHashPolicy( "One-at-a-time hash through function pointer" + sSet, aUIDs,
+		                     SFunctionHash<TUInt32>( JOneAtATimeHash ) );
+		BenchmarkHashPolicy( "One-at-a-time hash" + sSet, aUIDs, SByteHash<TUInt32>() );
+		BenchmarkHashPolicy( "Multiply-shift hash" + sSet, aUIDs, SIntegerHash<TUInt32>() );
+	}
+	BenchmarkHashPolicy( "Add up string hash (names)", aNames, SStringHash<AddUpHash>() );
+	BenchmarkHashPolicy( "One-at-a-time string hash (names)", aNames, SStringHash<JOneAtATimeHash>() );
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Resize benchmark
+ ------------------------------------------------------------------------------------------------*/
+
+// Time each operation on a table using the given resize rate (see CHashTable constructor): insert
+// the keys, looking up an earlier key after each insertion, then remove them all. Outputs the
+// total time and the worst case time of each kind of operation. Insertions that start a resize
+// allocate the new buckets, they are timed separately from the others
+static void BenchmarkResize
+(
+	const string&          sName,
+	const TUInt32          iResizeRate,
+	const vector<TUInt32>& aKeys
+)
+{
+	TUInt32 iNumKeys = static_cast<TUInt32>(aKeys.size());
+	CHashTable<TUInt32, TUInt32> table( 1024, SHash<TUInt32>(), 0.7f, iResizeRate );
+
+	float fInsertTime = 0.0f, fWorstInsert = 0.0f;
+	float fAllocateTime = 0.0f, fWorstAllocate = 0.0f;
+	TUInt32 iNumResizes = 0;
+	float fLookUpTime = 0.0f, fWorstLookUp = 0.0f;
+	float fRemoveTime = 0.0f, fWorstRemove = 0.0f;
+	TUInt32 iFound = 0;
+	TUInt32 iValue;
+	CTimer timer;
+	timer.Reset();
+	for (TUInt32 iKey = 0; iKey < iNumKeys; ++iKey)
+	{
+		TUInt32 iOldSize = table.GetSize();
+		timer.GetLapTime();
+		table.SetKeyValue( aKeys[iKey], iKey );
+		float fTime = timer.GetLapTime();
+		if (table.GetSize() != iOldSize)
+		{
+			fAllocateTime += fTime;
+			fWorstAllocate = (fTime > fWorstAllocate) ? fTime : fWorstAllocate;
+			++iNumResizes;
+		}
+		else
+		{
+			fInsertTime += fTime;
+			fWorstInsert = (fTime > fWorstInsert) ? fTime : fWorstInsert;
+		}
+
+		// Keys inserted earlier may be in either the old or new buckets during a resize
+		iFound += table.LookUpKey( aKeys[iKey / 2], &iValue ) ? 1 : 0;
+		fTime = timer.GetLapTime();
+		fLookUpTime += fTime;
+		fWorstLookUp = (fTime > fWorstLookUp) ? fTime : fWorstLookUp;
+	}
+	for (TUInt32 iKey = 0; iKey < iNumKeys; ++iKey)
+	{
+		timer.GetLapTime();
+		iFound += table.RemoveKey( aKeys[iKey] ) ? 1 : 0;
+		float fTime = timer.GetLapTime();
+		fRemoveTime += fTime;
+		fWorstRemove = (fTime > fWorstRemove) ? fTime : fWorstRemove;
+	}
+
+	cout << sName << (iFound == iNumKeys * 2 ? "" : " (KEYS MISSING)") << endl;
+	cout << "  Insert: total " << fInsertTime * 1000.0f << "ms, worst " << fWorstInsert * 1e6f << "us" << endl;
+	cout << "  Insert starting a resize (" << iNumResizes << "): total " << fAllocateTime * 1000.0f
+	     << "ms, worst " << fWorstAllocate * 1e6f << "us" << endl;
+	cout << "  Look up: total " << fLookUpTime * 1000.0f << "ms, worst " << fWorstLookUp * 1e6f << "us" << endl;
+	cout << "  Remove: total " << fRemoveTime * 1000.0f << "ms, worst " << fWorstRemove * 1e6f << "us" << endl;
+}
+
+// Output the total and worst case time of the operations on a table that grows from a small size
+// to the given number of keys, then has them removed, when resizing all at once and incrementally
+void OutputResizeBenchmark( const TUInt32 iNumKeys /*= 1000000*/ )
+{
+	// Sequential UIDs as issued by the entity manager
+	vector<TUInt32> aKeys( iNumKeys );
+	for (TUInt32 iKey = 0; iKey < iNumKeys; ++iKey)
+	{
+		aKeys[iKey] = iKey;
+	}
+
+	cout << "Hash table resize benchmark, " << iNumKeys << " keys" << endl;
+	BenchmarkResize( "Resize all at once", 0, aKeys );
+	BenchmarkResize( "Incremental resize (4 buckets per operation)", 4, aKeys );
+	BenchmarkResize( "Incremental resize (16 buckets per operation)", 16, aKeys );
+	cout << endl;
+}
+
+
 } // namespace gen
@@ -3,7 +3,7 @@
 	Author:       Laurent Noel
 
 	Hash table class storing keys and associated values, supporting quick lookup of a value for a
-	given a key. A hashing function is needed for the mapping and is specified for the constructor
+	given a key. A hash policy is needed for the mapping and is specified as a template parameter
 	
 	This is a template class, which allows any types for keys and values. E.g. to implement entity
 	UIDs the key is an integer (the UID), and the value is an entity pointer. For a phonebook, the
@@ -20,6 +20,8 @@
 #include <math.h>
 #include <iostream>
 #include <list>
+#include <new>
+#include <string>
 using namespace std;
 
 #include "Defines.h"
@@ -47,6 +49,96 @@ TUInt32 AddUpHash( const TUInt8* pKey, const TUInt32 iKeyLen );
 TUInt32 JOneAtATimeHash( const TUInt8* pKey, const TUInt32 iKeyLen );
 
 
+/*------------------------------------------------------------------------------------------------
+	Hash policies
+ ------------------------------------------------------------------------------------------------*/
+
+// The hash table classes take a hash policy as a template parameter. A policy is a type that can
+// be called with a key to give a 4-byte hash:  TUInt32 iHash = hashPolicy( key );
+// As the policy is known at compile time, the hash is a direct call that the compiler can inline
+// rather than a call through a function pointer. Tables are a power of 2 in size and find a
+// bucket by masking off the high bits of the hash, so the low bits must be well distributed.
+// The default policy for a key type is SHash (see below)
+
+// Hash the key as raw bytes with the given hashing function. Suits keys of any type that does not
+// contain pointers (see CHashTable below)
+template <class TKeyType, THashFunction HashFunction = JOneAtATimeHash>
+struct SByteHash
+{
+	TUInt32 operator()( const TKeyType& key ) const
+	{
+		return HashFunction( reinterpret_cast<const TUInt8*>(&key), sizeof(TKeyType) );
+	}
+};
+
+// Hash the key as raw bytes with a hashing function chosen at run time, constructed from the
+// function. This was the only option in earlier versions of CHashTable:
+//     CHashTable<TInt32, string, SFunctionHash<TInt32> > table( 64, AddUpHash );
+template <class TKeyType>
+struct SFunctionHash
+{
+	SFunctionHash( THashFunction pfHashFunction = JOneAtATimeHash ) : m_pfHashFunction( pfHashFunction ) {}
+
+	TUInt32 operator()( const TKeyType& key ) const
+	{
+		return m_pfHashFunction( reinterpret_cast<const TUInt8*>(&key), sizeof(TKeyType) );
+	}
+
+	THashFunction m_pfHashFunction;
+};
+
+// Multiply-shift hash for integer keys of up to 8 bytes. The key is multiplied by a large odd
+// constant (2^64 divided by the golden ratio) and the high 4 bytes of the product are used -
+// these depend on all the lower bits of the key. The best mixed bits are at the top, but tables
+// use the low bits of the hash, so the top bits are also shifted down into the low bits. The
+// high half of the key is first folded into the low half so 8-byte keys differing only in their
+// high bits are spread out too. Far quicker than hashing the key byte by byte
+template <class TKeyType>
+struct SIntegerHash
+{
+	TUInt32 operator()( const TKeyType& key ) const
+	{
+		TUInt64 iKey = static_cast<TUInt64>(key);
+		iKey ^= iKey >> 32;
+		TUInt32 iHash = static_cast<TUInt32>((iKey * 0x9E3779B97F4A7C15ull) >> 32);
+		return iHash ^ (iHash >> 15);
+	}
+};
+
+// Hash an STL string by its characters with the given hashing function. Strings cannot use
+// SByteHash as the bytes of a string object include a pointer to the characters
+template <THashFunction HashFunction = JOneAtATimeHash>
+struct SStringHash
+{
+	TUInt32 operator()( const string& key ) const
+	{
+		return HashFunction( reinterpret_cast<const TUInt8*>(key.data()), static_cast<TUInt32>(key.size()) );
+	}
+};
+
+// Default hash policy: integers use the multiply-shift hash, strings are hashed by their
+// characters and all other types are hashed as raw bytes with the one-at-a-time hash
+template <class TKeyType> struct SHash : SByteHash<TKeyType> {};
+template <> struct SHash<TInt8>   : SIntegerHash<TInt8> {};
+template <> struct SHash<TUInt8>  : SIntegerHash<TUInt8> {};
+template <> struct SHash<TInt16>  : SIntegerHash<TInt16> {};
+template <> struct SHash<TUInt16> : SIntegerHash<TUInt16> {};
+template <> struct SHash<TInt32>  : SIntegerHash<TInt32> {};
+template <> struct SHash<TUInt32> : SIntegerHash<TUInt32> {};
+template <> struct SHash<TInt64>  : SIntegerHash<TInt64> {};
+template <> struct SHash<TUInt64> : SIntegerHash<TUInt64> {};
+template <> struct SHash<string>  : SStringHash<> {};
+
+
+// Output the bucket distribution and lookup time of each hash policy for sets of integer UIDs
+// (sequential and widely spaced) and of entity names, using tables with the given number of keys
+void OutputHashPolicyBenchmark( const TUInt32 iNumKeys = 100000 );
+
+// Output the total and worst case time of the operations on a table that grows from a small size
+// to the given number of keys, then has them removed, when resizing all at once and incrementally
+void OutputResizeBenchmark( const TUInt32 iNumKeys = 1000000 );
+
+
 /*---------------------------------------------------------------------------------------------
 	CHashTable class
 ---------------------------------------------------------------------------------------------*/
@@ -63,10 +155,16 @@ TUInt32 JOneAtATimeHash( const TUInt8* pKey, const TUInt32 iKeyLen );
 // (keys and values are STL strings) - these are standard types have both == and = defined.
 // However, in other cases we may need to implement/overload the == and = operators or the
 // class would not compile.
-// A further restriction is that keys must not contain pointers (although values can). This is
-// because the hash function treats keys as a sequence of raw bytes, pointers are not followed
-// and the data pointed at will not be hashed
-template <class TKeyType, class TValueType>
+// A further restriction is that keys must not contain pointers (although values can) unless the
+// hash policy supports them. This is because the default hash policy for most types treats keys
+// as a sequence of raw bytes, pointers are not followed and the data pointed at will not be
+// hashed. Integer and STL string keys have their own hash policies (see SHash above)
+//
+// When the table is resized, all the keys can be moved to the new buckets at once, or they can be
+// moved a few buckets at a time to avoid a long pause when the table is large (incremental
+// resizing, see the constructor). While an incremental resize is in progress, the old and new
+// buckets are both kept and each key is looked up in whichever holds it
+template <class TKeyType, class TValueType, class THashPolicy = SHash<TKeyType> >
 class CHashTable
 {
 
@@ -74,24 +172,35 @@ class CHashTable
 	Constructors / Destructore
 ---------------------------------------------------------------------------------------------*/
 public:
-	// Constructor takes initial table size, a hashing function, and the maximum load factor
-	// before the table is resized - see data section at end
+	// Constructor takes initial table size, the hash policy object, the maximum load factor
+	// before the table is resized and the number of old buckets to move to the new buckets on
+	// each insertion or removal during a resize, 0 to move them all at once - see data section
+	// at end. The next resize comes after (old size * max load factor) more insertions, so with a
+	// load factor below 1 a rate of 2 or more finishes each resize before the next begins
 	CHashTable
 	(
-		const TUInt32  iInitialSize,         // Initial size for the hash table
-		THashFunction  pfHashFunction,       // Hashing function to use
-		const TFloat32 fMaxLoadFactor = 0.7f // Maximum load factor
-	) : m_kfMaxLoadFactor( fMaxLoadFactor ), m_kpfHashFunction( pfHashFunction )
+		const TUInt32      iInitialSize,                 // Initial size for the hash table
+		const THashPolicy& hashPolicy = THashPolicy(),   // Hash policy to use
+		const TFloat32     fMaxLoadFactor = 0.7f,        // Maximum load factor
+		const TUInt32      iResizeRate = 0               // Buckets moved per operation when resizing
+	) : m_HashPolicy( hashPolicy ), m_kfMaxLoadFactor( fMaxLoadFactor ), m_kiResizeRate( iResizeRate )
 	{
 		GEN_GUARD;
 
-		// Allocate initial hash table array
-		m_iSize = iInitialSize;
-		m_aBuckets = new TBucket[m_iSize];
-		GEN_ASSERT( m_aBuckets, "Fatal memory error reserving hash table memory" );
+		// Allocate initial hash table array, rounding the size up to a power of 2
+		m_iSize = 1;
+		while (m_iSize < iInitialSize)
+		{
+			m_iSize *= 2;
+		}
+		m_aBuckets = AllocateBuckets( m_iSize );
+		ConstructBuckets( m_aBuckets, 0, m_iSize );
 
-		// Starting with no hash table entries
+		// Starting with no hash table entries and no resize in progress
 		m_iNumEntries = 0;
+		m_aOldBuckets = 0;
+		m_iOldSize = 0;
+		m_iNextOldBucket = 0;
 
 		GEN_ENDGUARD;
 	}
@@ -108,7 +217,9 @@ public:
 	// Destructor to free hash table memory
 	~CHashTable()
 	{
-		delete[] m_aBuckets;
+		AbandonResize();
+		DestroyBuckets( m_aBuckets, 0, m_iSize );
+		FreeBuckets( m_aBuckets );
 	}
 
 
@@ -124,14 +235,14 @@ public:
 		TValueType*     pValue
 	)
 	{
-		// Find the index of the bucket associated with this key (will use hashing function)
-		TUInt32 iBucket = FindBucket( key );
+		// Find the bucket associated with this key (will use hashing function)
+		TBucket& bucket = FindBucket( key );
 
 		// Search the bucket to find the the given key
-		TKeyValuePairIter itKeyValuePair = FindKeyValuePair( iBucket, key );
+		TKeyValuePairIter itKeyValuePair = FindKeyValuePair( bucket, key );
 
 		// Not found (reached end of list), return false
-		if (itKeyValuePair == m_aBuckets[iBucket].end())
+		if (itKeyValuePair == bucket.end())
 		{
 			return false;
 		}
@@ -149,12 +260,15 @@ public:
 		const TValueType& value
 	)
 	{
-		// Find the index of the bucket associated with this key (will use hashing function)
-		TUInt32 iBucket = FindBucket( key );
+		// Continue any resize in progress
+		MoveOldBuckets( m_kiResizeRate );
+
+		// Find the bucket associated with this key (will use hashing function)
+		TBucket* pBucket = &FindBucket( key );
 
 		// See if given key already exists in the bucket 
-		TKeyValuePairIter itKeyValuePair = FindKeyValuePair( iBucket, key );
-		if (itKeyValuePair != m_aBuckets[iBucket].end())
+		TKeyValuePairIter itKeyValuePair = FindKeyValuePair( *pBucket, key );
+		if (itKeyValuePair != pBucket->end())
 		{
 			// If key already exists, simply update the value associated with it
 			itKeyValuePair->value = value;
@@ -165,14 +279,14 @@ public:
 			if (m_iNumEntries > m_iSize * m_kfMaxLoadFactor)
 			{
 				Resize( m_iSize * 2 );
-				iBucket = FindBucket( key ); // Find new bucket for key after resizing
+				pBucket = &FindBucket( key ); // Find new bucket for key after resizing
 			}
 
 			// Create a new key/value pair and add it to the list in this bucket
 			TKeyValuePair newPair;
 			newPair.key = key;
 			newPair.value = value;
-			m_aBuckets[iBucket].push_back( newPair );
+			pBucket->push_back( newPair );
 
 			// Increase total number of entries in hash table
 			++m_iNumEntries;
@@ -183,20 +297,23 @@ public:
 	// Remove the given key (and associated value) from the table, returns false if not found
 	bool RemoveKey(	const TKeyType& key )
 	{
-		// Find the index of the bucket associated with this key (will use hashing function)
-		TUInt32 iBucket = FindBucket( key );
+		// Continue any resize in progress
+		MoveOldBuckets( m_kiResizeRate );
+
+		// Find the bucket associated with this key (will use hashing function)
+		TBucket& bucket = FindBucket( key );
 
 		// Search the bucket to find the the given key
-		TKeyValuePairIter itKeyValuePair = FindKeyValuePair( iBucket, key );
+		TKeyValuePairIter itKeyValuePair = FindKeyValuePair( bucket, key );
 
 		// If not found then nothing to do
-		if (itKeyValuePair == m_aBuckets[iBucket].end())
+		if (itKeyValuePair == bucket.end())
 		{   
 			return false;
 		}
 
 		// Remove the found key from the bucket
-		m_aBuckets[iBucket].erase( itKeyValuePair );
+		bucket.erase( itKeyValuePair );
 
 		// Decrease number of table entries - note that table is never resized downwards
 		--m_iNumEntries; 
@@ -208,10 +325,25 @@ public:
 	// Remove all keys and associated values
 	void RemoveAllKeys()
 	{
+		AbandonResize();
 		for (TUInt32 iBucket = 0; iBucket < m_iSize; ++iBucket)
 		{
 			m_aBuckets[iBucket].clear();
 		}
+		m_iNumEntries = 0;
+	}
+
+
+	// Return true if an incremental resize is in progress
+	bool IsResizing() const
+	{
+		return m_aOldBuckets != 0;
+	}
+
+	// Return the number of buckets in the table (after any resize in progress)
+	TUInt32 GetSize() const
+	{
+		return m_iSize;
 	}
 
 
@@ -221,8 +353,9 @@ public:
 	// have the same hash and so end up in the same bucket. This reduces the efficiency of the
 	// hash table - we find the bucket associated with our key, if it has multiple entries, we
 	// must search through them all. So we aim for a hash function that minimises the number
-	// of such situations. This function will show up good / bad hash functions
-	void OutputDistribution() const
+	// of such situations. This function will show up good / bad hash functions. The bucket
+	// counts can be left out for large tables, leaving just the summary
+	void OutputDistribution( const bool bShowBuckets = true ) const
 	{
 		cout << "Hash Table Distribution:" << endl << endl;
 		
@@ -230,31 +363,57 @@ public:
 		// efficiency to look up a key
 		TUInt32 iAverageBucketSize = 0;
 		TUInt32 iUsedBuckets = 0;
+		TUInt32 iMaxBucketSize = 0;
 
 		// Output in a square based on table size
 		TUInt32 iBucket = 0;
 		while (iBucket != m_iSize)
 		{
-			TUInt32 iCollision = static_cast<TUInt32>(m_aBuckets[iBucket].size());
-			// Output a digit if less than 10 entries in a bucket
-			if (iCollision < 10)
+			// New buckets are not constructed until their keys are moved during a resize
+			TUInt32 iCollision = 0;
+			if (!m_aOldBuckets || (iBucket & (m_iOldSize - 1)) < m_iNextOldBucket)
 			{
-				cout << iCollision;
+				iCollision = static_cast<TUInt32>(m_aBuckets[iBucket].size());
 			}
-			else
+			if (bShowBuckets)
 			{
-				cout << '+'; // Output '+' for 10 or more entries
+				// Output a digit if less than 10 entries in a bucket
+				if (iCollision < 10)
+				{
+					cout << iCollision;
+				}
+				else
+				{
+					cout << '+'; // Output '+' for 10 or more entries
+				}
 			}
 			if (iCollision > 0)
 			{
 				iAverageBucketSize += iCollision;
 				++iUsedBuckets;
 			}
+			if (iCollision > iMaxBucketSize)
+			{
+				iMaxBucketSize = iCollision;
+			}
 			++iBucket;
 		}
 		cout << endl << "% used buckets: " << 100.0f * static_cast<float>(iUsedBuckets) / m_iSize;
 		cout << endl << "Average (used) bucket size: " 
 		     << static_cast<float>(iAverageBucketSize) / iUsedBuckets << endl;
+
+		// Compare with the average used bucket size expected if the hash placed keys in buckets
+		// at random, which is L / (1 - e^-L) for a load factor L. A good hash function comes close
+		float fLoadFactor = static_cast<float>(m_iNumEntries) / m_iSize;
+		if (fLoadFactor > 0.0f)
+		{
+			cout << "Expected for random hash: " << fLoadFactor / (1.0f - expf( -fLoadFactor )) << endl;
+		}
+		cout << "Largest bucket size: " << iMaxBucketSize << endl;
+		if (m_aOldBuckets)
+		{
+			cout << "Resizing, old buckets not yet moved (not shown): " << m_iOldSize - m_iNextOldBucket << endl;
+		}
 		cout << endl;
 	}
 
@@ -287,21 +446,24 @@ private:
 		Support functions
 	---------------------------------------------------------------------------------------------*/
 
-	// Find the index of the bucket that should contain the given key
-	TUInt32 FindBucket(	const TKeyType& key	) const
+	// Find the bucket that should contain the given key
+	TBucket& FindBucket( const TKeyType& key ) const
 	{
-		// Get a pointer to the key as raw bytes - this cast is OK for this kind of purpose
-		const TUInt8* pKeyData = reinterpret_cast<const TUInt8*>(&key);
-
-		// Use hashing function to convert key data to a single 4-byte integer
-		TUInt32 iIndex = m_kpfHashFunction( pKeyData, sizeof(TKeyType) );
+		// Use the hash policy to convert the key to a single 4-byte integer
+		TUInt32 iHash = m_HashPolicy( key );
 		
-		// Convert this 4-byte hash value to a bucket index. We have m_iSize buckets, so just
-		// use the integer modulus operator. Could use faster bitwise operator if number of
-		// buckets was a power of 2, but will deal with the general case here
-		iIndex %= m_iSize;
-
-		return iIndex;
+		// Convert this 4-byte hash value to a bucket index. We have m_iSize buckets, a power of 2,
+		// so keep the low bits of the hash with a bitwise and rather than the slower modulus.
+		// During a resize the key is still in the old buckets if its old bucket has not been moved
+		if (m_aOldBuckets)
+		{
+			TUInt32 iOldIndex = iHash & (m_iOldSize - 1);
+			if (iOldIndex >= m_iNextOldBucket)
+			{
+				return m_aOldBuckets[iOldIndex];
+			}
+		}
+		return m_aBuckets[iHash & (m_iSize - 1)];
 	}
 
 
@@ -309,13 +471,13 @@ private:
 	// Returns the end of list iterator if not found
 	TKeyValuePairIter FindKeyValuePair
 	(
-		const int       iBucket,
+		TBucket&        bucket,
 		const TKeyType& key
 	) const
 	{
 		// Start at beginning of bucket and step through each key/value pair
-		TKeyValuePairIter itKeyValuePair = m_aBuckets[iBucket].begin();
-		while (itKeyValuePair != m_aBuckets[iBucket].end())
+		TKeyValuePairIter itKeyValuePair = bucket.begin();
+		while (itKeyValuePair != bucket.end())
 		{
 			// If we find a matching key, then quit loop
 			if (key == itKeyValuePair->key)
@@ -329,34 +491,110 @@ private:
 		return itKeyValuePair;
 	}
 
-	// Resize the hash table - reinserts all keys
+	// Bucket memory is allocated and buckets constructed separately, so the new buckets of an
+	// incremental resize are constructed a few at a time as keys are moved into them. Constructing
+	// a bucket may allocate memory (e.g. the list sentinel node with Visual C++), so constructing
+	// them all at once would cost as much as moving the keys all at once
+
+	// Allocate uninitialised memory for the given number of buckets / free it
+	static TBucket* AllocateBuckets( const TUInt32 iNumBuckets )
+	{
+		return static_cast<TBucket*>(::operator new( iNumBuckets * sizeof(TBucket) ));
+	}
+	static void FreeBuckets( TBucket* aBuckets )
+	{
+		::operator delete( aBuckets );
+	}
+
+	// Construct / destroy the buckets in the given range of a bucket array
+	static void ConstructBuckets( TBucket* aBuckets, const TUInt32 iFirst, const TUInt32 iLast )
+	{
+		for (TUInt32 iBucket = iFirst; iBucket < iLast; ++iBucket)
+		{
+			new (&aBuckets[iBucket]) TBucket;
+		}
+	}
+	static void DestroyBuckets( TBucket* aBuckets, const TUInt32 iFirst, const TUInt32 iLast )
+	{
+		for (TUInt32 iBucket = iFirst; iBucket < iLast; ++iBucket)
+		{
+			aBuckets[iBucket].~TBucket();
+		}
+	}
+
+	// Resize the hash table to double its size - moves all keys to the new buckets, or starts
+	// moving them if resizing incrementally
 	void Resize( const TUInt32 iNewSize )
 	{
 		GEN_GUARD;
+		GEN_ASSERT( iNewSize == m_iSize * 2, "Hash tables only grow by doubling" );
+
+		// Finish any previous resize (only needed if the resize rate is too low)
+		MoveOldBuckets( m_iOldSize );
 
 		// Store old buckets and size
-		TUInt32 iOldSize = m_iSize;
-		TBucket* aOldBuckets = m_aBuckets;
+		m_iOldSize = m_iSize;
+		m_aOldBuckets = m_aBuckets;
+		m_iNextOldBucket = 0;
 
-		// Update size and create new set of buckets
+		// Update size and allocate the new set of buckets, which are constructed as keys are moved
 		m_iSize = iNewSize;
-		m_aBuckets = new TBucket[m_iSize];
-		GEN_ASSERT( m_aBuckets, "Fatal memory error reserving hash table memory" );
+		m_aBuckets = AllocateBuckets( m_iSize );
 
-		// Go through old buckets and set each key/value pair into new buckets
-		m_iNumEntries = 0;
-		for (TUInt32 iBucket = 0; iBucket < iOldSize; ++iBucket)
+		MoveOldBuckets( m_kiResizeRate > 0 ? m_kiResizeRate : m_iOldSize );
+
+		GEN_ENDGUARD;
+	}
+
+	// Move the key/value pairs in up to the given number of old buckets to the new buckets during
+	// a resize. The list nodes are moved (spliced) rather than copied, so no memory is allocated.
+	// The table doubles in size, so the keys in old bucket i go to new bucket i or i + old size -
+	// these two new buckets are constructed and the old bucket destroyed as it is moved
+	void MoveOldBuckets( const TUInt32 iNumBuckets )
+	{
+		if (!m_aOldBuckets)
+		{
+			return;
+		}
+
+		TUInt32 iRemaining = m_iOldSize - m_iNextOldBucket;
+		TUInt32 iLastBucket = m_iNextOldBucket + (iNumBuckets < iRemaining ? iNumBuckets : iRemaining);
+		ConstructBuckets( m_aBuckets, m_iNextOldBucket, iLastBucket );
+		ConstructBuckets( m_aBuckets, m_iOldSize + m_iNextOldBucket, m_iOldSize + iLastBucket );
+		while (m_iNextOldBucket < iLastBucket)
 		{
-			while (aOldBuckets[iBucket].size())
+			TBucket& oldBucket = m_aOldBuckets[m_iNextOldBucket];
+			while (!oldBucket.empty())
 			{
-				SetKeyValue( aOldBuckets[iBucket].front().key, aOldBuckets[iBucket].front().value );
-				aOldBuckets[iBucket].pop_front(); // Delete each old key/value pair after it is copied
+				TBucket& newBucket = m_aBuckets[m_HashPolicy( oldBucket.front().key ) & (m_iSize - 1)];
+				newBucket.splice( newBucket.end(), oldBucket, oldBucket.begin() );
 			}
+			oldBucket.~TBucket();
+			++m_iNextOldBucket;
 		}
 
-		delete[] aOldBuckets;
+		// Free the old buckets when all have been moved
+		if (m_iNextOldBucket == m_iOldSize)
+		{
+			FreeBuckets( m_aOldBuckets );
+			m_aOldBuckets = 0;
+		}
+	}
 
-		GEN_ENDGUARD;
+	// Stop any resize in progress, discarding the keys in the old buckets that have not been
+	// moved (used when all keys are removed). All the new buckets are constructed
+	void AbandonResize()
+	{
+		if (!m_aOldBuckets)
+		{
+			return;
+		}
+
+		DestroyBuckets( m_aOldBuckets, m_iNextOldBucket, m_iOldSize );
+		ConstructBuckets( m_aBuckets, m_iNextOldBucket, m_iOldSize );
+		ConstructBuckets( m_aBuckets, m_iOldSize + m_iNextOldBucket, m_iSize );
+		FreeBuckets( m_aOldBuckets );
+		m_aOldBuckets = 0;
 	}
 
 
@@ -366,16 +604,25 @@ private:
 
 	TBucket* m_aBuckets;    // Dynamically allocated array of buckets of key/value pairs
 	TUInt32  m_iSize;       // Size (capacity) of the table - number of buckets
-	TUInt32  m_iNumEntries; // Number of key/value pairs in the table
+	TUInt32  m_iNumEntries; // Number of key/value pairs in the table (old and new buckets)
 
-	// Hash function to use is stored as a function pointer - converts a key given as a
-	// sequence of bytes into a 4-byte unsigned integer
-	const THashFunction m_kpfHashFunction;
+	// Buckets from before an incremental resize, 0 if no resize is in progress. Old buckets before
+	// m_iNextOldBucket have been moved to the new buckets
+	TBucket* m_aOldBuckets;
+	TUInt32  m_iOldSize;
+	TUInt32  m_iNextOldBucket;
+
+	// Hash policy object - converts a key into a 4-byte unsigned integer (see SHash)
+	THashPolicy m_HashPolicy;
 
 	// If table becomes too full, then it is increased in size to avoid hash collisions. The max
 	// load factor defines how full it needs to be before this happens. In this implementation, the
 	// table is never decreased in size
 	const TFloat32 m_kfMaxLoadFactor;
+
+	// Number of old buckets moved to the new buckets on each insertion or removal during a
+	// resize, or 0 to move all buckets as soon as the table is resized
+	const TUInt32 m_kiResizeRate;
 };
 
 
@@ -0,0 +1,142 @@
+/*******************************************
+	CTimerWheel.cpp
+
+	Timing wheel benchmark
+********************************************/
+
+#include <iostream>
+#include <queue>
+#include <functional>
+using namespace std;
+
+#include "CTimerWheel.h"
+#include "CTimer.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Benchmark
+
+// Timer payload used by the benchmark: an identifier and the tick the timer should expire on
+struct SBenchmarkTimer
+{
+	TUInt32 id;
+	TUInt32 expiryTick;
+
+	bool operator>( const SBenchmarkTimer& other ) const
+	{
+		return expiryTick > other.expiryTick;
+	}
+};
+
+// Longest delay used, one minute at one millisecond per tick
+static const TUInt32 MaxBenchmarkDelay = 60000;
+
+// Delay for a timer given its identifier and the tick it is added on. Does not depend on the
+// order timers expire within a tick, so both containers see the same timers
+static TUInt32 BenchmarkDelay( TUInt32 id, TUInt32 tick )
+{
+	TUInt32 hash = (id * 2654435761u) ^ (tick * 2246822519u);
+	hash ^= hash >> 15;
+	hash *= 2654435761u;
+	hash ^= hash >> 13;
+	return 1 + hash % MaxBenchmarkDelay;
+}
+
+// State shared with the wheel's expire function
+struct SWheelBenchmark
+{
+	CTimerWheel<SBenchmarkTimer>* wheel;
+	TUInt32 numExpired;
+	TUInt32 numErrors; // Timers expiring on the wrong tick
+	TUInt32 checksum;
+};
+
+// Check an expired timer and add it again with a new delay
+static void WheelTimerExpired( const SBenchmarkTimer& timer, void* data )
+{
+	SWheelBenchmark* benchmark = static_cast<SWheelBenchmark*>(data);
+	TUInt32 tick = benchmark->wheel->CurrentTick();
+	if (timer.expiryTick != tick)
+	{
+		++benchmark->numErrors;
+	}
+	++benchmark->numExpired;
+	benchmark->checksum += timer.id * tick;
+
+	SBenchmarkTimer newTimer;
+	newTimer.id = timer.id;
+	TUInt32 delay = BenchmarkDelay( timer.id, tick );
+	newTimer.expiryTick = tick + delay;
+	benchmark->wheel->AddTimer( delay, newTimer );
+}
+
+// Output timings comparing CTimerWheel with a priority queue holding the given number of pending
+// timers, for adding timers, and for advancing time while expired timers are added again
+void OutputTimerWheelBenchmark( TUInt32 numTimers /*= 100000*/ )
+{
+	const TUInt32 NumTicks = 20000; // 20 seconds at 1ms per tick
+	CTimer timer;
+
+	// Timing wheel
+	CTimerWheel<SBenchmarkTimer> wheel;
+	SWheelBenchmark wheelBenchmark = { &wheel, 0, 0, 0 };
+	timer.Reset();
+	for (TUInt32 id = 0; id < numTimers; ++id)
+	{
+		SBenchmarkTimer newTimer;
+		newTimer.id = id;
+		newTimer.expiryTick = BenchmarkDelay( id, 0 );
+		wheel.AddTimer( newTimer.expiryTick, newTimer );
+	}
+	TFloat32 wheelAddTime = timer.GetLapTime();
+	wheel.Advance( NumTicks, WheelTimerExpired, &wheelBenchmark );
+	TFloat32 wheelAdvanceTime = timer.GetLapTime();
+
+	// Priority queue (binary heap) with the earliest timer at the top
+	priority_queue<SBenchmarkTimer, vector<SBenchmarkTimer>, greater<SBenchmarkTimer> > queue;
+	TUInt32 queueExpired = 0;
+	TUInt32 queueChecksum = 0;
+	timer.Reset();
+	for (TUInt32 id = 0; id < numTimers; ++id)
+	{
+		SBenchmarkTimer newTimer;
+		newTimer.id = id;
+		newTimer.expiryTick = BenchmarkDelay( id, 0 );
+		queue.push( newTimer );
+	}
+	TFloat32 queueAddTime = timer.GetLapTime();
+	for (TUInt32 tick = 1; tick <= NumTicks; ++tick)
+	{
+		while (!queue.empty() && queue.top().expiryTick <= tick)
+		{
+			SBenchmarkTimer expiredTimer = queue.top();
+			queue.pop();
+			++queueExpired;
+			queueChecksum += expiredTimer.id * tick;
+
+			expiredTimer.expiryTick = tick + BenchmarkDelay( expiredTimer.id, tick );
+			queue.push( expiredTimer );
+		}
+	}
+	TFloat32 queueAdvanceTime = timer.GetLapTime();
+
+	cout << "Timer wheel benchmark, " << numTimers << " pending timers, " << NumTicks << " ticks "
+	     << "(timer wheel / priority queue):" << endl;
+	cout << "  Add timer:          " << wheelAddTime * 1e9f / numTimers << "ns / "
+	     << queueAddTime * 1e9f / numTimers << "ns" << endl;
+	cout << "  Expire and re-add:  " << wheelAdvanceTime * 1e9f / wheelBenchmark.numExpired << "ns / "
+	     << queueAdvanceTime * 1e9f / queueExpired << "ns ("
+	     << wheelBenchmark.numExpired << " timers expired)" << endl;
+	cout << "  Advance one tick:   " << wheelAdvanceTime * 1e6f / NumTicks << "us / "
+	     << queueAdvanceTime * 1e6f / NumTicks << "us" << endl;
+	if (wheelBenchmark.numErrors != 0 || wheelBenchmark.numExpired != queueExpired ||
+	    wheelBenchmark.checksum != queueChecksum)
+	{
+		cout << "  MISMATCH: " << wheelBenchmark.numErrors << " timers expired on the wrong tick" << endl;
+	}
+}
+
+
+} // namespace gen
@@ -0,0 +1,252 @@
+/*******************************************
+	CTimerWheel.h
+
+	Hierarchical timing wheel holding timers
+	that expire after a number of ticks
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "Error.h"
+
+namespace gen
+{
+
+// Holds a large number of timers, each with a payload, and calls a function with the payload of
+// each timer as it expires. Time is measured in whole ticks. Adding a timer and expiring a timer
+// take constant time however many timers are pending, unlike a priority queue
+//
+// Timers are kept in lists in four wheels of 256 slots. The first wheel has a slot for each of
+// the next 256 ticks. Each slot of the second wheel covers 256 ticks, each slot of the third 256^2
+// ticks and each slot of the fourth 256^3. A timer is put in the slot of the first wheel that
+// covers its expiry tick without wrapping round. When the first wheel has passed all its slots,
+// the timers in the next slot of the second wheel are spread over the first wheel, and so on up
+// the wheels (cascading). A timer is moved at most three times however long its delay
+//
+// Timers that expire on the same tick expire in the order they were added, unless they were added
+// to different wheels. The payload type must be copyable. Not thread-safe
+template <class TPayload>
+class CTimerWheel
+{
+/////////////////////////////////////
+//	Public types
+public:
+
+	// Function called with the payload of each timer that expires, data is the pointer passed
+	// to Advance
+	typedef void (*TExpireFunction)( const TPayload& payload, void* data );
+
+
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor creates an empty wheel at tick 0
+	CTimerWheel()
+	{
+		Clear();
+	}
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CTimerWheel( const CTimerWheel& );
+	CTimerWheel& operator=( const CTimerWheel& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	// Add a timer that expires the given number of ticks from now, at least 1. The payload is
+	// passed to the expire function when it does
+	void AddTimer( TUInt32 ticks, const TPayload& payload )
+	{
+		GEN_ASSERT( ticks > 0, "Timers must expire after at least one tick" );
+
+		// Take a timer from the free list, or add one to the storage
+		TUInt32 timer = m_FreeTimer;
+		if (timer != NoTimer)
+		{
+			m_FreeTimer = m_Timers[timer].next;
+		}
+		else
+		{
+			timer = static_cast<TUInt32>(m_Timers.size());
+			m_Timers.push_back( STimer() );
+		}
+		m_Timers[timer].expiryTick = m_Tick + ticks;
+		m_Timers[timer].payload = payload;
+		InsertTimer( timer );
+		++m_NumTimers;
+	}
+
+	// Advance the given number of ticks, calling the given function for each timer that expires in
+	// order of expiry. The function may add new timers
+	void Advance( TUInt32 ticks, TExpireFunction expire, void* data )
+	{
+		while (ticks--)
+		{
+			++m_Tick;
+
+			// Cascade when the first wheel has gone round, and the second wheel when it has gone
+			// round, and so on
+			TUInt32 slot = m_Tick & SlotMask;
+			if (slot == 0)
+			{
+				for (TUInt32 wheel = 1; wheel < NumWheels; ++wheel)
+				{
+					TUInt32 wheelSlot = (m_Tick >> (wheel * SlotBits)) & SlotMask;
+					Cascade( wheel, wheelSlot );
+					if (wheelSlot != 0)
+					{
+						break;
+					}
+				}
+			}
+
+			// Detach the list of expiring timers so the expire function can add timers safely.
+			// Copy each payload before freeing its timer as adding timers may move the storage
+			TUInt32 timer = m_Slots[0][slot].first;
+			m_Slots[0][slot].first = m_Slots[0][slot].last = NoTimer;
+			while (timer != NoTimer)
+			{
+				TUInt32 nextTimer = m_Timers[timer].next;
+				TPayload payload = m_Timers[timer].payload;
+				m_Timers[timer].next = m_FreeTimer;
+				m_FreeTimer = timer;
+				--m_NumTimers;
+
+				expire( payload, data );
+				timer = nextTimer;
+			}
+		}
+	}
+
+	// Remove all timers without calling the expire function, and go back to tick 0
+	void Clear()
+	{
+		for (TUInt32 wheel = 0; wheel < NumWheels; ++wheel)
+		{
+			for (TUInt32 slot = 0; slot < NumSlots; ++slot)
+			{
+				m_Slots[wheel][slot].first = m_Slots[wheel][slot].last = NoTimer;
+			}
+		}
+
+		// Rebuild the free list from all the timer storage
+		m_FreeTimer = NoTimer;
+		for (TUInt32 timer = static_cast<TUInt32>(m_Timers.size()); timer-- > 0; )
+		{
+			m_Timers[timer].next = m_FreeTimer;
+			m_FreeTimer = timer;
+		}
+		m_Tick = 0;
+		m_NumTimers = 0;
+	}
+
+	// Number of timers that have not expired
+	TUInt32 NumTimers() const
+	{
+		return m_NumTimers;
+	}
+
+	// Number of ticks advanced (wraps round)
+	TUInt32 CurrentTick() const
+	{
+		return m_Tick;
+	}
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	// Four wheels of 256 slots cover the full range of 32-bit tick counts
+	static const TUInt32 SlotBits = 8;
+	static const TUInt32 NumSlots = 1 << SlotBits;
+	static const TUInt32 SlotMask = NumSlots - 1;
+	static const TUInt32 NumWheels = 4;
+
+	// Index used for the end of a list
+	static const TUInt32 NoTimer = 0xffffffff;
+
+	// A timer, linked into the list for a slot or into the free list
+	struct STimer
+	{
+		TUInt32  expiryTick;
+		TUInt32  next;
+		TPayload payload;
+	};
+
+	// A list of timers, added at the end
+	struct SSlot
+	{
+		TUInt32 first;
+		TUInt32 last;
+	};
+
+	// Add a timer to the end of the list for the slot covering its expiry tick, in the first wheel
+	// that reaches that far. A timer moved down by a cascade may expire on the current tick, it is
+	// put in the current slot of the first wheel, which is about to be expired
+	void InsertTimer( TUInt32 timer )
+	{
+		TUInt32 expiryTick = m_Timers[timer].expiryTick;
+		TUInt32 ticksLeft = expiryTick - m_Tick;
+		TUInt32 wheel = 0;
+		while (wheel < NumWheels - 1 && ticksLeft >= (1u << ((wheel + 1) * SlotBits)))
+		{
+			++wheel;
+		}
+		SSlot& slot = m_Slots[wheel][(expiryTick >> (wheel * SlotBits)) & SlotMask];
+
+		m_Timers[timer].next = NoTimer;
+		if (slot.last != NoTimer)
+		{
+			m_Timers[slot.last].next = timer;
+		}
+		else
+		{
+			slot.first = timer;
+		}
+		slot.last = timer;
+	}
+
+	// Move the timers in the given slot of the given wheel into the lower wheels
+	void Cascade( TUInt32 wheel, TUInt32 slot )
+	{
+		TUInt32 timer = m_Slots[wheel][slot].first;
+		m_Slots[wheel][slot].first = m_Slots[wheel][slot].last = NoTimer;
+		while (timer != NoTimer)
+		{
+			TUInt32 nextTimer = m_Timers[timer].next;
+			InsertTimer( timer );
+			timer = nextTimer;
+		}
+	}
+
+
+/////////////////////////////////////
+//	Data
+private:
+
+	// Storage for all timers, unused timers are linked into a free list
+	vector<STimer> m_Timers;
+	TUInt32        m_FreeTimer;
+
+	// The lists of timers in each slot of each wheel
+	SSlot m_Slots[NumWheels][NumSlots];
+
+	TUInt32 m_Tick;      // Ticks advanced so far
+	TUInt32 m_NumTimers; // Timers that have not expired
+};
+
+
+// Output timings comparing CTimerWheel with a priority queue holding the given number of pending
+// timers, for adding timers, and for advancing time while expired timers are added again
+void OutputTimerWheelBenchmark( TUInt32 numTimers = 100000 );
+
+
+} // namespace gen
@@ -0,0 +1,170 @@
+/*******************************************
+	CWorkerPool.cpp
+
+	Persistent worker threads for splitting
+	a loop across processor cores
+********************************************/
+
+#include "BaseMath.h"
+#include "CWorkerPool.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Constructor takes the total number of threads to use, including the calling thread
+CWorkerPool::CWorkerPool( TUInt32 numThreads /*= 1*/ )
+{
+	m_JobNumber = 0;
+	m_Job = 0;
+	m_JobData = 0;
+	m_JobItems = 0;
+	m_WorkersBusy = 0;
+	m_Stopping = false;
+	SetNumThreads( numThreads );
+}
+
+// Destructor stops and joins the worker threads
+CWorkerPool::~CWorkerPool()
+{
+	StopWorkers();
+}
+
+
+/////////////////////////////////////
+// Public interface
+
+// Change the total number of threads (including the calling thread), minimum 1
+void CWorkerPool::SetNumThreads( TUInt32 numThreads )
+{
+	numThreads = Max( numThreads, 1u );
+	if (numThreads == GetNumThreads())
+	{
+		return;
+	}
+	StopWorkers();
+	StartWorkers( numThreads - 1 );
+}
+
+// Run the job over items [0, numItems), split into one contiguous range per thread. Returns
+// when every range is complete
+void CWorkerPool::ParallelFor( TUInt32 numItems, TParallelJob job, void* data )
+{
+	if (m_Workers.empty())
+	{
+		job( data, 0, numItems, 0 );
+		return;
+	}
+
+	// Publish the job and wake the workers
+	{
+		unique_lock<mutex> lock( m_Mutex );
+		m_Job = job;
+		m_JobData = data;
+		m_JobItems = numItems;
+		m_WorkersBusy = static_cast<TUInt32>(m_Workers.size());
+		++m_JobNumber;
+	}
+	m_JobReady.notify_all();
+
+	// The calling thread takes the first range
+	TUInt32 first, last;
+	JobRange( 0, first, last );
+	job( data, first, last, 0 );
+
+	// Wait for the workers to finish their ranges
+	unique_lock<mutex> lock( m_Mutex );
+	while (m_WorkersBusy > 0)
+	{
+		m_JobDone.wait( lock );
+	}
+}
+
+// Number of hardware threads available, at least 1
+TUInt32 CWorkerPool::NumHardwareThreads()
+{
+	return Max( static_cast<TUInt32>(thread::hardware_concurrency()), 1u );
+}
+
+
+/////////////////////////////////////
+// Private interface
+
+// Start the given number of worker threads
+void CWorkerPool::StartWorkers( TUInt32 numWorkers )
+{
+	m_Stopping = false;
+	for (TUInt32 worker = 0; worker < numWorkers; ++worker)
+	{
+		m_Workers.push_back( thread( &CWorkerPool::WorkerMain, this, worker + 1, m_JobNumber ) );
+	}
+}
+
+// Stop and join all worker threads
+void CWorkerPool::StopWorkers()
+{
+	{
+		unique_lock<mutex> lock( m_Mutex );
+		m_Stopping = true;
+	}
+	m_JobReady.notify_all();
+	for (TUInt32 worker = 0; worker < m_Workers.size(); ++worker)
+	{
+		m_Workers[worker].join();
+	}
+	m_Workers.clear();
+}
+
+// Worker thread main loop - waits for each job after the given job number and runs its range
+void CWorkerPool::WorkerMain( TUInt32 threadIndex, TUInt32 firstJob )
+{
+	TUInt32 lastJob = firstJob;
+	while (true)
+	{
+		TParallelJob job;
+		void* data;
+		{
+			unique_lock<mutex> lock( m_Mutex );
+			while (!m_Stopping && m_JobNumber == lastJob)
+			{
+				m_JobReady.wait( lock );
+			}
+			if (m_Stopping)
+			{
+				return;
+			}
+			lastJob = m_JobNumber;
+			job = m_Job;
+			data = m_JobData;
+		}
+
+		TUInt32 first, last;
+		JobRange( threadIndex, first, last );
+		if (first < last)
+		{
+			job( data, first, last, threadIndex );
+		}
+
+		{
+			unique_lock<mutex> lock( m_Mutex );
+			--m_WorkersBusy;
+		}
+		m_JobDone.notify_one();
+	}
+}
+
+// Range of items for the given thread in the current job - items are split as evenly as
+// possible with the earlier threads taking any remainder
+void CWorkerPool::JobRange( TUInt32 threadIndex, TUInt32& first, TUInt32& last )
+{
+	TUInt32 numThreads = GetNumThreads();
+	TUInt32 perThread = m_JobItems / numThreads;
+	TUInt32 remainder = m_JobItems % numThreads;
+	first = threadIndex * perThread + Min( threadIndex, remainder );
+	last = first + perThread + (threadIndex < remainder ? 1 : 0);
+}
+
+
+} // namespace gen
@@ -0,0 +1,99 @@
+/*******************************************
+	CWorkerPool.h
+
+	Persistent worker threads for splitting
+	a loop across processor cores
+********************************************/
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+#include "Defines.h"
+
+namespace gen
+{
+
+// Function run by the pool on a range of items [first, last). The thread index is 0 for the
+// calling thread and 1 to (number of threads - 1) for the workers, so it can select per-thread
+// data without locking
+typedef void (*TParallelJob)( void* data, TUInt32 first, TUInt32 last, TUInt32 threadIndex );
+
+
+// A fixed set of worker threads that wait for jobs. A job is split into one contiguous range of
+// items per thread, with the calling thread taking the first range, and ParallelFor returns
+// once all ranges are complete. Threads are kept between jobs so each job only costs a wake-up
+// rather than thread creation. Only one thread may submit jobs
+class CWorkerPool
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor takes the total number of threads to use, including the calling thread. One
+	// thread runs jobs on the calling thread only
+	CWorkerPool( TUInt32 numThreads = 1 );
+
+	// Destructor stops and joins the worker threads
+	~CWorkerPool();
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CWorkerPool( const CWorkerPool& );
+	CWorkerPool& operator=( const CWorkerPool& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	// Change the total number of threads (including the calling thread), minimum 1. Must not be
+	// called during a job
+	void SetNumThreads( TUInt32 numThreads );
+
+	TUInt32 GetNumThreads()
+	{
+		return static_cast<TUInt32>(m_Workers.size()) + 1;
+	}
+
+	// Run the job over items [0, numItems), split into one contiguous range per thread. Returns
+	// when every range is complete
+	void ParallelFor( TUInt32 numItems, TParallelJob job, void* data );
+
+	// Number of hardware threads available, at least 1
+	static TUInt32 NumHardwareThreads();
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	// Start / stop the worker threads
+	void StartWorkers( TUInt32 numWorkers );
+	void StopWorkers();
+
+	// Worker thread main loop - waits for each job after the given job number and runs its range
+	void WorkerMain( TUInt32 threadIndex, TUInt32 firstJob );
+
+	// Range of items for the given thread in the current job
+	void JobRange( TUInt32 threadIndex, TUInt32& first, TUInt32& last );
+
+	vector<thread> m_Workers;
+
+	// Current job, changed under the mutex. Workers run a job when the job number changes
+	mutex              m_Mutex;
+	condition_variable m_JobReady;
+	condition_variable m_JobDone;
+	TUInt32            m_JobNumber;
+	TParallelJob       m_Job;
+	void*              m_JobData;
+	TUInt32            m_JobItems;
+	TUInt32            m_WorkersBusy;
+	bool               m_Stopping;
+};
+
+
+} // namespace gen
@@ -170,30 +170,33 @@ namespace gen
 			attr = element->FindAttribute("Number");
 			entityCount = (attr == nullptr) ? 1 : attr->IntValue();
 
+			// Find the optional child elements for position, rotation and scale once for all instances
+			SPlacementElements placementElements;
+			placementElements.parser = this;
+			placementElements.position = element->FirstChildElement("Position");
+			placementElements.rotation = element->FirstChildElement("Rotation");
+			placementElements.scale = element->FirstChildElement("Scale");
+
+			// Plain entities (scenery) are created together, which is much faster for large numbers
+			string templateType = m_EntityManager->GetTemplate(type)->GetType();
+			if (templateType != "Tank" && templateType != "Ammo" && templateType != "Health" &&
+				templateType != "Mine" && templateType != "Projectile")
+			{
+				m_EntityManager->CreateEntities(type, (entityCount > 0) ? entityCount : 0, PlacementGenerator,
+					&placementElements, name);
+				element = element->NextSiblingElement("Entity");
+				continue;
+			}
 
 			for (int i = 0; i < entityCount; i++)
 			{
-				// Next check for optional child elements such as position or scale, but set default values for all in case they are not provided
-				CVector3 pos{ 0, 0, 0 };
-				CVector3 rot{ 0, 0, 0 };
-				CVector3 scale{ 1, 1, 1 };
-
-				XMLElement* child = element->FirstChildElement("Position");
-				if (child != nullptr)  pos = GetVector3FromElement(child); // Helper method will read the X,Y,Z attributes into a CVector3
-
-				child = element->FirstChildElement("Rotation");
-				if (child != nullptr)
-				{
-					rot = GetVector3FromElement(child);
-					rot.x = ToRadians(rot.x);
-					rot.y = ToRadians(rot.y);
-					rot.z = ToRadians(rot.z);
-				}
+				// Read the placement, using default values for any child elements not provided
+				SEntityPlacement placement;
+				ReadPlacement(placementElements, placement);
+				CVector3& pos = placement.position;
+				CVector3& rot = placement.rotation;
+				CVector3& scale = placement.scale;
 
-				child = element->FirstChildElement("Scale");
-				if (child != nullptr)  scale = GetVector3FromElement(child);
-
-				string templateType = m_EntityManager->GetTemplate(type)->GetType();
 				if (templateType != "Tank")
 				{
 					if (templateType == "Ammo" || templateType == "Health")
@@ -239,10 +242,6 @@ namespace gen
 							m_EntityManager->CreateShell(type, ownerTank, name, pos, rot, scale);
 						}
 					}
-					else
-					{
-						m_EntityManager->CreateEntity(type, name, pos, rot, scale);
-					}
 				}
 				else
 				{
@@ -251,7 +250,7 @@ namespace gen
 					int team = attr->IntValue();
 
 					// Waypoints
-					child = element->FirstChildElement("ListWaypoints");
+					XMLElement* child = element->FirstChildElement("ListWaypoints");
 					vector<CVector3> patrolPoints;
 					if (child != nullptr)
 					{
@@ -276,6 +275,37 @@ namespace gen
 	}
 
 
+	// Read the placement of one entity from the given position, rotation and scale elements. Elements
+	// that are not provided (null) leave default values. Rotations are given in degrees
+	void CParseLevel::ReadPlacement(const SPlacementElements& elements, SEntityPlacement& placement)
+	{
+		placement.position = CVector3{ 0, 0, 0 };
+		placement.rotation = CVector3{ 0, 0, 0 };
+		placement.scale = CVector3{ 1, 1, 1 };
+
+		// Helper method will read the X,Y,Z attributes into a CVector3
+		if (elements.position != nullptr)  placement.position = GetVector3FromElement(elements.position);
+
+		if (elements.rotation != nullptr)
+		{
+			placement.rotation = GetVector3FromElement(elements.rotation);
+			placement.rotation.x = ToRadians(placement.rotation.x);
+			placement.rotation.y = ToRadians(placement.rotation.y);
+			placement.rotation.z = ToRadians(placement.rotation.z);
+		}
+
+		if (elements.scale != nullptr)  placement.scale = GetVector3FromElement(elements.scale);
+	}
+
+	// Entity generator for CEntityManager::CreateEntities, data points to the SPlacementElements for
+	// the entity tag. Each call reads a new placement, so any randomisation differs for each entity
+	void CParseLevel::PlacementGenerator(void* data, TUInt32 index, SEntityPlacement& placement)
+	{
+		SPlacementElements* elements = static_cast<SPlacementElements*>(data);
+		elements->parser->ReadPlacement(*elements, placement);
+	}
+
+
 	// Helper method to read a CVector3 from an element, expecting X, Y and Z attributes.
 	// Also supports a "Randomise" feature, see code
 	CVector3 CParseLevel::GetVector3FromElement(XMLElement* element)
@@ -48,6 +48,21 @@ namespace gen
 
 		CVector3 GetVector3FromElement(tinyxml2::XMLElement* rootElement);
 
+		// The optional child elements giving the placement of the entities in an entity tag
+		struct SPlacementElements
+		{
+			CParseLevel*           parser;
+			tinyxml2::XMLElement* position;
+			tinyxml2::XMLElement* rotation;
+			tinyxml2::XMLElement* scale;
+		};
+
+		// Read the placement of one entity from its placement elements
+		void ReadPlacement(const SPlacementElements& elements, SEntityPlacement& placement);
+
+		// Entity generator for CEntityManager::CreateEntities, data points to SPlacementElements
+		static void PlacementGenerator(void* data, TUInt32 index, SEntityPlacement& placement);
+
 
 		/*---------------------------------------------------------------------------------------------
 			Data
@@ -0,0 +1,561 @@
+/*******************************************
+	BoxTree.cpp
+
+	Bounding volume hierarchy over axis
+	aligned boxes for ray queries
+********************************************/
+
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+#include "BoxTree.h"
+#include "CTimer.h"
+
+#ifdef GEN_BOX_TREE_SIMD
+#include <xmmintrin.h>
+#endif
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Building
+
+// Build the tree over the given boxes, replacing any previous boxes. Boxes are referred to by
+// their index in the given list
+void CBoxTree::Build( const vector<SBoundingBox>& boxes )
+{
+	m_Boxes = boxes;
+	m_BoxOrder.resize( m_Boxes.size() );
+	for (TUInt32 box = 0; box < m_BoxOrder.size(); ++box)
+	{
+		m_BoxOrder[box] = box;
+	}
+
+	// A tree over n boxes has at most 2n - 1 nodes, reserve them so building does not reallocate
+	m_Nodes.clear();
+	m_Nodes.reserve( 2 * m_Boxes.size() );
+	m_Packets.clear();
+	if (!m_Boxes.empty())
+	{
+		BuildNode( 0, NumBoxes() );
+	}
+}
+
+// Remove all boxes
+void CBoxTree::Clear()
+{
+	m_Boxes.clear();
+	m_BoxOrder.clear();
+	m_Nodes.clear();
+	m_Packets.clear();
+}
+
+// Add the node (and all nodes below it) for the boxes in the given range of m_BoxOrder, and
+// return its index
+TUInt32 CBoxTree::BuildNode( TUInt32 begin, TUInt32 end )
+{
+	// Fill in the node before adding it, it is made a leaf over the range unless it is split below
+	SNode node;
+	SetLeafBounds( node, begin, end );
+	node.first = begin;
+	node.count = end - begin;
+	node.packet = 0;
+	TUInt32 nodeIndex = NumNodes();
+	m_Nodes.push_back( node );
+	if (end - begin > MaxLeafBoxes)
+	{
+		// Find the axis along which the box centres are most spread out. Centres are used doubled
+		// (min + max) as only their order matters
+		CVector3 minCentre = m_Boxes[m_BoxOrder[begin]].minBounds + m_Boxes[m_BoxOrder[begin]].maxBounds;
+		CVector3 maxCentre = minCentre;
+		for (TUInt32 order = begin + 1; order < end; ++order)
+		{
+			const SBoundingBox& box = m_Boxes[m_BoxOrder[order]];
+			CVector3 centre = box.minBounds + box.maxBounds;
+			minCentre.x = Min( minCentre.x, centre.x );
+			minCentre.y = Min( minCentre.y, centre.y );
+			minCentre.z = Min( minCentre.z, centre.z );
+			maxCentre.x = Max( maxCentre.x, centre.x );
+			maxCentre.y = Max( maxCentre.y, centre.y );
+			maxCentre.z = Max( maxCentre.z, centre.z );
+		}
+		CVector3 spread = maxCentre - minCentre;
+		TUInt32 axis = (spread.x >= spread.y && spread.x >= spread.z) ? 0 : (spread.y >= spread.z ? 1 : 2);
+
+		// Boxes all in the same place cannot be split usefully, they are left in a larger leaf
+		if (spread[axis] > 0.0f)
+		{
+			// Split the boxes in half at the median centre along the axis. The left child is added
+			// next, the right child after all the nodes below the left child
+			TUInt32 middle = begin + (end - begin) / 2;
+			const vector<SBoundingBox>& boxes = m_Boxes;
+			nth_element( m_BoxOrder.begin() + begin, m_BoxOrder.begin() + middle, m_BoxOrder.begin() + end,
+				[&boxes, axis]( TUInt32 a, TUInt32 b )
+				{
+					return boxes[a].minBounds[axis] + boxes[a].maxBounds[axis] <
+					       boxes[b].minBounds[axis] + boxes[b].maxBounds[axis];
+				} );
+			BuildNode( begin, middle );
+			TUInt32 rightChild = BuildNode( middle, end );
+
+			m_Nodes[nodeIndex].first = rightChild;
+			m_Nodes[nodeIndex].count = 0;
+			m_Nodes[nodeIndex].packet = 0;
+			return nodeIndex;
+		}
+	}
+
+	// Leaf node, copy its boxes into new packets
+	SNode& leaf = m_Nodes[nodeIndex];
+	leaf.packet = static_cast<TUInt32>(m_Packets.size());
+	m_Packets.resize( m_Packets.size() + (leaf.count + BoxPacketSize - 1) / BoxPacketSize );
+	SetLeafPackets( leaf );
+	return nodeIndex;
+}
+
+// Set the bounds of the given node from the boxes in the given range of m_BoxOrder
+void CBoxTree::SetLeafBounds( SNode& node, TUInt32 begin, TUInt32 end )
+{
+	node.minBounds = m_Boxes[m_BoxOrder[begin]].minBounds;
+	node.maxBounds = m_Boxes[m_BoxOrder[begin]].maxBounds;
+	for (TUInt32 order = begin + 1; order < end; ++order)
+	{
+		const SBoundingBox& box = m_Boxes[m_BoxOrder[order]];
+		node.minBounds.x = Min( node.minBounds.x, box.minBounds.x );
+		node.minBounds.y = Min( node.minBounds.y, box.minBounds.y );
+		node.minBounds.z = Min( node.minBounds.z, box.minBounds.z );
+		node.maxBounds.x = Max( node.maxBounds.x, box.maxBounds.x );
+		node.maxBounds.y = Max( node.maxBounds.y, box.maxBounds.y );
+		node.maxBounds.z = Max( node.maxBounds.z, box.maxBounds.z );
+	}
+}
+
+// Copy the boxes of the given leaf node into its packets
+void CBoxTree::SetLeafPackets( const SNode& node )
+{
+	for (TUInt32 leafBox = 0; leafBox < node.count; ++leafBox)
+	{
+		const SBoundingBox& box = m_Boxes[m_BoxOrder[node.first + leafBox]];
+		SBoxPacket& packet = m_Packets[node.packet + leafBox / BoxPacketSize];
+		TUInt32 lane = leafBox % BoxPacketSize;
+		packet.minX[lane] = box.minBounds.x;
+		packet.minY[lane] = box.minBounds.y;
+		packet.minZ[lane] = box.minBounds.z;
+		packet.maxX[lane] = box.maxBounds.x;
+		packet.maxY[lane] = box.maxBounds.y;
+		packet.maxZ[lane] = box.maxBounds.z;
+	}
+}
+
+
+/////////////////////////////////////
+// Moving boxes
+
+// Replace the box with the given index. The tree is not correct until Refit is called
+void CBoxTree::SetBox( TUInt32 index, const SBoundingBox& box )
+{
+	GEN_ASSERT( index < NumBoxes(), "Invalid box index" );
+	m_Boxes[index] = box;
+}
+
+// Update the bounds of all nodes to match the current boxes, keeping the shape of the tree.
+// Children come after their parent in the node array, so working backwards through the array
+// updates both children of a node before the node itself
+void CBoxTree::Refit()
+{
+	for (TUInt32 nodeIndex = NumNodes(); nodeIndex-- > 0; )
+	{
+		SNode& node = m_Nodes[nodeIndex];
+		if (node.count > 0)
+		{
+			SetLeafBounds( node, node.first, node.first + node.count );
+			SetLeafPackets( node );
+		}
+		else
+		{
+			const SNode& left = m_Nodes[nodeIndex + 1];
+			const SNode& right = m_Nodes[node.first];
+			node.minBounds.x = Min( left.minBounds.x, right.minBounds.x );
+			node.minBounds.y = Min( left.minBounds.y, right.minBounds.y );
+			node.minBounds.z = Min( left.minBounds.z, right.minBounds.z );
+			node.maxBounds.x = Max( left.maxBounds.x, right.maxBounds.x );
+			node.maxBounds.y = Max( left.maxBounds.y, right.maxBounds.y );
+			node.maxBounds.z = Max( left.maxBounds.z, right.maxBounds.z );
+		}
+	}
+}
+
+
+/////////////////////////////////////
+// Ray queries
+
+// Return true if the ray from the given point along the given direction hits any box no further
+// than the given distance (in multiples of the direction's length). Stops at the first box found
+bool CBoxTree::RayHitsAny( const CVector3& rayStart, const CVector3& rayDirection,
+                           TFloat32 maxDistance /*= D3D10_FLOAT32_MAX*/ ) const
+{
+	if (m_Nodes.empty())
+	{
+		return false;
+	}
+
+	// Divide once per ray rather than once per box. A zero direction component gives an infinite
+	// inverse, which the slab test handles
+	CVector3 invRayDirection( 1.0f / rayDirection.x, 1.0f / rayDirection.y, 1.0f / rayDirection.z );
+
+	// Depth-first traversal with an explicit stack of nodes still to visit
+	TUInt32 stack[MaxDepth];
+	TUInt32 stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		TUInt32 nodeIndex = stack[--stackSize];
+		const SNode& node = m_Nodes[nodeIndex];
+		if (!RayHitsBox( node.minBounds, node.maxBounds, rayStart, invRayDirection, maxDistance ))
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			// Test the leaf boxes a packet at a time, ignoring the unused entries in the last packet
+			for (TUInt32 leafBox = 0; leafBox < node.count; leafBox += BoxPacketSize)
+			{
+				const SBoxPacket& packet = m_Packets[node.packet + leafBox / BoxPacketSize];
+				TUInt32 hits = m_IsSIMD ? RayHitsPacket( packet, rayStart, invRayDirection, maxDistance ) :
+				                          RayHitsPacketScalar( packet, rayStart, invRayDirection, maxDistance );
+				TUInt32 numPacketBoxes = Min( node.count - leafBox, BoxPacketSize );
+				if (hits & ((1u << numPacketBoxes) - 1))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			// Visit the left child first
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+	return false;
+}
+
+// Test the given number of rays as RayHitsAny, setting the matching entry in the results array
+// to whether each ray hits any box
+void CBoxTree::RaysHitAny( const SRay* rays, bool* results, TUInt32 numRays,
+                           TFloat32 maxDistance /*= D3D10_FLOAT32_MAX*/ ) const
+{
+	for (TUInt32 ray = 0; ray < numRays; ++ray)
+	{
+		results[ray] = RayHitsAny( rays[ray].start, rays[ray].direction, maxDistance );
+	}
+}
+
+// Return true if the ray with given start and inverse direction hits the given box between
+// distance 0 and the given distance. Slab test: the ray is inside the box where it is between
+// the pairs of planes on all three axes at once
+bool CBoxTree::RayHitsBox( const CVector3& minBounds, const CVector3& maxBounds,
+                           const CVector3& rayStart, const CVector3& invRayDirection,
+                           TFloat32 maxDistance /*= D3D10_FLOAT32_MAX*/ )
+{
+	TFloat32 t1 = (minBounds.x - rayStart.x) * invRayDirection.x;
+	TFloat32 t2 = (maxBounds.x - rayStart.x) * invRayDirection.x;
+	TFloat32 t3 = (minBounds.y - rayStart.y) * invRayDirection.y;
+	TFloat32 t4 = (maxBounds.y - rayStart.y) * invRayDirection.y;
+	TFloat32 t5 = (minBounds.z - rayStart.z) * invRayDirection.z;
+	TFloat32 t6 = (maxBounds.z - rayStart.z) * invRayDirection.z;
+
+	TFloat32 tmin = Max( Max( Min( t1, t2 ), Min( t3, t4 ) ), Min( t5, t6 ) );
+	TFloat32 tmax = Min( Min( Max( t1, t2 ), Max( t3, t4 ) ), Max( t5, t6 ) );
+
+	// Missed if the box is behind the ray, the ray leaves one slab before entering another, or
+	// the box is beyond the maximum distance
+	return !(tmax < 0.0f || tmin > tmax || tmin > maxDistance);
+}
+
+// Test a ray against the boxes in the given packet, returns a bit mask with bit n set if the ray
+// hits box n. The same slab test as RayHitsBox on four boxes at once
+TUInt32 CBoxTree::RayHitsPacket( const SBoxPacket& packet, const CVector3& rayStart,
+                                 const CVector3& invRayDirection, TFloat32 maxDistance )
+{
+#ifdef GEN_BOX_TREE_SIMD
+	__m128 startX = _mm_set1_ps( rayStart.x );
+	__m128 startY = _mm_set1_ps( rayStart.y );
+	__m128 startZ = _mm_set1_ps( rayStart.z );
+	__m128 invDirX = _mm_set1_ps( invRayDirection.x );
+	__m128 invDirY = _mm_set1_ps( invRayDirection.y );
+	__m128 invDirZ = _mm_set1_ps( invRayDirection.z );
+
+	__m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( packet.minX ), startX ), invDirX );
+	__m128 t2 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( packet.maxX ), startX ), invDirX );
+	__m128 t3 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( packet.minY ), startY ), invDirY );
+	__m128 t4 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( packet.maxY ), startY ), invDirY );
+	__m128 t5 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( packet.minZ ), startZ ), invDirZ );
+	__m128 t6 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( packet.maxZ ), startZ ), invDirZ );
+
+	// A ray starting on a slab plane with a zero direction component gives 0 * infinity = NaN.
+	// The SSE min/max return their second argument if either is NaN, so arguments are ordered
+	// to match Min( a, b ) = (b < a) ? b : a, i.e. _mm_min_ps( b, a ), and Max( a, b ) =
+	// !(b < a) ? b : a, i.e. _mm_max_ps( a, b ). The results then match the scalar test exactly
+	__m128 tmin = _mm_max_ps( _mm_max_ps( _mm_min_ps( t2, t1 ), _mm_min_ps( t4, t3 ) ), _mm_min_ps( t6, t5 ) );
+	__m128 tmax = _mm_min_ps( _mm_max_ps( t5, t6 ), _mm_min_ps( _mm_max_ps( t3, t4 ), _mm_max_ps( t1, t2 ) ) );
+
+	__m128 misses = _mm_or_ps( _mm_cmplt_ps( tmax, _mm_setzero_ps() ),
+	                _mm_or_ps( _mm_cmpgt_ps( tmin, tmax ), _mm_cmpgt_ps( tmin, _mm_set1_ps( maxDistance ) ) ) );
+	return static_cast<TUInt32>(~_mm_movemask_ps( misses )) & ((1u << BoxPacketSize) - 1);
+#else
+	return RayHitsPacketScalar( packet, rayStart, invRayDirection, maxDistance );
+#endif
+}
+
+// Scalar version of RayHitsPacket, testing each box in turn with RayHitsBox
+TUInt32 CBoxTree::RayHitsPacketScalar( const SBoxPacket& packet, const CVector3& rayStart,
+                                       const CVector3& invRayDirection, TFloat32 maxDistance )
+{
+	TUInt32 hits = 0;
+	for (TUInt32 lane = 0; lane < BoxPacketSize; ++lane)
+	{
+		CVector3 minBounds( packet.minX[lane], packet.minY[lane], packet.minZ[lane] );
+		CVector3 maxBounds( packet.maxX[lane], packet.maxY[lane], packet.maxZ[lane] );
+		if (RayHitsBox( minBounds, maxBounds, rayStart, invRayDirection, maxDistance ))
+		{
+			hits |= 1u << lane;
+		}
+	}
+	return hits;
+}
+
+
+/////////////////////////////////////
+// Benchmark
+
+// Simple random number generator so the benchmark is repeatable, returns a value in [a, b)
+static TFloat32 BenchmarkRandom( TUInt32& seed, TFloat32 a, TFloat32 b )
+{
+	seed = seed * 1664525u + 1013904223u;
+	return a + (b - a) * static_cast<TFloat32>(seed >> 8) / static_cast<TFloat32>(1 << 24);
+}
+
+// Output timings comparing CBoxTree with testing every box in turn for the given number of random
+// rays against the given number of building sized boxes. Also outputs any rays where the two
+// disagree
+void OutputBoxTreeBenchmark( TUInt32 numBoxes /*= 1000*/, TUInt32 numRays /*= 10000*/ )
+{
+	// Buildings the size of those in the level, spread over a square area that leaves them about
+	// as far apart as in the level
+	const CVector3 BuildingMin( -7.36113f, -0.148627f, -4.34613f );
+	const CVector3 BuildingMax( 5.11745f, 11.1836f, 5.35663f );
+	TFloat32 worldSize = 40.0f * sqrt( static_cast<TFloat32>(numBoxes) );
+	TUInt32 seed = 12345;
+
+	vector<SBoundingBox> boxes( numBoxes );
+	for (TUInt32 box = 0; box < numBoxes; ++box)
+	{
+		CVector3 position( BenchmarkRandom( seed, -worldSize, worldSize ), 0.0f,
+		                   BenchmarkRandom( seed, -worldSize, worldSize ) );
+		boxes[box].minBounds = position + BuildingMin;
+		boxes[box].maxBounds = position + BuildingMax;
+	}
+
+	// Rays at turret height in random directions across the ground, like tank line of sight checks
+	vector<SRay> rays( numRays );
+	for (TUInt32 ray = 0; ray < numRays; ++ray)
+	{
+		rays[ray].start = CVector3( BenchmarkRandom( seed, -worldSize, worldSize ), 2.0f,
+		                            BenchmarkRandom( seed, -worldSize, worldSize ) );
+		TFloat32 angle = BenchmarkRandom( seed, 0.0f, 2.0f * kfPi );
+		rays[ray].direction = CVector3( sin( angle ), 0.0f, cos( angle ) );
+	}
+
+	CTimer timer;
+	CBoxTree tree;
+	timer.Reset();
+	tree.Build( boxes );
+	TFloat32 buildTime = timer.GetLapTime();
+	tree.Refit();
+	TFloat32 refitTime = timer.GetLapTime();
+
+	// Tree queries, all rays in one batch, with the SSE and the scalar packet tests
+	bool* treeHits = new bool[numRays];
+	bool* scalarTreeHits = new bool[numRays];
+	timer.Reset();
+	tree.RaysHitAny( &rays[0], treeHits, numRays );
+	TFloat32 treeTime = timer.GetLapTime();
+	tree.SetSIMD( false );
+	tree.RaysHitAny( &rays[0], scalarTreeHits, numRays );
+	TFloat32 scalarTreeTime = timer.GetLapTime();
+
+	// Test every box in turn, stopping at the first hit
+	TUInt32 numHits = 0;
+	TUInt32 numMismatches = 0;
+	timer.Reset();
+	for (TUInt32 ray = 0; ray < numRays; ++ray)
+	{
+		CVector3 invRayDirection( 1.0f / rays[ray].direction.x, 1.0f / rays[ray].direction.y,
+		                          1.0f / rays[ray].direction.z );
+		bool hit = false;
+		for (TUInt32 box = 0; box < numBoxes && !hit; ++box)
+		{
+			hit = CBoxTree::RayHitsBox( boxes[box].minBounds, boxes[box].maxBounds, rays[ray].start,
+			                            invRayDirection );
+		}
+		numHits += hit ? 1 : 0;
+		numMismatches += (hit != treeHits[ray] || hit != scalarTreeHits[ray]) ? 1 : 0;
+	}
+	TFloat32 linearTime = timer.GetLapTime();
+	delete[] treeHits;
+	delete[] scalarTreeHits;
+
+	cout << "Box tree benchmark, " << numBoxes << " boxes, " << numRays << " rays ("
+	     << tree.NumNodes() << " nodes):" << endl;
+	cout << "  Build / refit:      " << buildTime * 1e6f << "us / " << refitTime * 1e6f << "us" << endl;
+	cout << "  Ray (tree SIMD / tree scalar / every box): " << treeTime * 1e9f / numRays << "ns / "
+	     << scalarTreeTime * 1e9f / numRays << "ns / " << linearTime * 1e9f / numRays << "ns ("
+	     << numHits << " rays hit)" << endl;
+	if (numMismatches != 0)
+	{
+		cout << "  MISMATCH: " << numMismatches << " rays gave different results" << endl;
+	}
+}
+
+// Random value for the packet check, mostly spread over a small range so rays and boxes often
+// touch, but sometimes one of the values that catch out slab tests: zero (an infinite inverse
+// direction), a box bound (a ray along a box face), or the largest float
+static TFloat32 CheckValue( TUInt32& seed, TFloat32 bound )
+{
+	TFloat32 choice = BenchmarkRandom( seed, 0.0f, 1.0f );
+	if (choice < 0.1f)
+	{
+		return 0.0f;
+	}
+	else if (choice < 0.2f)
+	{
+		return bound;
+	}
+	else if (choice < 0.22f)
+	{
+		return (choice < 0.21f) ? D3D10_FLOAT32_MAX : -D3D10_FLOAT32_MAX;
+	}
+	return BenchmarkRandom( seed, -4.0f, 4.0f );
+}
+
+// Check the SSE packet test gives the same result as the scalar test for every box, over random
+// rays and boxes and over rays and boxes built to hit edge cases. Outputs the number of tests and
+// any that disagree, and the time taken by each test
+void OutputBoxPacketCheck( TUInt32 numRandomTests /*= 1000000*/ )
+{
+	// Values each coordinate of the edge case rays and boxes is taken from. Rays start on, inside
+	// and outside a unit box, and box bounds include flat and inside-out boxes
+	const TFloat32 EdgeValues[] = { -1.0f, 0.0f, 1.0f, 2.0f };
+	const TUInt32 NumEdgeValues = sizeof(EdgeValues) / sizeof(EdgeValues[0]);
+	const TFloat32 EdgeDirections[] = { -1.0f, -0.0f, 0.0f, 1.0f };
+	const TUInt32 NumEdgeDirections = sizeof(EdgeDirections) / sizeof(EdgeDirections[0]);
+	const TFloat32 MaxDistances[] = { D3D10_FLOAT32_MAX, 1.0f, 0.0f };
+	const TUInt32 NumMaxDistances = sizeof(MaxDistances) / sizeof(MaxDistances[0]);
+
+	TUInt32 numTests = 0;
+	TUInt32 numMismatches = 0;
+
+	// Every combination of edge case start point and direction against a packet holding the unit
+	// box, a box flat in X, a box flat in Y and an inside-out box
+	SBoxPacket packet;
+	for (TUInt32 lane = 0; lane < BoxPacketSize; ++lane)
+	{
+		packet.minX[lane] = packet.minY[lane] = packet.minZ[lane] = 0.0f;
+		packet.maxX[lane] = packet.maxY[lane] = packet.maxZ[lane] = 1.0f;
+	}
+	packet.maxX[1] = 0.0f;
+	packet.maxY[2] = 0.0f;
+	packet.minX[3] = packet.minY[3] = packet.minZ[3] = 1.0f;
+	packet.maxX[3] = packet.maxY[3] = packet.maxZ[3] = 0.0f;
+	TUInt32 numStarts = NumEdgeValues * NumEdgeValues * NumEdgeValues;
+	TUInt32 numDirections = NumEdgeDirections * NumEdgeDirections * NumEdgeDirections;
+	for (TUInt32 start = 0; start < numStarts; ++start)
+	{
+		CVector3 rayStart( EdgeValues[start % NumEdgeValues],
+		                   EdgeValues[(start / NumEdgeValues) % NumEdgeValues],
+		                   EdgeValues[start / (NumEdgeValues * NumEdgeValues)] );
+		for (TUInt32 direction = 0; direction < numDirections; ++direction)
+		{
+			CVector3 rayDirection( EdgeDirections[direction % NumEdgeDirections],
+			                       EdgeDirections[(direction / NumEdgeDirections) % NumEdgeDirections],
+			                       EdgeDirections[direction / (NumEdgeDirections * NumEdgeDirections)] );
+			CVector3 invRayDirection( 1.0f / rayDirection.x, 1.0f / rayDirection.y, 1.0f / rayDirection.z );
+			for (TUInt32 distance = 0; distance < NumMaxDistances; ++distance)
+			{
+				TUInt32 hits = CBoxTree::RayHitsPacket( packet, rayStart, invRayDirection, MaxDistances[distance] );
+				TUInt32 scalarHits = CBoxTree::RayHitsPacketScalar( packet, rayStart, invRayDirection,
+				                                                    MaxDistances[distance] );
+				numMismatches += (hits != scalarHits) ? 1 : 0;
+				++numTests;
+			}
+		}
+	}
+
+	// Random rays and packets, with values chosen to often land on box bounds and zero
+	TUInt32 seed = 54321;
+	vector<SBoxPacket> packets( 256 );
+	for (TUInt32 randomPacket = 0; randomPacket < packets.size(); ++randomPacket)
+	{
+		SBoxPacket& randomBoxes = packets[randomPacket];
+		for (TUInt32 lane = 0; lane < BoxPacketSize; ++lane)
+		{
+			randomBoxes.minX[lane] = BenchmarkRandom( seed, -4.0f, 4.0f );
+			randomBoxes.minY[lane] = BenchmarkRandom( seed, -4.0f, 4.0f );
+			randomBoxes.minZ[lane] = BenchmarkRandom( seed, -4.0f, 4.0f );
+			randomBoxes.maxX[lane] = randomBoxes.minX[lane] + BenchmarkRandom( seed, 0.0f, 4.0f );
+			randomBoxes.maxY[lane] = randomBoxes.minY[lane] + BenchmarkRandom( seed, 0.0f, 4.0f );
+			randomBoxes.maxZ[lane] = randomBoxes.minZ[lane] + BenchmarkRandom( seed, 0.0f, 4.0f );
+		}
+	}
+	vector<CVector3> rayStarts( numRandomTests );
+	vector<CVector3> invRayDirections( numRandomTests );
+	for (TUInt32 test = 0; test < numRandomTests; ++test)
+	{
+		const SBoxPacket& randomBoxes = packets[test % packets.size()];
+		rayStarts[test] = CVector3( CheckValue( seed, randomBoxes.minX[0] ), CheckValue( seed, randomBoxes.maxY[1] ),
+		                            CheckValue( seed, randomBoxes.minZ[2] ) );
+		CVector3 rayDirection( CheckValue( seed, 1.0f ), CheckValue( seed, -1.0f ), CheckValue( seed, 1.0f ) );
+		invRayDirections[test] = CVector3( 1.0f / rayDirection.x, 1.0f / rayDirection.y, 1.0f / rayDirection.z );
+	}
+
+	CTimer timer;
+	TUInt32* results = new TUInt32[numRandomTests];
+	timer.Reset();
+	for (TUInt32 test = 0; test < numRandomTests; ++test)
+	{
+		results[test] = CBoxTree::RayHitsPacket( packets[test % packets.size()], rayStarts[test],
+		                                         invRayDirections[test], D3D10_FLOAT32_MAX );
+	}
+	TFloat32 packetTime = timer.GetLapTime();
+	for (TUInt32 test = 0; test < numRandomTests; ++test)
+	{
+		results[test] ^= CBoxTree::RayHitsPacketScalar( packets[test % packets.size()], rayStarts[test],
+		                                                invRayDirections[test], D3D10_FLOAT32_MAX );
+	}
+	TFloat32 scalarTime = timer.GetLapTime();
+	for (TUInt32 test = 0; test < numRandomTests; ++test)
+	{
+		numMismatches += (results[test] != 0) ? 1 : 0;
+	}
+	numTests += numRandomTests;
+	delete[] results;
+
+#ifdef GEN_BOX_TREE_SIMD
+	cout << "Box packet check (SSE / scalar), " << numTests << " tests:" << endl;
+#else
+	cout << "Box packet check (SIMD compiled out, scalar / scalar), " << numTests << " tests:" << endl;
+#endif
+	cout << "  Ray against " << BoxPacketSize << " boxes: " << packetTime * 1e9f / numRandomTests << "ns / "
+	     << scalarTime * 1e9f / numRandomTests << "ns" << endl;
+	if (numMismatches != 0)
+	{
+		cout << "  MISMATCH: " << numMismatches << " tests gave different results" << endl;
+	}
+}
+
+
+} // namespace gen
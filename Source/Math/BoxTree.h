@@ -0,0 +1,215 @@
+/*******************************************
+	BoxTree.h
+
+	Bounding volume hierarchy over axis
+	aligned boxes for ray queries
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+
+// Leaf boxes are tested four at a time with SSE where the compiler targets it, unless GEN_NO_SIMD
+// is defined (e.g. in the project preprocessor definitions), in which case scalar code is used
+#if !defined(GEN_NO_SIMD) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__))
+#define GEN_BOX_TREE_SIMD
+#endif
+
+namespace gen
+{
+
+/////////////////////////////////////
+//	Public types
+
+// An axis aligned box given by its minimum and maximum corners
+struct SBoundingBox
+{
+	CVector3 minBounds;
+	CVector3 maxBounds;
+};
+
+// A ray from a start point along a direction
+struct SRay
+{
+	CVector3 start;
+	CVector3 direction;
+};
+
+// Number of boxes tested at once by the packet test
+const TUInt32 BoxPacketSize = 4;
+
+// A packet of boxes stored as separate arrays for each bound (structure of arrays), so each array
+// can be loaded straight into an SSE register
+struct SBoxPacket
+{
+	TFloat32 minX[BoxPacketSize];
+	TFloat32 minY[BoxPacketSize];
+	TFloat32 minZ[BoxPacketSize];
+	TFloat32 maxX[BoxPacketSize];
+	TFloat32 maxY[BoxPacketSize];
+	TFloat32 maxZ[BoxPacketSize];
+};
+
+
+// Bounding volume hierarchy (BVH) over a fixed set of axis aligned boxes, e.g. the buildings in a
+// level. Answers whether a ray hits any box while only testing the boxes near the ray, rather than
+// every box in turn
+//
+// The tree is a binary tree of nodes, each holding the bounds of all the boxes below it. It is
+// built top-down: the boxes in a node are split in half at the median of their centres along the
+// axis where the centres are most spread out, until a node holds few enough boxes to be a leaf.
+// Nodes are stored depth-first in a single array - the left child of a node follows it directly
+// and it stores the index of the right child, so a node's children always come after it
+//
+// Boxes may be moved after the tree is built: set the new boxes and refit the tree, which updates
+// node bounds without changing the tree shape. This is cheap, but the tree becomes slower to
+// query as boxes move far from where they were when it was built - rebuild in that case.
+// Queries do not change the tree, so any number of threads may query it at once
+//
+// The boxes in each leaf are also kept in packets of four (see SBoxPacket), which are tested
+// against a ray together with SSE instructions. A scalar test of the packets gives the same
+// results, and is used when SIMD is compiled out or switched off with SetSIMD
+class CBoxTree
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor creates an empty tree
+	CBoxTree()
+	{
+		m_IsSIMD = true;
+	}
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CBoxTree( const CBoxTree& );
+	CBoxTree& operator=( const CBoxTree& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	// Build the tree over the given boxes, replacing any previous boxes. Boxes are referred to by
+	// their index in the given list
+	void Build( const vector<SBoundingBox>& boxes );
+
+	// Remove all boxes
+	void Clear();
+
+	// Replace the box with the given index. The tree is not correct until Refit is called, which
+	// should be done once after all the boxes that have moved are set
+	void SetBox( TUInt32 index, const SBoundingBox& box );
+
+	// Update the bounds of all nodes to match the current boxes, keeping the shape of the tree
+	void Refit();
+
+	// Return true if the ray from the given point along the given direction hits any box no
+	// further than the given distance (in multiples of the direction's length). Stops at the first
+	// box found, which is not necessarily the nearest. A ray starting inside a box hits it
+	bool RayHitsAny( const CVector3& rayStart, const CVector3& rayDirection,
+	                 TFloat32 maxDistance = D3D10_FLOAT32_MAX ) const;
+
+	// Test the given number of rays as RayHitsAny, setting the matching entry in the results array
+	// to whether each ray hits any box
+	void RaysHitAny( const SRay* rays, bool* results, TUInt32 numRays,
+	                 TFloat32 maxDistance = D3D10_FLOAT32_MAX ) const;
+
+	// Select the SSE packet test (the default) or the scalar test. Has no effect if SIMD is
+	// compiled out, the scalar test is always used
+	void SetSIMD( bool isSIMD )
+	{
+		m_IsSIMD = isSIMD;
+	}
+	bool IsSIMD() const
+	{
+		return m_IsSIMD;
+	}
+
+	// Return true if the ray with given start and inverse direction (1 / direction on each axis)
+	// hits the given box between distance 0 and the given distance
+	static bool RayHitsBox( const CVector3& minBounds, const CVector3& maxBounds,
+	                        const CVector3& rayStart, const CVector3& invRayDirection,
+	                        TFloat32 maxDistance = D3D10_FLOAT32_MAX );
+
+	// Test a ray against the boxes in the given packet, returns a bit mask with bit n set if the
+	// ray hits box n. Exactly the same results as RayHitsBox on each box, including for rays along
+	// box faces. Uses SSE unless it is compiled out / the scalar version never uses it
+	static TUInt32 RayHitsPacket( const SBoxPacket& packet, const CVector3& rayStart,
+	                              const CVector3& invRayDirection, TFloat32 maxDistance );
+	static TUInt32 RayHitsPacketScalar( const SBoxPacket& packet, const CVector3& rayStart,
+	                                    const CVector3& invRayDirection, TFloat32 maxDistance );
+
+	// Number of boxes / tree nodes
+	TUInt32 NumBoxes() const
+	{
+		return static_cast<TUInt32>(m_Boxes.size());
+	}
+	TUInt32 NumNodes() const
+	{
+		return static_cast<TUInt32>(m_Nodes.size());
+	}
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	// Largest number of boxes in a leaf node
+	static const TUInt32 MaxLeafBoxes = 4;
+
+	// Deepest tree that can be queried. Halving the boxes at each level, this is far more than
+	// any number of boxes that fits in memory needs
+	static const TUInt32 MaxDepth = 64;
+
+	// A node of the tree, with the bounds of all the boxes below it
+	struct SNode
+	{
+		CVector3 minBounds;
+		CVector3 maxBounds;
+		TUInt32  first;  // Leaf: first entry in m_BoxOrder. Other nodes: index of right child node
+		TUInt32  count;  // Leaf: number of boxes. Other nodes: 0
+		TUInt32  packet; // Leaf: first packet in m_Packets holding its boxes
+	};
+
+	// Add the node (and all nodes below it) for the boxes in the given range of m_BoxOrder, and
+	// return its index
+	TUInt32 BuildNode( TUInt32 begin, TUInt32 end );
+
+	// Set the bounds of the given node from the boxes in the given range of m_BoxOrder
+	void SetLeafBounds( SNode& node, TUInt32 begin, TUInt32 end );
+
+	// Copy the boxes of the given leaf node into its packets
+	void SetLeafPackets( const SNode& node );
+
+
+/////////////////////////////////////
+//	Data
+private:
+
+	vector<SBoundingBox> m_Boxes;    // Boxes in the order given to Build
+	vector<TUInt32>      m_BoxOrder; // Box indexes in leaf order, each leaf holds a range of these
+	vector<SNode>        m_Nodes;    // Nodes in depth-first order, the root is first
+	vector<SBoxPacket>   m_Packets;  // Boxes of each leaf in packets, unused entries are masked off
+
+	bool m_IsSIMD; // Use the SSE packet test
+};
+
+
+// Output timings comparing CBoxTree with testing every box in turn for the given number of random
+// rays against the given number of building sized boxes. Also outputs any rays where the two
+// disagree
+void OutputBoxTreeBenchmark( TUInt32 numBoxes = 1000, TUInt32 numRays = 10000 );
+
+// Check the SSE packet test gives the same result as the scalar test for every box, over random
+// rays and boxes and over rays and boxes built to hit edge cases (rays along box faces and edges,
+// zero direction components, empty and flat boxes, boxes behind the ray or beyond the maximum
+// distance). Outputs the number of tests and any that disagree, and the time taken by each test
+void OutputBoxPacketCheck( TUInt32 numRandomTests = 1000000 );
+
+
+} // namespace gen
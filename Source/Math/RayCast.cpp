@@ -22,18 +22,55 @@ namespace gen
 		m_BuildingOutterBounds[MAX_X] = 5.11745f;
 		m_BuildingOutterBounds[MAX_Y] = 11.1836f;
 		m_BuildingOutterBounds[MAX_Z] = 5.35663f;
+
+		// No occluders until BuildOccluders is called. NoAtom is a valid entity name (unnamed
+		// entities), so InvalidAtom is used
+		m_OccluderName = InvalidAtom;
+	}
+
+	SBoundingBox CRayCast::OccluderBox(const CVector3& position)
+	{
+		SBoundingBox box;
+		box.minBounds = position + CVector3(m_BuildingOutterBounds[MIN_X], m_BuildingOutterBounds[MIN_Y], m_BuildingOutterBounds[MIN_Z]);
+		box.maxBounds = position + CVector3(m_BuildingOutterBounds[MAX_X], m_BuildingOutterBounds[MAX_Y], m_BuildingOutterBounds[MAX_Z]);
+		return box;
+	}
+
+	void CRayCast::BuildOccluders(const string& name)
+	{
+		BuildOccluders(FindAtom(name));
+	}
+
+	void CRayCast::BuildOccluders(TAtom name)
+	{
+		m_OccluderName = name;
+		vector<SBoundingBox> boxes;
+		for (CEntity* entity : EntityManager.Entities(m_OccluderName))
+		{
+			boxes.push_back(OccluderBox(entity->Position()));
+		}
+		m_Occluders.Build(boxes);
 	}
 
 	bool CRayCast::RayBoxIntersect(CVector3 rayStartingPos, CVector3 rayDirection, string objectToCheck)
 	{
-		// Adaptation of the code found at: https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-box-intersection
-		vector<CEntity*> entities = EntityManager.GetEntities(objectToCheck);
-		vector<bool> collidedWith;
+		return RayBoxIntersect(rayStartingPos, rayDirection, FindAtom(objectToCheck));
+	}
+
+	bool CRayCast::RayBoxIntersect(CVector3 rayStartingPos, CVector3 rayDirection, TAtom objectToCheck)
+	{
+		rayDirection.Normalise();
+
+		// Occluders are in a tree so only the buildings near the ray are tested
+		if (objectToCheck == m_OccluderName)
+		{
+			return m_Occluders.RayHitsAny(rayStartingPos, rayDirection);
+		}
 
-		for each (CEntity * entity in entities)
+		// Adaptation of the code found at: https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-box-intersection
+		for (CEntity* entity : EntityManager.Entities(objectToCheck))
 		{
 			CVector3 checkedEntityPos = entity->Position();
-			rayDirection.Normalise();
 
 			TFloat32 xMin = checkedEntityPos.x + m_BuildingOutterBounds[MIN_X];
 			TFloat32 xMax = checkedEntityPos.x + m_BuildingOutterBounds[MAX_X];
@@ -60,26 +97,43 @@ namespace gen
 			// if tmax < 0, ray (line) is intersecting AABB, but whole AABB is behing us
 			// or
 			// if tmin > tmax, ray doesn't intersect AABB
-			if (tmax < 0.0f || tmin > tmax)
-			{
-				collidedWith.push_back(false);
-			}
-			else
+			if (!(tmax < 0.0f || tmin > tmax))
 			{
-				collidedWith.push_back(true);
+				// The ray collided with one of the buildings
+				return true;
 			}
 		}
 
-		// If the ray collided with one of the buildings
-		for each (bool collided in collidedWith)
+		// Didn't collide with any of the buildings
+		return false;
+	}
+
+	void CRayCast::RayBoxIntersectMany(const SRay* rays, bool* results, TUInt32 numRays, string objectToCheck)
+	{
+		RayBoxIntersectMany(rays, results, numRays, FindAtom(objectToCheck));
+	}
+
+	void CRayCast::RayBoxIntersectMany(const SRay* rays, bool* results, TUInt32 numRays, TAtom objectToCheck)
+	{
+		if (objectToCheck != m_OccluderName)
 		{
-			if (collided)
+			for (TUInt32 ray = 0; ray < numRays; ++ray)
 			{
-				return true;
+				results[ray] = RayBoxIntersect(rays[ray].start, rays[ray].direction, objectToCheck);
 			}
+			return;
 		}
 
-		// Didn't collide with any of the buildings
-		return false;
+		// Occluders: the whole batch goes through the tree, which tests four buildings at a time
+		m_NormalisedRays.resize(numRays);
+		for (TUInt32 ray = 0; ray < numRays; ++ray)
+		{
+			m_NormalisedRays[ray].start = rays[ray].start;
+			m_NormalisedRays[ray].direction = Normalise(rays[ray].direction);
+		}
+		if (numRays > 0)
+		{
+			m_Occluders.RaysHitAny(&m_NormalisedRays[0], results, numRays);
+		}
 	}
 }
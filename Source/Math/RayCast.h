@@ -1,6 +1,8 @@
 using namespace std;
 #include "CVector3.h"
 #include "Entity.h"
+#include "Atom.h"
+#include "BoxTree.h"
 #include <memory>
 namespace gen
 {
@@ -12,6 +14,17 @@ namespace gen
 			TFloat32 m_BuildingOutterBounds[6];
 			CRayCast();
 
+			// Tree over the bounds of the entities with one name (the occluders), and that name,
+			// InvalidAtom before the tree is built
+			CBoxTree m_Occluders;
+			TAtom m_OccluderName;
+
+			// Rays given to RayBoxIntersectMany with their directions normalised, reused by each call
+			vector<SRay> m_NormalisedRays;
+
+			// Bounds of an occluder at the given position
+			SBoundingBox OccluderBox(const CVector3& position);
+
 		public:
 			// Stop the compiler generating methods of copy the object
 			CRayCast(CRayCast const&) = delete;
@@ -23,6 +36,20 @@ namespace gen
 				return s;
 			}
 			bool RayBoxIntersect(CVector3 rayStartingPos, CVector3 rayDirection, string objectToCheck);
+			bool RayBoxIntersect(CVector3 rayStartingPos, CVector3 rayDirection, TAtom objectToCheck);
+
+			// Test a batch of rays as RayBoxIntersect, e.g. all the line of sight checks in a frame,
+			// setting the matching entry in the results array to whether each ray hits. Unlike
+			// RayBoxIntersect, only one thread may call this at a time
+			void RayBoxIntersectMany(const SRay* rays, bool* results, TUInt32 numRays, string objectToCheck);
+			void RayBoxIntersectMany(const SRay* rays, bool* results, TUInt32 numRays, TAtom objectToCheck);
+
+			// Build the tree used by RayBoxIntersect for entities with the given name (e.g.
+			// "Building"), call after the level is loaded. The occluders must not move, be created
+			// or be destroyed afterwards (buildings are static), call this again if they do.
+			// Entities with other names are tested one entity at a time
+			void BuildOccluders(const string& name);
+			void BuildOccluders(TAtom name);
 	};
 
 }
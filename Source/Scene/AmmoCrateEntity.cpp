@@ -46,27 +46,25 @@ bool CAmmoCrateEntity::Update(TFloat32 updateTime)
 void CAmmoCrateEntity::AliveBehaviour(TFloat32 updateTime)
 {
 	Matrix().RotateLocalY(m_RotationSpeed * updateTime);
-	// Find out if any of the tanks is able to pick up this crate
-	EntityManager.BeginEnumEntities("", "", "Tank");
-	CEntity* entity = EntityManager.EnumEntity();
-	while (entity != 0)
+	// Find out if any of the nearby tanks is able to pick up this crate
+	vector<CEntity*> tanks;
+	EntityManager.QueryRadius(Position(), m_PickUpDistance, SEntityFilter(TankTypeAtom), tanks);
+	for each (CEntity* entity in tanks)
 	{
-		if (Distance(Position(), entity->Position()) < m_PickUpDistance)
-		{
-			CTankEntity* tankEntity = static_cast<CTankEntity*>(entity);
-			TInt32 currentTankShells = tankEntity->GetShellsAvailable(); 
-			TInt32 tankShellCapacity = tankEntity->GetShellCapacity(); 
-			TInt32 shellsToGive = Min(tankShellCapacity - currentTankShells, m_AmountOfShells);
+		CTankEntity* tankEntity = static_cast<CTankEntity*>(entity);
+		TInt32 currentTankShells = tankEntity->GetShellsAvailable(); 
+		TInt32 tankShellCapacity = tankEntity->GetShellCapacity(); 
+		TInt32 shellsToGive = Min(tankShellCapacity - currentTankShells, m_AmountOfShells);
 
-			tankEntity->RestoreShells(shellsToGive);
-			tankEntity->SetIsCollectingCrate(false);
-			UpdateState(Collected);
-			SetTargeted(false);
-		}
-		
-		entity = EntityManager.EnumEntity();
+		// The tank applies the shells itself (it may be updating at the same time)
+		SMessage msg;
+		msg.from = GetUID();
+		msg.type = Msg_RestoreShells;
+		msg.amount = shellsToGive;
+		Messenger.SendMessage(tankEntity->GetUID(), msg);
+		UpdateState(Collected);
+		SetTargeted(false);
 	}
-	EntityManager.EndEnumEntities();
 }
 
 
@@ -1,7 +1,11 @@
 #include "CrateEntity.h"
+#include "Messenger.h"
 
 namespace gen
 {
+	// Messenger class for sending messages to and between entities
+	extern CMessenger Messenger;
+
 	CCRateEntity::CCRateEntity
 	(
 		CEntityTemplate* entityTemplate,
@@ -25,10 +29,30 @@ namespace gen
 		m_AlivePosition = CVector3::kOrigin;
 		m_State = Collected;
 		m_IsTargeted = false;
+		m_TargetedBy = SystemUID;
+		SnapshotState();
+	}
+
+	// Copy the state read by other entities (alive, targeted) for a parallel update
+	void CCRateEntity::SnapshotState()
+	{
+		m_Snapshot.state = m_State;
+		m_Snapshot.isTargeted = m_IsTargeted;
 	}
 
 	bool CCRateEntity::Update(TFloat32 updateTime)
 	{
+		// Fetch any messages. Tanks choose crates from the snapshot, so several may claim the same
+		// crate in one update. Claims are fetched in sender order, the first is accepted
+		SMessage msg;
+		while (Messenger.FetchMessage(GetUID(), &msg))
+		{
+			if (msg.type == Msg_Targeted)
+			{
+				ClaimTarget(msg.from);
+			}
+		}
+
 		switch (m_State)
 		{
 			default:
@@ -58,6 +82,22 @@ namespace gen
 		return true;
 	}
 
+	void CCRateEntity::ClaimTarget(TEntityUID tank)
+	{
+		if (m_State == Alive && (!m_IsTargeted || m_TargetedBy == tank))
+		{
+			SetTargeted(true);
+			m_TargetedBy = tank;
+			return;
+		}
+
+		// Tell the tank to look for another crate
+		SMessage msg;
+		msg.from = GetUID();
+		msg.type = Msg_TargetRejected;
+		Messenger.SendMessage(tank, msg);
+	}
+
 	void CCRateEntity::AliveBehaviour(TFloat32 updateTime)
 	{
 		// Implementated in derived classes because here goes specific functionality 
@@ -67,7 +107,7 @@ namespace gen
 	{
 		if (Position().y > m_AlivePosition.y)
 		{
-			Position().y -= updateTime * m_Gravity;
+			Matrix().Position().y -= updateTime * m_Gravity;
 		}
 		else
 		{
@@ -79,7 +119,12 @@ namespace gen
 	{
 		if (m_RespawnTime > 0.0f)
 		{
-			m_RespawnTime -= updateTime;
+			// Sleep through the rest of the wait rather than counting it down every update
+			m_RespawnTime -= updateTime + GetTimeAsleep();
+			if (m_RespawnTime > 0.0f)
+			{
+				Sleep(m_RespawnTime);
+			}
 		}
 		else
 		{
@@ -45,9 +45,12 @@ namespace gen
 	public:
 		virtual bool Update(TFloat32 updateTime);
 		
-		const bool IsAlive() { return m_State == Alive; }
+		// Copy the state read by other entities (alive, targeted) for a parallel update
+		virtual void SnapshotState();
 
-		const bool GetTargeted() { return m_IsTargeted; }
+		const bool IsAlive() { return (ReadSnapshot() ? m_Snapshot.state : m_State) == Alive; }
+
+		const bool GetTargeted() { return ReadSnapshot() ? m_Snapshot.isTargeted : m_IsTargeted; }
 
 		void SetTargeted(bool isTargeted) { m_IsTargeted = isTargeted; }
 
@@ -69,8 +72,17 @@ namespace gen
 		CVector3 m_CollectedPosition;
 		EState m_State;
 		bool m_IsTargeted;
+		TEntityUID m_TargetedBy; // Tank whose claim was accepted, when targeted
 		TFloat32 m_RetargetCooldown = 15.0f;
 
+		// State read by other entities during a parallel update (see CEntity::SnapshotState)
+		struct SSnapshot
+		{
+			EState state;
+			bool   isTargeted;
+		};
+		SSnapshot m_Snapshot;
+
 		// Methods that can be overriden 
 
 		virtual void AliveBehaviour(TFloat32 updateTime);
@@ -80,6 +92,10 @@ namespace gen
 		virtual void CollectedBehaviour(TFloat32 updateTime);
 
 		virtual void UpdateState(EState newState);
+
+		// Accept a tank's claim (Msg_Targeted) if the crate is alive and not already claimed,
+		// otherwise reply with Msg_TargetRejected
+		void ClaimTarget(TEntityUID tank);
 		
 	};
 
@@ -5,10 +5,17 @@
 ********************************************/
 
 #include "Entity.h"
+#include "EntityManager.h"
 
 namespace gen
 {
 
+extern CEntityManager EntityManager;
+
+// Parallel update state
+bool CEntity::s_SnapshotReads = false;
+thread_local CEntity* CEntity::t_UpdatingEntity = 0;
+
 /*-----------------------------------------------------------------------------------------
 -------------------------------------------------------------------------------------------
 	Base Entity Class
@@ -29,42 +36,113 @@ CEntity::CEntity
 {
 	m_Template = entityTemplate;
 	m_UID = UID;
-	m_Name = name;
+	m_Name = Atom( name );
+	m_InGrid = false;
+	m_SleepTime = 0.0f;
+	m_TimeAsleep = 0.0f;
+
+	// Seed the random sequence from the UID (xorshift state must not be zero)
+	m_RandomState = (UID ^ 0x9e3779b9u) * 2654435761u;
+	if (m_RandomState == 0)
+	{
+		m_RandomState = 1;
+	}
 
-	// Allocate space for matrices
-	TUInt32 numNodes = m_Template->Mesh()->GetNumNodes();
-	m_RelMatrices = new CMatrix4x4[numNodes];
-	m_Matrices = new CMatrix4x4[numNodes];
+	// Allocate relative and absolute matrices in the manager's transform store
+	m_Transforms = &EntityManager.Transforms();
+	m_NumNodes = m_Template->Mesh()->GetNumNodes();
+	m_FirstNode = m_Transforms->Allocate( m_NumNodes );
+	m_WorldDirty = true;
 
 	// Set initial matrices from mesh defaults
-	for (TUInt32 node = 0; node < numNodes; ++node)
+	for (TUInt32 node = 0; node < m_NumNodes; ++node)
 	{
-		m_RelMatrices[node] = m_Template->Mesh()->GetNode( node ).positionMatrix;
+		Matrix( node ) = m_Template->Mesh()->GetNode( node ).positionMatrix;
 	}
 
 	// Override root matrix with constructor parameters
-	m_RelMatrices[0] = CMatrix4x4( position, rotation, kZXY, scale );
+	Matrix() = CMatrix4x4( position, rotation, kZXY, scale );
+}
+
+// Destructor returns matrices to the manager's transform store
+CEntity::~CEntity()
+{
+	m_Transforms->Free( m_FirstNode, m_NumNodes );
 }
 
 
 // Render the model
 void CEntity::Render()
 {
+	// Bring absolute matrices up to date - unchanged entities are not recalculated
+	UpdateWorldMatrices();
+
+	// Incorporate any bone<->mesh offsets (only relevant for skinning)
+	// Don't need this step for this exercise
+
+	// Render with absolute matrices
+	m_Template->Mesh()->Render( &m_Transforms->WorldMatrix( m_FirstNode ) );
+}
+
+// Recalculate the world matrices of nodes whose relative matrix, or a parent's, has changed
+// since the last call
+void CEntity::UpdateWorldMatrices()
+{
+	if (!m_WorldDirty)
+	{
+		return;
+	}
+
 	// Get pointer to mesh to simplify code
 	CMesh* Mesh = m_Template->Mesh();
 
-	// Calculate absolute matrices from relative node matrices & node heirarchy
-	m_Matrices[0] = m_RelMatrices[0];
-	TUInt32 numNodes = Mesh->GetNumNodes();
-	for (TUInt32 node = 1; node < numNodes; ++node)
+	// Calculate absolute matrices from relative node matrices & node heirarchy. Parents come
+	// before their children, so a child of a dirty node is marked dirty before it is reached
+	CMatrix4x4* relMatrices = &m_Transforms->RelMatrix( m_FirstNode );
+	CMatrix4x4* matrices = &m_Transforms->WorldMatrix( m_FirstNode );
+	TUInt8* dirty = &m_Transforms->DirtyFlag( m_FirstNode );
+	TUInt32 numRecomputes = 0;
+	if (dirty[0])
 	{
-		m_Matrices[node] = m_RelMatrices[node] * m_Matrices[Mesh->GetNode( node ).parent];
+		matrices[0] = relMatrices[0];
+		++numRecomputes;
+	}
+	for (TUInt32 node = 1; node < m_NumNodes; ++node)
+	{
+		TUInt32 parent = Mesh->GetNode( node ).parent;
+		if (dirty[node] || dirty[parent])
+		{
+			dirty[node] = 1;
+			matrices[node] = relMatrices[node] * matrices[parent];
+			++numRecomputes;
+		}
 	}
-	// Incorporate any bone<->mesh offsets (only relevant for skinning)
-	// Don't need this step for this exercise
 
-	// Render with absolute matrices
-	Mesh->Render( m_Matrices );
+	for (TUInt32 node = 0; node < m_NumNodes; ++node)
+	{
+		dirty[node] = 0;
+	}
+	m_WorldDirty = false;
+	m_Transforms->CountRecomputes( numRecomputes );
+}
+
+
+// Random integer from a to b (inclusive) from the entity's own sequence
+TInt32 CEntity::Random( TInt32 a, TInt32 b )
+{
+	m_RandomState ^= m_RandomState << 13;
+	m_RandomState ^= m_RandomState >> 17;
+	m_RandomState ^= m_RandomState << 5;
+	return a + static_cast<TInt32>(m_RandomState % static_cast<TUInt32>(b - a + 1));
+}
+
+// Random float from a to b (inclusive) from the entity's own sequence
+TFloat32 CEntity::Random( TFloat32 a, TFloat32 b )
+{
+	m_RandomState ^= m_RandomState << 13;
+	m_RandomState ^= m_RandomState >> 17;
+	m_RandomState ^= m_RandomState << 5;
+	return a + (b - a) * (static_cast<TFloat32>(m_RandomState >> 8) / 16777215.0f);
 }
 
 
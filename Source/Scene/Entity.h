@@ -10,10 +10,12 @@
 using namespace std;
 
 #include "Defines.h"
+#include "Atom.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
 #include "Camera.h"
 #include "Mesh.h"
+#include "TransformStore.h"
 
 namespace gen
 {
@@ -25,6 +27,56 @@ namespace gen
 typedef TUInt32 TEntityUID;
 const TEntityUID SystemUID = 0xffffffff;
 
+// Entity handles pack the index of a slot in the entity manager's handle table (low bits) with
+// the generation of that slot (high bits). Each time an entity is destroyed the generation of its
+// slot is increased, so handles to destroyed entities no longer match and safely resolve to null
+// even after the slot is reused. An entity's UID is its packed handle value
+const TUInt32 HandleIndexBits = 20;
+const TUInt32 HandleIndexMask = (1u << HandleIndexBits) - 1;
+const TUInt32 HandleGenerationMask = 0xffffffff >> HandleIndexBits;
+
+// The largest index is never used for a slot, so SystemUID is never a valid handle
+const TUInt32 MaxHandleSlots = HandleIndexMask;
+
+struct SEntityHandle
+{
+	// Default handle refers to no entity
+	SEntityHandle() : value( SystemUID ) {}
+
+	// Handle from a UID (the packed value)
+	explicit SEntityHandle( TEntityUID UID ) : value( UID ) {}
+
+	SEntityHandle( TUInt32 index, TUInt32 generation )
+		: value( ((generation & HandleGenerationMask) << HandleIndexBits) | index ) {}
+
+	TUInt32 Index() const
+	{
+		return value & HandleIndexMask;
+	}
+
+	TUInt32 Generation() const
+	{
+		return value >> HandleIndexBits;
+	}
+
+	TEntityUID UID() const
+	{
+		return value;
+	}
+
+	bool operator==( const SEntityHandle& handle ) const
+	{
+		return value == handle.value;
+	}
+
+	bool operator!=( const SEntityHandle& handle ) const
+	{
+		return value != handle.value;
+	}
+
+	TUInt32 value;
+};
+
 
 /*-----------------------------------------------------------------------------------------
 -------------------------------------------------------------------------------------------
@@ -44,8 +96,8 @@ public:
 	// and the associated mesh (e.g. "panda.x")
 	CEntityTemplate( const string& type, const string& name, const string& meshFilename )
 	{
-		m_Type = type;
-		m_Name = name;
+		m_Type = Atom( type );
+		m_Name = Atom( name );
 
 		// Load mesh
 		m_Mesh = new CMesh();
@@ -78,10 +130,21 @@ public:
 
 	const string& GetType()
 	{
-		return m_Type;
+		return AtomString( m_Type );
 	}
 
 	const string& GetName()
+	{
+		return AtomString( m_Name );
+	}
+
+	// Type and name as atoms, for fast comparison
+	TAtom GetTypeAtom()
+	{
+		return m_Type;
+	}
+
+	TAtom GetNameAtom()
 	{
 		return m_Name;
 	}
@@ -96,9 +159,9 @@ public:
 //	Private interface
 private:
 
-	// Type and name of the template
-	string m_Type;
-	string m_Name;
+	// Type and name of the template (interned strings)
+	TAtom m_Type;
+	TAtom m_Name;
 
 	// The mesh representing this entity
 	CMesh* m_Mesh;
@@ -133,11 +196,7 @@ public:
 	);
 
 	// Destructor - base class destructors should always be virtual
-	virtual ~CEntity()
-	{
-		delete[] m_Matrices;
-		delete[] m_RelMatrices;
-	}
+	virtual ~CEntity();
 
 private:
 	// Prevent use of copy constructor and assignment operator (private and not defined)
@@ -157,12 +216,23 @@ public:
 		return m_UID;
 	}
 
+	SEntityHandle const GetHandle()
+	{
+		return SEntityHandle( m_UID );
+	}
+
 	CEntityTemplate* const Template()
 	{
 		return m_Template;
 	}
 
 	const string& GetName()
+	{
+		return AtomString( m_Name );
+	}
+
+	// Name as an atom, for fast comparison
+	TAtom GetNameAtom()
 	{
 		return m_Name;
 	}
@@ -171,16 +241,51 @@ public:
 	/////////////////////////////////////
 	// Matrix access
 
-	// Direct access to position and matrix
-	CVector3& Position( TUInt32 node = 0 )
+	// Access to position and matrices - these refer into the entity manager's transform store
+	// so should not be held across entity creation. During a parallel update, other entities
+	// see the matrices as they were at the start of the update
+
+	// Relative matrix of a node (the root node's is its world matrix) for changing. This marks
+	// the node's world matrix to be recalculated, so use GetMatrix or Position to only read it.
+	// During a parallel update only the entity being updated may change its matrices
+	CMatrix4x4& Matrix( TUInt32 node = 0 )
+	{
+		GEN_ASSERT( !ReadSnapshot(), "Another entity's matrix changed during a parallel update" );
+		m_Transforms->DirtyFlag( m_FirstNode + node ) = 1;
+		m_WorldDirty = true;
+		return m_Transforms->RelMatrix( m_FirstNode + node );
+	}
+
+	// Relative matrix and position of a node for reading
+	const CMatrix4x4& GetMatrix( TUInt32 node = 0 )
 	{
-		return m_RelMatrices[node].Position();
+		return ReadSnapshot() ? m_Transforms->SnapshotMatrix( m_FirstNode + node ) :
+		                        m_Transforms->RelMatrix( m_FirstNode + node );
 	}
-	CMatrix4x4& Matrix( TUInt32 node = 0 )
+	const CVector3& Position( TUInt32 node = 0 )
 	{
-		return m_RelMatrices[node];
+		return GetMatrix( node ).Position();
+	}
+
+	// World matrix of a node, calculated from the relative matrices of the node and its parents
+	// only when one of them has changed (see UpdateWorldMatrices)
+	const CMatrix4x4& WorldMatrix( TUInt32 node = 0 )
+	{
+		if (ReadSnapshot())
+		{
+			return m_Transforms->SnapshotWorldMatrix( m_FirstNode + node );
+		}
+		if (m_WorldDirty)
+		{
+			UpdateWorldMatrices();
+		}
+		return m_Transforms->WorldMatrix( m_FirstNode + node );
 	}
 
+	// Recalculate the world matrices of nodes whose relative matrix, or a parent's, has changed
+	// since the last call. Does nothing if no node has changed
+	void UpdateWorldMatrices();
+
 
 	/////////////////////////////////////
 	// Update / Render
@@ -195,20 +300,113 @@ public:
 	void Render();
 
 
+	/////////////////////////////////////
+	// Parallel update support
+	// In a parallel update (see CEntityManager::UpdateAllEntities) entities are updated on several
+	// threads at once. Each entity may change only its own state - anything it reads from other
+	// entities comes from a snapshot taken at the start of the update, and any change it needs
+	// to make to another entity is sent as a message
+
+	// Bring the world matrices up to date and copy the node matrices and any other state that
+	// other entities read to the snapshot (called by the entity manager)
+	void TakeSnapshot()
+	{
+		UpdateWorldMatrices();
+		m_Transforms->TakeSnapshot( m_FirstNode, m_NumNodes );
+		SnapshotState();
+	}
+
+	// Copy any state that other entities read into snapshot members. Node matrices are copied
+	// by TakeSnapshot. Virtual function, base version does nothing
+	virtual void SnapshotState() {}
+
+	// Switch reads of other entities' snapshots on or off (set by the entity manager)
+	static void SetSnapshotReads( bool snapshotReads )
+	{
+		s_SnapshotReads = snapshotReads;
+	}
+
+	// Set the entity being updated on the calling thread, 0 for none (set by the entity manager)
+	static void SetUpdatingEntity( CEntity* entity )
+	{
+		t_UpdatingEntity = entity;
+	}
+
+
+/////////////////////////////////////
+//	Protected interface
+protected:
+
+	// Return true if reads of this entity should use its snapshot, i.e. during a parallel update
+	// by any entity other than this one
+	bool ReadSnapshot()
+	{
+		return s_SnapshotReads && t_UpdatingEntity != this;
+	}
+
+	// Ask not to be updated for the given time (seconds) after this update. A message sent to
+	// the entity wakes it early. Use GetTimeAsleep to find how long the entity slept
+	void Sleep( TFloat32 time )
+	{
+		m_SleepTime = time;
+	}
+
+	// Ask not to be updated until a message is sent to the entity
+	void SleepUntilMessage()
+	{
+		m_SleepTime = -1.0f;
+	}
+
+	// Time the entity was asleep before the current update, 0 if it was not asleep. This time
+	// is not included in the update time passed to Update
+	TFloat32 GetTimeAsleep()
+	{
+		return m_TimeAsleep;
+	}
+
+	// Random numbers from a per-entity sequence seeded from the UID, so results do not depend on
+	// the order entities are updated in. Returns from a to b (inclusive). These hide the global
+	// Random functions within entity classes
+	TInt32 Random( TInt32 a, TInt32 b );
+	TFloat32 Random( TFloat32 a, TFloat32 b );
+
+
 /////////////////////////////////////
 //	Private interface
 private:
+	friend class CSpatialGrid;
+	friend class CEntityManager;
 
 	// The template used by this entity - the common data for all entities of this type
 	CEntityTemplate* m_Template;
 
-	// Unique identifier and name for the entity
+	// Unique identifier and name for the entity (name is an interned string)
 	TEntityUID  m_UID;
-	string      m_Name;
-
-	// Relative and absolute world matrices for each node in the template's mesh
-	CMatrix4x4* m_RelMatrices; // Dynamically allocated arrays
-	CMatrix4x4* m_Matrices;
+	TAtom       m_Name;
+
+	// Relative and absolute world matrices for each node in the template's mesh are held in the
+	// entity manager's transform store, as a range of nodes starting at the given index
+	CTransformStore* m_Transforms;
+	TUInt32          m_FirstNode;
+	TUInt32          m_NumNodes;
+	bool             m_WorldDirty; // Any node is dirty, i.e. world matrices need recalculating
+
+	// Cell the entity is filed in by the spatial grid (maintained by CSpatialGrid)
+	bool   m_InGrid;
+	TInt32 m_GridCellX;
+	TInt32 m_GridCellZ;
+
+	// State of the entity's random number sequence (xorshift)
+	TUInt32 m_RandomState;
+
+	// Sleep requested by the current update (0 for none, negative until a message), and time
+	// spent asleep before the current update (maintained by CEntityManager)
+	TFloat32 m_SleepTime;
+	TFloat32 m_TimeAsleep;
+
+	// Parallel update state (see above)
+	static bool                  s_SnapshotReads;
+	static thread_local CEntity* t_UpdatingEntity;
 };
 
 
@@ -5,32 +5,61 @@
 	destruction
 ********************************************/
 
+#include <iostream>
+#include <algorithm>
+using namespace std;
+
 #include "EntityManager.h"
+#include "Messenger.h"
+#include "CTimer.h"
 
 namespace gen
 {
 
+// Messages are held during the parallel update
+extern CMessenger Messenger;
+
+// Type and name atoms used in queries every frame
+const TAtom TankTypeAtom = Atom( "Tank" );
+const TAtom ProjectileTypeAtom = Atom( "Projectile" );
+const TAtom AmmoTypeAtom = Atom( "Ammo" );
+const TAtom HealthTypeAtom = Atom( "Health" );
+const TAtom BuildingNameAtom = Atom( "Building" );
+
 /////////////////////////////////////
 // Constructors/Destructors
 
-// Constructor reserves space for entities and UID hash map, also sets first UID
+// Constructor reserves space for entities and handle table
 CEntityManager::CEntityManager()
+	: m_EntityPool( "Entity" ), m_TankPool( "Tank", 16 ), m_ShellPool( "Shell", 16 ),
+	  m_AmmoCratePool( "AmmoCrate", 16 ), m_HealthCratePool( "HealthCrate", 16 ), m_MinePool( "Mine", 16 )
 {
 	// Initialise list of entities and UID hash map
 	m_Entities.reserve( 1024 );
-	m_EntityUIDMap = new CHashTable<TEntityUID, TUInt32>( 2048, JOneAtATimeHash ); 
-
-	// Set first entity UID that will be used
-	m_NextUID = 0;
-
-	m_IsEnumerating = false;
+	m_EntitySlots.reserve( 1024 );
+	m_HandleSlots.reserve( 1024 );
+	m_FirstFreeSlot = m_LastFreeSlot = NoFreeSlot;
+	m_NewSlotGeneration = 0;
+
+	m_Commands.reserve( 256 );
+	m_IsUpdating = false;
+
+	m_ActiveEntities.reserve( 1024 );
+	m_NumSleeping = 0;
+	m_ElapsedTime = 0.0f;
+	m_IsDeliveryListener = false;
+
+	// Two-phase update on the calling thread only, see SetUpdateThreads
+	m_UpdateThreads = 1;
+	m_IsParallelPhase = false;
+	m_UpdateTime = 0.0f;
 }
 
-// Destructor removes all entities
+// Destructor removes all entities. The messenger is not used, it is a global in another file so
+// may already have been destroyed
 CEntityManager::~CEntityManager()
 {
-	DestroyAllEntities();
-	delete m_EntityUIDMap;
+	FreeAllEntities();
 }
 
 
@@ -103,6 +132,110 @@ void CEntityManager::DestroyAllTemplates()
 /////////////////////////////////////
 // Entity creation / destruction
 
+// Take a handle slot for a new entity and return the UID (packed handle) to construct it with
+TEntityUID CEntityManager::NewUID()
+{
+	GEN_ASSERT( !m_IsParallelPhase, "Entities cannot be created during a parallel update" );
+
+	// Take the oldest free slot, or add a new one
+	TUInt32 slot = m_FirstFreeSlot;
+	if (slot != NoFreeSlot)
+	{
+		m_FirstFreeSlot = m_HandleSlots[slot].entityIndex;
+		if (m_FirstFreeSlot == NoFreeSlot)
+		{
+			m_LastFreeSlot = NoFreeSlot;
+		}
+	}
+	else
+	{
+		slot = static_cast<TUInt32>(m_HandleSlots.size());
+		GEN_ASSERT( slot < MaxHandleSlots, "Too many entities for handle table" );
+		SHandleSlot newSlot;
+		newSlot.generation = m_NewSlotGeneration;
+		m_HandleSlots.push_back( newSlot );
+	}
+
+	// Entity index is set when the entity is added
+	m_HandleSlots[slot].entityIndex = NoFreeSlot;
+	return SEntityHandle( slot, m_HandleSlots[slot].generation ).UID();
+}
+
+// Add a newly constructed entity to the manager, or queue it to be added if updating. Pass
+// the pool the entity was constructed in, the team for entities that are on one and whether
+// the entity is static (never updated). Returns the UID of the entity
+TEntityUID CEntityManager::AddEntity( CEntity* newEntity, CEntityPoolBase* pool, TInt32 team /*= NoTeam*/,
+                                      bool isStatic /*= false*/ )
+{
+	if (m_IsUpdating)
+	{
+		// Entity handle is valid immediately, but the entity is not found until committed
+		m_HandleSlots[newEntity->GetHandle().Index()].entityIndex = PendingEntity;
+
+		SEntityCommand command;
+		command.type = EntityCommand_Create;
+		command.handle = newEntity->GetHandle();
+		command.entity = newEntity;
+		command.pool = pool;
+		command.team = team;
+		command.isStatic = isStatic;
+		m_Commands.push_back( command );
+	}
+	else
+	{
+		InsertEntity( newEntity, pool, team, isStatic );
+	}
+	return newEntity->GetUID();
+}
+
+// Add a newly constructed entity to the entity list, handle table, type lists, active list
+// and spatial grid (see AddEntity)
+void CEntityManager::InsertEntity( CEntity* newEntity, CEntityPoolBase* pool, TInt32 team, bool isStatic )
+{
+	// Get vector index for new entity and add it to vector
+	TUInt32 entityIndex = static_cast<TUInt32>(m_Entities.size());
+	m_Entities.push_back( newEntity );
+
+	// Point the entity's handle slot at the entity index
+	m_HandleSlots[newEntity->GetHandle().Index()].entityIndex = entityIndex;
+
+	// Add entity index to the list for its template type
+	SEntitySlot entitySlot;
+	entitySlot.indices = &m_EntityTypes[newEntity->Template()->GetTypeAtom()];
+	entitySlot.position = static_cast<TUInt32>(entitySlot.indices->size());
+	entitySlot.indices->push_back( entityIndex );
+	entitySlot.pool = pool;
+	entitySlot.team = team;
+	entitySlot.teamPosition = 0;
+	entitySlot.activity = Activity_Static;
+	entitySlot.activePosition = 0;
+	entitySlot.sleepCount = 0;
+	entitySlot.sleepStart = 0.0f;
+	m_EntitySlots.push_back( entitySlot );
+
+	// Static entities are never updated, so take their snapshot once now
+	if (isStatic)
+	{
+		newEntity->TakeSnapshot();
+	}
+	else
+	{
+		Activate( entityIndex );
+
+		// Updated entities fetch messages, so receive broadcasts to their team and type
+		Messenger.AddRecipient( newEntity->GetUID(), team, newEntity->Template()->GetTypeAtom() );
+	}
+
+	// File the entity in the spatial grid at its initial position
+	m_SpatialGrid.Insert( newEntity, team );
+
+	// Only tanks are on a team
+	if (team != NoTeam)
+	{
+		AddToTeam( entityIndex );
+	}
+}
+
 // Create a base class entity - requires a template name, may supply entity name and position
 // Returns the UID of the new entity
 TEntityUID CEntityManager::CreateEntity
@@ -118,19 +251,10 @@ TEntityUID CEntityManager::CreateEntity
 	CEntityTemplate* entityTemplate = GetTemplate( templateName );
 
 	// Create new entity with next UID
-	CEntity* newEntity = new CEntity( entityTemplate, m_NextUID, name, position, rotation, scale );
-
-	// Get vector index for new entity and add it to vector
-	TUInt32 entityIndex = static_cast<TUInt32>(m_Entities.size());
-	m_Entities.push_back( newEntity );
+	CEntity* newEntity = new (m_EntityPool.Allocate()) CEntity( entityTemplate, NewUID(), name, position, rotation, scale );
 
-	// Add mapping from UID to entity index into hash map
-	m_EntityUIDMap->SetKeyValue( m_NextUID, entityIndex );
-	
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
-
-	// Return UID of new entity then increase it ready for next entity
-	return m_NextUID++;
+	// Base class entities do nothing in their update so are static
+	return AddEntity( newEntity, &m_EntityPool, NoTeam, true );
 }
 
 
@@ -152,19 +276,9 @@ TEntityUID CEntityManager::CreateTank
 	CTankTemplate* tankTemplate = static_cast<CTankTemplate*>(GetTemplate(templateName));
 
 	// Create new tank entity with next UID
-	CEntity* newEntity = new CTankEntity(tankTemplate, m_NextUID, team, patrolPoints, name, position, rotation, scale);
-
-	// Get vector index for new entity and add it to vector
-	TUInt32 entityIndex = static_cast<int>(m_Entities.size());
-	m_Entities.push_back(newEntity);
+	CEntity* newEntity = new (m_TankPool.Allocate()) CTankEntity(tankTemplate, NewUID(), team, patrolPoints, name, position, rotation, scale);
 
-	// Add mapping from UID to entity index into hash map
-	m_EntityUIDMap->SetKeyValue(m_NextUID, entityIndex);
-
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
-
-							 // Return UID of new entity then increase it ready for next entity
-	return m_NextUID++;
+	return AddEntity( newEntity, &m_TankPool, team );
 }
 
 
@@ -184,19 +298,9 @@ TEntityUID CEntityManager::CreateShell
 	CEntityTemplate* entityTemplate = GetTemplate(templateName);
 
 	// Create new tank entity with next UID
-	CEntity* newEntity = new CShellEntity(entityTemplate, m_NextUID, owner, name, position, rotation, scale);
-
-	// Get vector index for new entity and add it to vector
-	TUInt32 entityIndex = static_cast<int>(m_Entities.size());
-	m_Entities.push_back(newEntity);
-
-	// Add mapping from UID to entity index into hash map
-	m_EntityUIDMap->SetKeyValue(m_NextUID, entityIndex);
+	CEntity* newEntity = new (m_ShellPool.Allocate()) CShellEntity(entityTemplate, NewUID(), owner, name, position, rotation, scale);
 
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
-
-							 // Return UID of new entity then increase it ready for next entity
-	return m_NextUID++;
+	return AddEntity( newEntity, &m_ShellPool );
 }
 
 TEntityUID CEntityManager::CreateCrate
@@ -215,30 +319,22 @@ TEntityUID CEntityManager::CreateCrate
 	CEntityTemplate* entityTemplate = GetTemplate(templateName);
 
 	CEntity* newEntity = nullptr;
+	CEntityPoolBase* pool = nullptr;
 	// Create type of crate
 	if (templateName == "AmmoCrate")
 	{
-		newEntity = new CAmmoCrateEntity(entityTemplate, m_NextUID, 
+		newEntity = new (m_AmmoCratePool.Allocate()) CAmmoCrateEntity(entityTemplate, NewUID(), 
 			rotationSpeed, respawnTime, pickUpDistance, name, position, rotation, scale);
+		pool = &m_AmmoCratePool;
 	}
 	else
 	{
-		newEntity = new CHealthCrateEntity(entityTemplate, m_NextUID,
+		newEntity = new (m_HealthCratePool.Allocate()) CHealthCrateEntity(entityTemplate, NewUID(),
 			rotationSpeed, respawnTime, pickUpDistance, name, position, rotation, scale);
+		pool = &m_HealthCratePool;
 	}
 
-	// Get vector index for new entity and add it to vector
-	TUInt32 entityIndex = static_cast<int>(m_Entities.size());
-	m_Entities.push_back(newEntity);
-
-	// Add mapping from UID to entity index into hash map
-	m_EntityUIDMap->SetKeyValue(m_NextUID, entityIndex);
-
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
-
-							 // Return UID of new entity then increase it ready for next entity
-	return m_NextUID++;
-	return TEntityUID();
+	return AddEntity( newEntity, pool );
 }
 
 TEntityUID CEntityManager::CreateMine
@@ -256,62 +352,457 @@ TEntityUID CEntityManager::CreateMine
 	CEntityTemplate* entityTemplate = GetTemplate(templateName);
 
 	// Create new tank entity with next UID
-	CEntity* newEntity = new CMineEntity(entityTemplate, m_NextUID, respawnTime, damageRadius, name, position, rotation, scale);
+	CEntity* newEntity = new (m_MinePool.Allocate()) CMineEntity(entityTemplate, NewUID(), respawnTime, damageRadius, name, position, rotation, scale);
 
-	// Get vector index for new entity and add it to vector
-	TUInt32 entityIndex = static_cast<int>(m_Entities.size());
-	m_Entities.push_back(newEntity);
+	return AddEntity( newEntity, &m_MinePool );
+}
 
-	// Add mapping from UID to entity index into hash map
-	m_EntityUIDMap->SetKeyValue(m_NextUID, entityIndex);
 
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
+// Create the given number of base class entities with a template name, each placed by the
+// generator function. Returns the contiguous range of UIDs of the new entities
+SEntityUIDRange CEntityManager::CreateEntities
+(
+	const string&    templateName,
+	TUInt32          count,
+	TEntityGenerator generator /*= 0*/,
+	void*            data /*= 0*/,
+	const string&    name /*= ""*/
+)
+{
+	GEN_ASSERT( !m_IsParallelPhase, "Entities cannot be created during a parallel update" );
 
-							 // Return UID of new entity then increase it ready for next entity
-	return m_NextUID++;
+	// Get template associated with the template name
+	CEntityTemplate* entityTemplate = GetTemplate( templateName );
+
+	// Reserve space for all the entities at once
+	ReserveEntities( count, entityTemplate->GetTypeAtom() );
+	m_EntityPool.Reserve( count );
+	m_Transforms.Reserve( count * entityTemplate->Mesh()->GetNumNodes() );
+
+	// Take new handle slots from the end of the table, so the UIDs (all the same generation) are
+	// consecutive
+	SEntityUIDRange UIDs;
+	TUInt32 firstSlot = static_cast<TUInt32>(m_HandleSlots.size());
+	GEN_ASSERT( firstSlot + count <= MaxHandleSlots, "Too many entities for handle table" );
+	UIDs.first = SEntityHandle( firstSlot, m_NewSlotGeneration ).UID();
+	UIDs.count = count;
+	SHandleSlot newSlot;
+	newSlot.entityIndex = NoFreeSlot;
+	newSlot.generation = m_NewSlotGeneration;
+	m_HandleSlots.resize( m_HandleSlots.size() + count, newSlot );
+
+	// Create the entities in order
+	SEntityPlacement placement;
+	for (TUInt32 entity = 0; entity < count; ++entity)
+	{
+		placement.position = CVector3::kOrigin;
+		placement.rotation = CVector3( 0.0f, 0.0f, 0.0f );
+		placement.scale = CVector3( 1.0f, 1.0f, 1.0f );
+		if (generator)
+		{
+			generator( data, entity, placement );
+		}
+
+		CEntity* newEntity = new (m_EntityPool.Allocate()) CEntity( entityTemplate, UIDs[entity], name, placement.position,
+		                                                            placement.rotation, placement.scale );
+		AddEntity( newEntity, &m_EntityPool, NoTeam, true );
+	}
+
+	return UIDs;
 }
 
 
 // Destroy the given entity - returns true if the entity existed and was destroyed
-bool CEntityManager::DestroyEntity( TEntityUID UID )
+bool CEntityManager::DestroyEntity( SEntityHandle handle )
 {
-	// Find the vector index of the given UID
-	TUInt32 entityIndex;
-	if (!m_EntityUIDMap->LookUpKey( UID, &entityIndex ))
+	GEN_ASSERT( !m_IsParallelPhase, "Entities cannot be destroyed during a parallel update" );
+
+	// Check the handle refers to an existing entity, or during an update one created earlier in
+	// the update. Entities still being constructed (not yet added) cannot be destroyed
+	TUInt32 slot = handle.Index();
+	if (slot >= m_HandleSlots.size() || m_HandleSlots[slot].generation != handle.Generation())
 	{
 		// Quit if not found
 		return false;
 	}
+	TUInt32 entityIndex = m_HandleSlots[slot].entityIndex;
+	if (entityIndex >= m_Entities.size() && !(m_IsUpdating && entityIndex == PendingEntity))
+	{
+		return false;
+	}
 
-	// Delete the given entity and remove from UID map
-	delete m_Entities[entityIndex];
-	m_EntityUIDMap->RemoveKey( UID );
+	if (m_IsUpdating)
+	{
+		SEntityCommand command;
+		command.type = EntityCommand_Destroy;
+		command.handle = handle;
+		m_Commands.push_back( command );
+	}
+	else
+	{
+		RemoveEntity( handle );
+	}
+	return true;
+}
+
+// Remove and destroy the entity with the given handle, which must exist
+void CEntityManager::RemoveEntity( SEntityHandle handle )
+{
+	TUInt32 entityIndex = m_HandleSlots[handle.Index()].entityIndex;
+	if (m_EntitySlots[entityIndex].team != NoTeam)
+	{
+		RemoveFromTeam( entityIndex );
+	}
+
+	// Any wake timer for the entity is ignored when it expires as the handle is no longer valid
+	if (m_EntitySlots[entityIndex].activity == Activity_Active)
+	{
+		Deactivate( entityIndex );
+	}
+	else if (m_EntitySlots[entityIndex].activity == Activity_Sleeping)
+	{
+		--m_NumSleeping;
+	}
+
+	// Messages still waiting for the entity are never fetched
+	Messenger.DiscardMessages( handle.UID() );
+
+	// Destroy the given entity (returning it to its pool) and remove from handle table, type
+	// list and spatial grid
+	m_SpatialGrid.Remove( m_Entities[entityIndex] );
+	m_EntitySlots[entityIndex].pool->Destroy( m_Entities[entityIndex] );
+	FreeHandleSlot( handle.Index() );
+	RemoveFromTypeIndices( entityIndex );
 
 	// If not removing last entity...
-	if (entityIndex != m_Entities.size() - 1)
+	TUInt32 lastIndex = static_cast<TUInt32>(m_Entities.size()) - 1;
+	if (entityIndex != lastIndex)
 	{
-		// ...put the last entity into the empty entity slot and update UID map
+		// ...put the last entity into the empty entity slot and update handle table and type list
 		m_Entities[entityIndex] = m_Entities.back();
-		m_EntityUIDMap->SetKeyValue( m_Entities.back()->GetUID(), entityIndex );
+		m_HandleSlots[m_Entities.back()->GetHandle().Index()].entityIndex = entityIndex;
+		m_EntitySlots[entityIndex] = m_EntitySlots.back();
+		const SEntitySlot& movedSlot = m_EntitySlots[entityIndex];
+		(*movedSlot.indices)[movedSlot.position] = entityIndex;
+		if (movedSlot.activity == Activity_Active)
+		{
+			m_ActiveEntities[movedSlot.activePosition] = entityIndex;
+		}
 	}
 	m_Entities.pop_back(); // Remove last entity
-
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
-	return true;
+	m_EntitySlots.pop_back();
 }
 
 
-// Destroy all entities held by the manager
+// Destroy all entities held by the manager, and any messages waiting for them
 void CEntityManager::DestroyAllEntities()
 {
-	m_EntityUIDMap->RemoveAllKeys();
+	FreeAllEntities();
+	Messenger.DiscardAllMessages();
+}
+
+// Destroy all entities held by the manager without using the messenger
+void CEntityManager::FreeAllEntities()
+{
+	// Discard any deferred commands, destroying entities that were never added
+	for (TUInt32 command = 0; command < m_Commands.size(); ++command)
+	{
+		if (m_Commands[command].type == EntityCommand_Create)
+		{
+			FreeHandleSlot( m_Commands[command].handle.Index() );
+			m_Commands[command].pool->Destroy( m_Commands[command].entity );
+		}
+	}
+	m_Commands.clear();
+
+	m_EntityTypes.clear();
+	m_Teams.clear();
+	m_ActiveEntities.clear();
+	m_UpdateList.clear();
+	m_NumSleeping = 0;
+	m_WakeTimers = priority_queue<SWakeTimer, vector<SWakeTimer>, greater<SWakeTimer> >();
+	m_WokenEntities.clear();
+	m_SpatialGrid.Clear();
 	while (m_Entities.size())
 	{
-		delete m_Entities.back();
+		FreeHandleSlot( m_Entities.back()->GetHandle().Index() );
+		m_EntitySlots.back().pool->Destroy( m_Entities.back() );
 		m_Entities.pop_back();
+		m_EntitySlots.pop_back();
+	}
+	m_Transforms.Clear();
+}
+
+// Apply all deferred entity creation and destruction in the order it was requested. Called
+// at the end of UpdateAllEntities
+void CEntityManager::CommitCommands()
+{
+	for (TUInt32 command = 0; command < m_Commands.size(); ++command)
+	{
+		SEntityCommand& entityCommand = m_Commands[command];
+		if (entityCommand.type == EntityCommand_Create)
+		{
+			InsertEntity( entityCommand.entity, entityCommand.pool, entityCommand.team, entityCommand.isStatic );
+		}
+		else if (GetEntity( entityCommand.handle ))
+		{
+			// Entities created earlier in the update have been inserted above, so any entity
+			// still found can be removed. Repeat destroys of the same entity are ignored
+			RemoveEntity( entityCommand.handle );
+		}
+	}
+	m_Commands.clear();
+}
+
+// Invalidate handles to the entity in the given handle slot and add the slot to the free list
+void CEntityManager::FreeHandleSlot( TUInt32 slot )
+{
+	SHandleSlot& handleSlot = m_HandleSlots[slot];
+	handleSlot.generation = (handleSlot.generation + 1) & HandleGenerationMask;
+	handleSlot.entityIndex = NoFreeSlot;
+
+	// Add to the end of the free list
+	if (m_LastFreeSlot != NoFreeSlot)
+	{
+		m_HandleSlots[m_LastFreeSlot].entityIndex = slot;
+	}
+	else
+	{
+		m_FirstFreeSlot = slot;
+	}
+	m_LastFreeSlot = slot;
+}
+
+// Remove free slots from the end of the handle table, e.g. after destroying entities created
+// in bulk
+void CEntityManager::TrimHandleSlots()
+{
+	GEN_ASSERT( !m_IsUpdating, "Cannot trim the handle table during an update" );
+
+	// Free slots cannot be told apart by their entity index, so follow the free list
+	vector<bool> isFree( m_HandleSlots.size(), false );
+	for (TUInt32 slot = m_FirstFreeSlot; slot != NoFreeSlot; slot = m_HandleSlots[slot].entityIndex)
+	{
+		isFree[slot] = true;
+	}
+	TUInt32 numSlots = static_cast<TUInt32>(m_HandleSlots.size());
+	while (numSlots > 0 && isFree[numSlots - 1])
+	{
+		--numSlots;
+	}
+	if (numSlots == m_HandleSlots.size())
+	{
+		return;
+	}
+
+	// Slots added later start from a generation no lower than any removed slot, so handles to
+	// entities in the removed slots still do not match. Then relink the remaining free slots in
+	// the same order
+	TUInt32 firstFreeSlot = m_FirstFreeSlot;
+	for (TUInt32 slot = numSlots; slot < m_HandleSlots.size(); ++slot)
+	{
+		m_NewSlotGeneration = Max( m_NewSlotGeneration, m_HandleSlots[slot].generation );
+	}
+	m_FirstFreeSlot = m_LastFreeSlot = NoFreeSlot;
+	for (TUInt32 slot = firstFreeSlot; slot != NoFreeSlot; )
+	{
+		TUInt32 nextSlot = m_HandleSlots[slot].entityIndex;
+		if (slot < numSlots)
+		{
+			if (m_LastFreeSlot != NoFreeSlot)
+			{
+				m_HandleSlots[m_LastFreeSlot].entityIndex = slot;
+			}
+			else
+			{
+				m_FirstFreeSlot = slot;
+			}
+			m_LastFreeSlot = slot;
+			m_HandleSlots[slot].entityIndex = NoFreeSlot;
+		}
+		slot = nextSlot;
+	}
+	m_HandleSlots.resize( numSlots );
+}
+
+// Reserve space in the entity lists for the given number of new entities of a template type
+void CEntityManager::ReserveEntities( TUInt32 numEntities, TAtom templateType )
+{
+	// Grow at least geometrically so repeated small reservations do not reallocate each time
+	size_t required = m_Entities.size() + numEntities;
+	if (required > m_Entities.capacity())
+	{
+		required = max( required, m_Entities.capacity() * 2 );
+		m_Entities.reserve( required );
+		m_EntitySlots.reserve( required );
+	}
+
+	required = m_HandleSlots.size() + numEntities;
+	if (required > m_HandleSlots.capacity())
+	{
+		m_HandleSlots.reserve( max( required, m_HandleSlots.capacity() * 2 ) );
+	}
+
+	TEntityIndices& typeIndices = m_EntityTypes[templateType];
+	required = typeIndices.size() + numEntities;
+	if (required > typeIndices.capacity())
+	{
+		typeIndices.reserve( max( required, typeIndices.capacity() * 2 ) );
+	}
+
+	if (m_IsUpdating)
+	{
+		m_Commands.reserve( m_Commands.size() + numEntities );
+	}
+}
+
+// Remove the entity at the given index from the index list for its template type
+void CEntityManager::RemoveFromTypeIndices( TUInt32 entityIndex )
+{
+	// Order within a type list does not matter, so move the last index in the list into the
+	// removed position and update the slot of the entity that index refers to
+	const SEntitySlot& entitySlot = m_EntitySlots[entityIndex];
+	TEntityIndices& indices = *entitySlot.indices;
+	TUInt32 movedIndex = indices.back();
+	indices[entitySlot.position] = movedIndex;
+	m_EntitySlots[movedIndex].position = entitySlot.position;
+	indices.pop_back();
+}
+
+
+/////////////////////////////////////
+// Teams
+
+// Called by a tank from its update when it enters or leaves the Destruct state
+void CEntityManager::TankAliveChanged( CTankEntity* tank )
+{
+	if (m_IsParallelPhase)
+	{
+		// Only the tank's own result is written, so this is safe from any thread. The change is
+		// applied after the phase (see ParallelUpdate). The active list does not change during the
+		// phase so the tank's active position is its position in the update list
+		TUInt32 entityIndex = m_HandleSlots[tank->GetHandle().Index()].entityIndex;
+		m_UpdateResults[m_EntitySlots[entityIndex].activePosition] |= UpdateResult_AliveChanged;
+	}
+	else
+	{
+		UpdateTeamAlive( tank );
+	}
+}
+
+// Add / remove a function to call whenever a team changes
+void CEntityManager::AddTeamListener( TTeamListener listener, void* data /*= 0*/ )
+{
+	m_TeamListeners.push_back( make_pair( listener, data ) );
+}
+
+void CEntityManager::RemoveTeamListener( TTeamListener listener, void* data /*= 0*/ )
+{
+	for (TUInt32 teamListener = 0; teamListener < m_TeamListeners.size(); ++teamListener)
+	{
+		if (m_TeamListeners[teamListener].first == listener && m_TeamListeners[teamListener].second == data)
+		{
+			m_TeamListeners.erase( m_TeamListeners.begin() + teamListener );
+			return;
+		}
+	}
+}
+
+// Add the tank at the given entity index to the roster of its team
+void CEntityManager::AddToTeam( TUInt32 entityIndex )
+{
+	SEntitySlot& entitySlot = m_EntitySlots[entityIndex];
+	GEN_ASSERT( entitySlot.team >= 0, "Invalid team number" );
+	if (!IsTeam( entitySlot.team ))
+	{
+		STeam newTeam;
+		newTeam.numAlive = 0;
+		m_Teams.resize( entitySlot.team + 1, newTeam );
+	}
+
+	STeam& team = m_Teams[entitySlot.team];
+	STeamMember member;
+	member.tank = static_cast<CTankEntity*>(m_Entities[entityIndex]);
+	member.isAlive = member.tank->GetAliveStatus();
+	entitySlot.teamPosition = static_cast<TUInt32>(team.members.size());
+	team.members.push_back( member );
+	if (member.isAlive)
+	{
+		++team.numAlive;
+	}
+
+	NotifyTeamListeners( TeamEvent_TankAdded, entitySlot.team, member.tank );
+}
+
+// Remove the tank at the given entity index from the roster of its team
+void CEntityManager::RemoveFromTeam( TUInt32 entityIndex )
+{
+	const SEntitySlot& entitySlot = m_EntitySlots[entityIndex];
+	STeam& team = m_Teams[entitySlot.team];
+	STeamMember member = team.members[entitySlot.teamPosition];
+	if (member.isAlive)
+	{
+		--team.numAlive;
+	}
+
+	// Roster order does not matter, so move the last tank into the removed position
+	STeamMember& movedMember = team.members.back();
+	TUInt32 movedIndex = m_HandleSlots[movedMember.tank->GetHandle().Index()].entityIndex;
+	m_EntitySlots[movedIndex].teamPosition = entitySlot.teamPosition;
+	team.members[entitySlot.teamPosition] = movedMember;
+	team.members.pop_back();
+
+	NotifyTeamListeners( TeamEvent_TankDestroyed, entitySlot.team, member.tank );
+}
+
+// Update the alive count of a tank's team if the tank has entered or left the Destruct state
+void CEntityManager::UpdateTeamAlive( CTankEntity* tank )
+{
+	// Ignore tanks that have not been added yet, they are counted when added
+	TUInt32 entityIndex = m_HandleSlots[tank->GetHandle().Index()].entityIndex;
+	if (entityIndex >= m_Entities.size() || m_Entities[entityIndex] != tank)
+	{
+		return;
+	}
+
+	const SEntitySlot& entitySlot = m_EntitySlots[entityIndex];
+	STeamMember& member = m_Teams[entitySlot.team].members[entitySlot.teamPosition];
+	bool isAlive = tank->GetAliveStatus();
+	if (isAlive == member.isAlive)
+	{
+		return;
+	}
+	member.isAlive = isAlive;
+	if (isAlive)
+	{
+		++m_Teams[entitySlot.team].numAlive;
+	}
+	else
+	{
+		--m_Teams[entitySlot.team].numAlive;
+	}
+
+	NotifyTeamListeners( isAlive ? TeamEvent_TankRevived : TeamEvent_TankDied, entitySlot.team, tank );
+}
+
+// Call the team listeners with an event for the given team and tank
+void CEntityManager::NotifyTeamListeners( ETeamEvent type, TInt32 team, CTankEntity* tank )
+{
+	if (m_TeamListeners.empty())
+	{
+		return;
 	}
 
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
+	STeamEvent event;
+	event.type = type;
+	event.team = team;
+	event.tank = tank;
+	event.numTanks = static_cast<TUInt32>(m_Teams[team].members.size());
+	event.numAlive = m_Teams[team].numAlive;
+	for (TUInt32 listener = 0; listener < m_TeamListeners.size(); ++listener)
+	{
+		m_TeamListeners[listener].first( event, m_TeamListeners[listener].second );
+	}
 }
 
 
@@ -321,19 +812,254 @@ void CEntityManager::DestroyAllEntities()
 // Call all entity update functions. Pass the time since last update
 void CEntityManager::UpdateAllEntities( float updateTime )
 {
-	TUInt32 entity = 0;
-	while (entity < m_Entities.size())
+	// A frame is an update and a render, start counting world matrix recalculations again
+	m_Transforms.NewFrame();
+
+	// Wake entities whose sleep ends during this update and list the active entities to update
+	m_UpdateTime = updateTime;
+	StartEntityUpdates();
+
+	// Structural changes are deferred during the update so the entity list is stable - entities
+	// are updated in list order and each entity is updated exactly once
+	m_IsUpdating = true;
+	ParallelUpdate( updateTime );
+	m_IsUpdating = false;
+	m_ElapsedTime += updateTime;
+
+	CommitCommands();
+
+	// Entities removed from the edge of the grid leave its extents wider than needed
+	m_SpatialGrid.ShrinkExtents();
+
+	// Messages sent from now on are counted in the next frame
+	Messenger.EndFrame();
+}
+
+// Set the number of threads used by UpdateAllEntities (including the calling thread), minimum 1
+void CEntityManager::SetUpdateThreads( TUInt32 numThreads )
+{
+	GEN_ASSERT( !m_IsUpdating, "Cannot change update threads during an update" );
+	m_WorkerPool.SetNumThreads( numThreads );
+	m_UpdateThreads = m_WorkerPool.GetNumThreads();
+}
+
+// Wake a sleeping entity so it is updated from the next update. Returns false if the entity
+// does not exist or is not asleep
+bool CEntityManager::WakeEntity( SEntityHandle handle )
+{
+	if (!GetEntity( handle ))
+	{
+		return false;
+	}
+	TUInt32 entityIndex = m_HandleSlots[handle.Index()].entityIndex;
+	if (m_EntitySlots[entityIndex].activity != Activity_Sleeping)
 	{
-		// Update entity, if it returns false, then destroy it
-		if (!m_Entities[entity]->Update( updateTime ))
+		return false;
+	}
+	WakeIndex( entityIndex );
+	return true;
+}
+
+// Add the entity at the given index to the active list
+void CEntityManager::Activate( TUInt32 entityIndex )
+{
+	SEntitySlot& entitySlot = m_EntitySlots[entityIndex];
+	entitySlot.activity = Activity_Active;
+	entitySlot.activePosition = static_cast<TUInt32>(m_ActiveEntities.size());
+	m_ActiveEntities.push_back( entityIndex );
+}
+
+// Remove the entity at the given index from the active list
+void CEntityManager::Deactivate( TUInt32 entityIndex )
+{
+	// Order within the active list does not matter, so move the last index into the removed
+	// position and update the slot of the entity that index refers to
+	SEntitySlot& entitySlot = m_EntitySlots[entityIndex];
+	TUInt32 movedIndex = m_ActiveEntities.back();
+	m_ActiveEntities[entitySlot.activePosition] = movedIndex;
+	m_EntitySlots[movedIndex].activePosition = entitySlot.activePosition;
+	m_ActiveEntities.pop_back();
+	entitySlot.activity = Activity_Static;
+}
+
+// Put the active entity at the given index to sleep as requested by its update
+void CEntityManager::PutToSleep( TUInt32 entityIndex )
+{
+	CEntity* entity = m_Entities[entityIndex];
+	SEntitySlot& entitySlot = m_EntitySlots[entityIndex];
+	Deactivate( entityIndex );
+	entitySlot.activity = Activity_Sleeping;
+	++entitySlot.sleepCount;
+	++m_NumSleeping;
+
+	// The entity falls asleep at the end of the current update. Entities sleeping until a
+	// message arrives have no timer
+	entitySlot.sleepStart = m_ElapsedTime + m_UpdateTime;
+	if (entity->m_SleepTime > 0.0f)
+	{
+		SWakeTimer timer;
+		timer.wakeTime = entitySlot.sleepStart + entity->m_SleepTime;
+		timer.handle = entity->GetHandle();
+		timer.sleepCount = entitySlot.sleepCount;
+		m_WakeTimers.push( timer );
+	}
+	entity->m_SleepTime = 0.0f;
+
+	// Sleeping entities are left out of the snapshot taken at the start of each update, so take
+	// their snapshot now. It stays valid while they sleep
+	entity->TakeSnapshot();
+
+	// Listen for messages to wake entities, set here rather than in the constructor as the
+	// messenger may be constructed after the manager
+	if (!m_IsDeliveryListener)
+	{
+		Messenger.SetDeliveryListener( MessageDelivered, this );
+		m_IsDeliveryListener = true;
+	}
+}
+
+// Wake the sleeping entity at the given index
+void CEntityManager::WakeIndex( TUInt32 entityIndex )
+{
+	Activate( entityIndex );
+	--m_NumSleeping;
+
+	// The time asleep is set when the entity is next updated
+	m_WokenEntities.push_back( m_Entities[entityIndex]->GetHandle() );
+}
+
+// Messenger delivery listener, wakes the entity a message is sent to
+void CEntityManager::MessageDelivered( TEntityUID to, void* data )
+{
+	static_cast<CEntityManager*>(data)->WakeEntity( SEntityHandle( to ) );
+}
+
+// Wake the entities whose timers expire by the end of the current update, and prepare the
+// list of entities to update
+void CEntityManager::StartEntityUpdates()
+{
+	TFloat32 updateEndTime = m_ElapsedTime + m_UpdateTime;
+	while (!m_WakeTimers.empty() && m_WakeTimers.top().wakeTime <= updateEndTime)
+	{
+		// Ignore timers for destroyed entities and for entities that have been woken and slept
+		// again since the timer was set
+		SWakeTimer timer = m_WakeTimers.top();
+		m_WakeTimers.pop();
+		if (GetEntity( timer.handle ))
 		{
-			DestroyEntity(m_Entities[entity]->GetUID());
+			TUInt32 entityIndex = m_HandleSlots[timer.handle.Index()].entityIndex;
+			if (m_EntitySlots[entityIndex].activity == Activity_Sleeping &&
+			    m_EntitySlots[entityIndex].sleepCount == timer.sleepCount)
+			{
+				WakeIndex( entityIndex );
+			}
 		}
-		else
+	}
+
+	// Deliver the delayed messages due by the end of this update, waking their recipients
+	Messenger.AdvanceTime( m_UpdateTime );
+
+	// Tell woken entities how long they slept, up to the start of this update
+	for (TUInt32 woken = 0; woken < m_WokenEntities.size(); ++woken)
+	{
+		CEntity* entity = GetEntity( m_WokenEntities[woken] );
+		if (entity)
 		{
-			++entity;
+			TUInt32 entityIndex = m_HandleSlots[m_WokenEntities[woken].Index()].entityIndex;
+			entity->m_TimeAsleep = m_ElapsedTime - m_EntitySlots[entityIndex].sleepStart;
 		}
 	}
+	m_WokenEntities.clear();
+
+	// Update a copy of the active list as entities may sleep or be woken during the update
+	m_UpdateList.assign( m_ActiveEntities.begin(), m_ActiveEntities.end() );
+}
+
+// Apply the result of an entity's update: destroy it if its update returned false, otherwise
+// refile it in the spatial grid and put it to sleep if it asked to
+void CEntityManager::FinishEntityUpdate( TUInt32 entityIndex, bool keepEntity )
+{
+	CEntity* entity = m_Entities[entityIndex];
+	entity->m_TimeAsleep = 0.0f;
+	if (!keepEntity)
+	{
+		entity->m_SleepTime = 0.0f;
+		DestroyEntity( entity->GetHandle() );
+		return;
+	}
+
+	// Refile the entity in the spatial grid in case it moved
+	m_SpatialGrid.Move( entity );
+	if (entity->m_SleepTime != 0.0f)
+	{
+		PutToSleep( entityIndex );
+	}
+}
+
+// Update entities in two phases, the first split across the worker threads (or run on the calling
+// thread with a single update thread)
+void CEntityManager::ParallelUpdate( float updateTime )
+{
+	TUInt32 numEntities = static_cast<TUInt32>(m_UpdateList.size());
+
+	// Snapshot the matrices and any other state entities read from each other. Only the entities
+	// being updated are copied - static entities keep the snapshot taken when they were inserted
+	// and sleeping entities the one taken when they were put to sleep
+	m_WorkerPool.ParallelFor( numEntities, SnapshotJob, this );
+
+	// Phase 1: update entities in parallel. Each entity only writes its own state, reads other
+	// entities' snapshots, and sends messages that are held until all updates are complete
+	m_UpdateResults.assign( numEntities, 0 );
+	m_IsParallelPhase = true;
+	CEntity::SetSnapshotReads( true );
+	Messenger.BeginDeferredDelivery( m_WorkerPool.GetNumThreads() );
+
+	m_WorkerPool.ParallelFor( numEntities, UpdateJob, this );
+
+	CEntity::SetSnapshotReads( false );
+	m_IsParallelPhase = false;
+
+	// Phase 2: apply the results in update list order so they do not depend on the thread count
+	for (TUInt32 entity = 0; entity < numEntities; ++entity)
+	{
+		TUInt32 entityIndex = m_UpdateList[entity];
+		if (m_UpdateResults[entity] & UpdateResult_AliveChanged)
+		{
+			UpdateTeamAlive( static_cast<CTankEntity*>(m_Entities[entityIndex]) );
+		}
+		FinishEntityUpdate( entityIndex, (m_UpdateResults[entity] & UpdateResult_Keep) != 0 );
+	}
+
+	// Deliver the messages once entities have been put to sleep, so a message sent during the
+	// update wakes its recipient even if the recipient asked to sleep in the same update
+	Messenger.EndDeferredDelivery();
+}
+
+// Worker pool job taking the snapshot of a range of entities in the update list
+void CEntityManager::SnapshotJob( void* data, TUInt32 first, TUInt32 last, TUInt32 threadIndex )
+{
+	CEntityManager* manager = static_cast<CEntityManager*>(data);
+	for (TUInt32 entity = first; entity < last; ++entity)
+	{
+		manager->m_Entities[manager->m_UpdateList[entity]]->TakeSnapshot();
+	}
+}
+
+// Worker pool job updating a range of entities in the update list
+void CEntityManager::UpdateJob( void* data, TUInt32 first, TUInt32 last, TUInt32 threadIndex )
+{
+	CEntityManager* manager = static_cast<CEntityManager*>(data);
+	for (TUInt32 entity = first; entity < last; ++entity)
+	{
+		CEntity* updateEntity = manager->m_Entities[manager->m_UpdateList[entity]];
+		CEntity::SetUpdatingEntity( updateEntity );
+		Messenger.SetDeferredSender( threadIndex, entity );
+		if (updateEntity->Update( manager->m_UpdateTime ))
+		{
+			manager->m_UpdateResults[entity] |= UpdateResult_Keep;
+		}
+	}
+	CEntity::SetUpdatingEntity( 0 );
 }
 
 // Render all entities
@@ -348,6 +1074,121 @@ void CEntityManager::RenderAllEntities()
 }
 
 
+/////////////////////////////////////
+// Pooled memory
+
+// Get occupancy statistics for each entity class pool, along with the pool names
+void CEntityManager::GetEntityPoolStats( vector<string>& names, vector<SPoolStats>& stats )
+{
+	CEntityPoolBase* pools[] = { &m_EntityPool, &m_TankPool, &m_ShellPool, &m_AmmoCratePool,
+	                             &m_HealthCratePool, &m_MinePool };
+	for (TUInt32 pool = 0; pool < sizeof(pools) / sizeof(pools[0]); ++pool)
+	{
+		names.push_back( pools[pool]->GetName() );
+		stats.push_back( pools[pool]->GetStats() );
+	}
+}
+
+
+/////////////////////////////////////
+// Diagnostics
+
+// Output entity pool and transform store occupancy
+void CEntityManager::OutputPoolStats()
+{
+	vector<string> names;
+	vector<SPoolStats> stats;
+	GetEntityPoolStats( names, stats );
+	cout << "Entity pools (in use / peak / capacity, chunks):" << endl;
+	for (TUInt32 pool = 0; pool < stats.size(); ++pool)
+	{
+		cout << "  " << names[pool] << ": " << stats[pool].inUse << " / " << stats[pool].peakInUse
+		     << " / " << stats[pool].capacity << ", " << stats[pool].numChunks << endl;
+	}
+
+	cout << "Transform store (nodes in use / allocated / capacity): "
+	     << m_Transforms.NumNodes() - m_Transforms.NumFreeNodes() << " / " << m_Transforms.NumNodes()
+	     << " / " << m_Transforms.Capacity() << endl;
+}
+
+// Output timings comparing type-filtered enumeration using the per-type index lists against
+// a scan of all entities comparing type strings. Temporarily adds the given number of
+// entities using a scenery template
+void CEntityManager::OutputEnumerationBenchmark( const string& sceneryTemplate,
+                                                 TUInt32 numScenery /*= 10000*/ )
+{
+	const TUInt32 NumPasses = 100;
+	const string searchTypes[] = { "Tank", "Ammo", "Scenery" };
+
+	// Add scenery on a grid so the spatial grid is not overloaded with a single cell
+	SEntityUIDRange sceneryUIDs = CreateEntities( sceneryTemplate, numScenery, SceneryGridGenerator );
+
+	cout << "Enumeration benchmark: " << m_Entities.size() << " entities, " << NumPasses
+	     << " passes per type" << endl;
+
+	CTimer timer;
+	for (TUInt32 type = 0; type < sizeof(searchTypes) / sizeof(searchTypes[0]); ++type)
+	{
+		// Type index lists
+		TUInt32 listCount = 0;
+		timer.Reset();
+		for (TUInt32 pass = 0; pass < NumPasses; ++pass)
+		{
+			for (CEntity* entity : Entities( "", "", searchTypes[type] ))
+			{
+				++listCount;
+			}
+		}
+		TFloat32 listTime = timer.GetLapTime();
+
+		// Previous enumeration method (e.g. the old GetTankEntities): scan all entities with a
+		// type string compare, returning a new vector of the matching entities
+		TUInt32 scanCount = 0;
+		for (TUInt32 pass = 0; pass < NumPasses; ++pass)
+		{
+			vector<CEntity*> entities = ScanEntitiesOfType( searchTypes[type] );
+			scanCount += static_cast<TUInt32>(entities.size());
+		}
+		TFloat32 scanTime = timer.GetLapTime();
+
+		cout << "  " << searchTypes[type] << ": " << listCount / NumPasses << " found, type list "
+		     << listTime * 1000.0f << "ms, scan returning a vector " << scanTime * 1000.0f << "ms"
+		     << (listCount == scanCount ? "" : " (MISMATCH)") << endl;
+	}
+
+	// Destroy the scenery in reverse order so its matrices are removed from the end of the
+	// transform store, then remove its handle slots and shrink the grid back to the scene
+	for (TUInt32 scenery = sceneryUIDs.count; scenery-- > 0; )
+	{
+		DestroyEntity( sceneryUIDs[scenery] );
+	}
+	TrimHandleSlots();
+	m_SpatialGrid.ShrinkExtents();
+}
+
+// Return a new vector of the entities with the given template type, found by scanning all
+// entities. The enumeration method used before the type index lists, for the benchmark
+vector<CEntity*> CEntityManager::ScanEntitiesOfType( const string& templateType )
+{
+	vector<CEntity*> entities;
+	for (TUInt32 entity = 0; entity < m_Entities.size(); ++entity)
+	{
+		if (m_Entities[entity]->Template()->GetType() == templateType)
+		{
+			entities.push_back( m_Entities[entity] );
+		}
+	}
+	return entities;
+}
+
+// Entity generator placing entities on a grid with 100 entities per row, 10 units apart
+void CEntityManager::SceneryGridGenerator( void* data, TUInt32 index, SEntityPlacement& placement )
+{
+	placement.position = CVector3( static_cast<TFloat32>(index % 100) * 10.0f, 0.0f,
+	                               static_cast<TFloat32>(index / 100) * 10.0f );
+}
+
+
 } // namespace gen
 
 
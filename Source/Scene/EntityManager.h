@@ -8,21 +8,146 @@
 #pragma once
 
 #include <map>
+#include <queue>
 using namespace std;
 
 #include "Defines.h"
-#include "CHashTable.h"
 #include "Entity.h"
 #include "TankEntity.h"
 #include "ShellEntity.h"
 #include "AmmoCrateEntity.h"
 #include "HealthCrateEntity.h"
 #include "MineEntity.h"
+#include "SpatialGrid.h"
+#include "EntityRange.h"
+#include "EntityPool.h"
+#include "TransformStore.h"
+#include "CWorkerPool.h"
 #include "Camera.h"
 
 namespace gen
 {
 
+/////////////////////////////////////
+//	Type and name atoms
+
+// Atoms for the template types and entity names that entities query every frame, so the queries
+// compare atoms rather than looking up strings. Interned when the program starts
+extern const TAtom TankTypeAtom;
+extern const TAtom ProjectileTypeAtom;
+extern const TAtom AmmoTypeAtom;
+extern const TAtom HealthTypeAtom;
+extern const TAtom BuildingNameAtom;
+
+
+/////////////////////////////////////
+//	Entity range filters (see EntityRange.h)
+
+// Visit tanks by team (as for spatial queries), optionally excluding one tank or tanks that are
+// being destroyed
+struct STankFilter
+{
+	STankFilter( ETeamFilter teamFilter = Team_Any, TInt32 filterTeam = NoTeam,
+	             CEntity* excludeEntity = 0, bool onlyAlive = false )
+		: teamMatch( teamFilter ), team( filterTeam ), exclude( excludeEntity ), aliveOnly( onlyAlive ) {}
+
+	bool operator()( CEntity* entity ) const
+	{
+		CTankEntity* tank = static_cast<CTankEntity*>(entity);
+		return entity != exclude &&
+		       (teamMatch != Team_Same || tank->GetTeam() == team) &&
+		       (teamMatch != Team_Other || tank->GetTeam() != team) &&
+		       (!aliveOnly || tank->GetAliveStatus());
+	}
+
+	ETeamFilter teamMatch;
+	TInt32      team;
+	CEntity*    exclude;
+	bool        aliveOnly;
+};
+
+// Visit crates that are alive and not targeted by a tank
+struct SAvailableCrateFilter
+{
+	bool operator()( CEntity* entity ) const
+	{
+		CCRateEntity* crate = static_cast<CCRateEntity*>(entity);
+		return crate->IsAlive() && !crate->GetTargeted();
+	}
+};
+
+// Visit shells fired by the given tank
+struct SShellOwnerFilter
+{
+	SShellOwnerFilter( CTankEntity* shellOwner ) : owner( shellOwner ) {}
+
+	bool operator()( CEntity* entity ) const
+	{
+		return static_cast<CShellEntity*>(entity)->GetOwner() == owner;
+	}
+
+	CTankEntity* owner;
+};
+
+typedef CEntityRange<CEntity, SEntityNameFilter>          TEntityRange;
+typedef CEntityRange<CTankEntity, STankFilter>            TTankRange;
+typedef CEntityRange<CCRateEntity, SAvailableCrateFilter> TCrateRange;
+
+
+/////////////////////////////////////
+//	Team events
+
+// Changes to a team reported to team listeners (see CEntityManager::AddTeamListener)
+enum ETeamEvent
+{
+	TeamEvent_TankAdded,     // Tank added to the manager
+	TeamEvent_TankDestroyed, // Tank removed from the manager, whether alive or not
+	TeamEvent_TankDied,      // Tank entered the Destruct state
+	TeamEvent_TankRevived,   // Tank left the Destruct state
+};
+
+struct STeamEvent
+{
+	ETeamEvent   type;
+	TInt32       team;
+	CTankEntity* tank;     // Still valid during a TankDestroyed event
+	TUInt32      numTanks; // Team counts after the change
+	TUInt32      numAlive;
+};
+
+// Function called with each team event, data is the pointer given when the listener was added
+typedef void (*TTeamListener)( const STeamEvent& event, void* data );
+
+
+/////////////////////////////////////
+//	Bulk creation
+
+// Placement of one entity created by CEntityManager::CreateEntities
+struct SEntityPlacement
+{
+	CVector3 position;
+	CVector3 rotation;
+	CVector3 scale;
+};
+
+// Function called to place each entity created by CreateEntities, in index order. The
+// placement is set to the origin, no rotation and unit scale before the call. Data is the
+// pointer passed to CreateEntities
+typedef void (*TEntityGenerator)( void* data, TUInt32 index, SEntityPlacement& placement );
+
+// Contiguous range of UIDs returned by CreateEntities
+struct SEntityUIDRange
+{
+	TEntityUID first;
+	TUInt32    count;
+
+	TEntityUID operator[]( TUInt32 index ) const
+	{
+		return first + index;
+	}
+};
+
+
 // The entity manager is responsible for creation, update, rendering and deletion of
 // entities. It also manages UIDs for entities using a hash table
 class CEntityManager
@@ -134,10 +259,32 @@ public:
 	);
 
 
-	// Destroy the given entity - returns true if the entity existed and was destroyed
-	bool DestroyEntity( TEntityUID UID );
+	// Create the given number of base class entities with a template name, all with the same
+	// name. Each entity is placed by calling the generator function, or at the origin if none
+	// is given. Storage for all the entities is reserved up front, so creating many entities
+	// takes time in proportion to the count and few heap allocations. The entities take new
+	// handle slots rather than reusing freed ones, so their UIDs form a contiguous range, which
+	// is returned
+	SEntityUIDRange CreateEntities
+	(
+		const string&    templateName,
+		TUInt32          count,
+		TEntityGenerator generator = 0,
+		void*            data = 0,
+		const string&    name = ""
+	);
+
+
+	// Destroy the given entity - returns true if the entity existed and was destroyed. During
+	// UpdateAllEntities the destruction is deferred until the end of the update. An entity still
+	// being constructed (e.g. destroyed from its own constructor) is not destroyed
+	bool DestroyEntity( SEntityHandle handle );
+	bool DestroyEntity( TEntityUID UID )
+	{
+		return DestroyEntity( SEntityHandle( UID ) );
+	}
 
-	// Destroy all entities held by the manager
+	// Destroy all entities held by the manager, and any messages waiting for them
 	void DestroyAllEntities();
 
 
@@ -170,208 +317,96 @@ public:
 		return m_Entities[index];
 	}
 
-	// Return the entity with the given UID
-	CEntity* GetEntity( TEntityUID UID )
+	// Return the entity with the given handle, or 0 if the entity has been destroyed. Entities
+	// are not returned while being constructed, or if created during an update until the
+	// update's commands are committed (their entity index is NoFreeSlot / PendingEntity)
+	CEntity* GetEntity( SEntityHandle handle )
 	{
-		// Find the entity UID in the entity hash map
-		TUInt32 entityIndex;
-		if (!m_EntityUIDMap->LookUpKey( UID, &entityIndex ))
+		TUInt32 slot = handle.Index();
+		if (slot >= m_HandleSlots.size() || m_HandleSlots[slot].generation != handle.Generation() ||
+		    m_HandleSlots[slot].entityIndex >= m_Entities.size())
 		{
 			return 0;
 		}
-		return m_Entities[entityIndex];
+		return m_Entities[m_HandleSlots[slot].entityIndex];
 	}
 
-	// Return the entity with the given name & optionally the given template name & type
-	CEntity* GetEntity( const string& name, const string& templateName = "",
-	                    const string& templateType = "" )
+	// Return the entity with the given UID (UIDs are packed handles)
+	CEntity* GetEntity( TEntityUID UID )
 	{
-		TEntityIter entity = m_Entities.begin();
-		while (entity != m_Entities.end())
-		{
-			if ((*entity)->GetName() == name && 
-				(templateName.length() == 0 || (*entity)->Template()->GetName() == templateName) &&
-				(templateType.length() == 0 || (*entity)->Template()->GetType() == templateType))
-			{
-				return (*entity);
-			}
-			++entity;
-		}
-		return 0;
+		return GetEntity( SEntityHandle( UID ) );
 	}
 
-	CShellEntity* GetTanksShell(CTankEntity* owner)
+	// Return the first entity with the given name & optionally the given template name & type
+	CEntity* GetEntity( const string& name, const string& templateName = "",
+	                    const string& templateType = "" )
 	{
-		BeginEnumEntities("", "", "Projectile");
-		CEntity* entity = EnumEntity();
-		while (entity != 0)
-		{
-			CShellEntity* shellEntity = static_cast<CShellEntity*>(entity);
-			if (shellEntity != 0)
-			{
-				if (shellEntity->GetOwner() == owner)
-				{
-					return shellEntity;
-				}
-			}
-			entity = EnumEntity();
-		}
-		EndEnumEntities();
+		return GetEntity( FindAtom( name ), FindAtom( templateName ), FindAtom( templateType ) );
 	}
 
-	const vector<CTankEntity*> GetTankEntities() 
+	// As above, but taking atoms (NoAtom to match any template name or type). The template name
+	// is required to distinguish this from the UID version of GetEntity
+	CEntity* GetEntity( TAtom name, TAtom templateName, TAtom templateType = NoAtom )
 	{
-		vector<CTankEntity*> tankEntities;
-		BeginEnumEntities("", "", "Tank");
-		CEntity* entity = EnumEntity();
-
-		while (entity != 0)
-		{
-			CTankEntity* tankEntity = static_cast<CTankEntity*>(entity);
-			if (tankEntity != 0)
-			{
-				tankEntities.push_back(tankEntity);
-			}
-			entity = EnumEntity();
-		}
-		EndEnumEntities();
-		return tankEntities;
+		return Entities( name, templateName, templateType ).First();
 	}
 
-	const vector<CTankEntity*> GetTankEntities(CEntity* entityToExclude)
+	CShellEntity* GetTanksShell(CTankEntity* owner)
 	{
-		vector<CTankEntity*> tankEntities;
-		BeginEnumEntities("", "", "Tank");
-		CEntity* entity = EnumEntity();
-
-		while (entity != 0)
-		{
-			CTankEntity* tankEntity = static_cast<CTankEntity*>(entity);
-			if (tankEntity != 0 && entity != entityToExclude)
-			{
-				tankEntities.push_back(tankEntity);
-			}
-			entity = EnumEntity();
-		}
-		EndEnumEntities();
-		return tankEntities;
+		return TypeRange<CShellEntity>(ProjectileTypeAtom, SShellOwnerFilter(owner)).First();
 	}
 
-	const vector<CTankEntity*> GetEnemyTeamTanks(TInt32 team)
+	const TInt32 GetAmmoCrateCount()
 	{
-		vector<CTankEntity*> entities;
-		CEntity* entity;
-		BeginEnumEntities("", "", "Tank"); 
-		while ((entity = EnumEntity()) != 0)
-		{
-			CTankEntity* tankEntity = reinterpret_cast<CTankEntity*>(entity);
-			if (tankEntity->GetTeam() != team && tankEntity->GetAliveStatus())
-			{
-				entities.push_back(tankEntity);
-			}
-		}
-		EndEnumEntities();
-		return entities;
+		return NumEntitiesOfType( AmmoTypeAtom );
 	}
 
-	const vector<CTankEntity*> GetTeamTanks(TInt32 team)
+	const TInt32 GetHealthCrateCount()
 	{
-		vector<CTankEntity*> entities;
-		CEntity* entity;
-		BeginEnumEntities("", "", "Tank"); 
-		while ((entity = EnumEntity()) != 0)
-		{
-			CTankEntity* tankEntity = reinterpret_cast<CTankEntity*>(entity);
-			if (tankEntity->GetTeam() == team && tankEntity->GetAliveStatus())
-			{
-				entities.push_back(tankEntity);
-			}
-		}
-		EndEnumEntities();
-		return entities;
+		return NumEntitiesOfType( HealthTypeAtom );
 	}
 
-	const vector<CTankEntity*> GetTeamTanks(TInt32 team, CEntity* entityToExclude)
+	// Return the number of entities whose template has the given type
+	TUInt32 NumEntitiesOfType( const string& templateType )
 	{
-		vector<CTankEntity*> entities;
-		CEntity* entity;
-		BeginEnumEntities("", "", "Tank");
-		while ((entity = EnumEntity()) != 0)
-		{
-			CTankEntity* tankEntity = reinterpret_cast<CTankEntity*>(entity);
-			if (tankEntity->GetTeam() == team && tankEntity != entityToExclude)
-			{
-				entities.push_back(tankEntity);
-			}
-		}
-		EndEnumEntities();
-		return entities;
+		return NumEntitiesOfType( FindAtom( templateType ) );
 	}
-
-	const vector<CCRateEntity*> GetCrateEntities(string crateType)
+	TUInt32 NumEntitiesOfType( TAtom templateType )
 	{
-		vector<CCRateEntity*> crates;
-		CEntity* entity;
-		BeginEnumEntities("", "", crateType);
-		while ((entity = EnumEntity()) != 0)
-		{
-			CCRateEntity* crateEntity = reinterpret_cast<CCRateEntity*>(entity);
-			if (crateEntity->IsAlive() && !crateEntity->GetTargeted())
-			{
-				crates.push_back(crateEntity);
-			}
-		}
-		EndEnumEntities();
-		return crates;
+		return static_cast<TUInt32>(EntitiesOfType( templateType ).size());
 	}
 
-	const TInt32 GetAmmoCrateCount()
+
+
+	/////////////////////////////////////
+	// Teams
+	// Each team has a roster of its tanks and a count of those that are alive (not in the
+	// Destruct state). These are kept up to date as tanks are added, destroyed and change state,
+	// so team queries do not visit any other entities
+
+	// Return the number of team numbers in use, teams are numbered from 0 (some may be empty)
+	TUInt32 NumTeams()
 	{
-		TInt32 ammoCrateCount = 0;
-		CEntity* entity;
-		BeginEnumEntities("", "", "Ammo"); // Enumerate entities with ship templates
-		while ((entity = EnumEntity()) != 0)
-		{
-			ammoCrateCount++;
-		}
-		EndEnumEntities();
-		return ammoCrateCount;
+		return static_cast<TUInt32>(m_Teams.size());
 	}
 
-	const TInt32 GetHealthCrateCount()
+	// Return the number of tanks on the given team, alive or not
+	TUInt32 GetTeamSize( TInt32 team )
 	{
-		TInt32 healthCrateCount = 0;
-		CEntity* entity;
-		BeginEnumEntities("", "", "Health"); // Enumerate entities with ship templates
-		while ((entity = EnumEntity()) != 0)
-		{
-			healthCrateCount++;
-		}
-		EndEnumEntities();
-		return healthCrateCount;
+		return IsTeam( team ) ? static_cast<TUInt32>(m_Teams[team].members.size()) : 0;
 	}
 
-	vector<CEntity*> GetEntities(const string& name, const string& templateName = "",
-		const string& templateType = "")
+	// Return the tank at the given position in a team's roster (0 to GetTeamSize - 1). Roster
+	// order changes as tanks are destroyed
+	CTankEntity* GetTeamTank( TInt32 team, TUInt32 index )
 	{
-		TEntityIter entity = m_Entities.begin();
-		vector<CEntity*> entities;
-		while (entity != m_Entities.end())
-		{
-			if ((*entity)->GetName() == name &&
-				(templateName.length() == 0 || (*entity)->Template()->GetName() == templateName) &&
-				(templateType.length() == 0 || (*entity)->Template()->GetType() == templateType))
-			{
-				entities.push_back((*entity));
-			}
-			++entity;
-		}
-		return entities;
+		return m_Teams[team].members[index].tank;
 	}
 
+	// Return the number of tanks on the given team that are alive
 	const TInt32 GetTeamCount(TInt32 team)
 	{
-		return GetTeamTanks(team).size();
+		return IsTeam( team ) ? m_Teams[team].numAlive : 0;
 	}
 	const bool GetWinningTeam(string &winningTeam)
 	{
@@ -382,52 +417,86 @@ public:
 		return haveWinner;
 	}
 
+	// Called by a tank from its update when it enters or leaves the Destruct state. During the
+	// parallel update phase the change is recorded and applied in entity order after the phase
+	void TankAliveChanged( CTankEntity* tank );
+
+	// Add / remove a function to call whenever a team changes. Listeners are only called on the
+	// thread calling UpdateAllEntities and never during the parallel update phase. They are not
+	// called by DestroyAllEntities
+	void AddTeamListener( TTeamListener listener, void* data = 0 );
+	void RemoveTeamListener( TTeamListener listener, void* data = 0 );
 
-	// Begin an enumeration of entities matching given name, template name and type
-	// An empty string indicates to match anything in this field (would be nice to support
-	// wildcards, e.g. match name of "Ship*")
-	void BeginEnumEntities( const string& name, const string& templateName,
-	                        const string& templateType = "" )
-	{
-		m_IsEnumerating = true;
-		m_EnumEntity = m_Entities.begin();
-		m_EnumName = name;
-		m_EnumTemplateName = templateName;
-		m_EnumTemplateType = templateType;
-	}
 
-	// Finish enumerating entities (see above)
-	void EndEnumEntities()
+	/////////////////////////////////////
+	// Entity ranges
+	// Ranges over the entities matching a query, for use with a range-based for loop. Nothing is
+	// allocated and each range holds its own position, so ranges can be nested and used by
+	// entities during a parallel update. Ranges must not be used after entities are added or
+	// removed. See EntityRange.h
+
+	// Entities matching the given name, template name and type. An empty string matches anything
+	// in that field. If a template type is given then only the entities of that type are visited
+	// (see m_EntityTypes)
+	TEntityRange Entities( const string& name, const string& templateName = "",
+	                       const string& templateType = "" )
 	{
-		m_IsEnumerating = false;
+		return Entities( FindAtom( name ), FindAtom( templateName ), FindAtom( templateType ) );
 	}
 
-	// Return next entity matching parameters passed to a previous call to BeginEnumEntities
-	// Returns 0 if BeginEnumEntities not called or no more matching entities
-	CEntity* EnumEntity()
+	// As above, but taking atoms. NoAtom matches anything in that field
+	TEntityRange Entities( TAtom name, TAtom templateName = NoAtom, TAtom templateType = NoAtom )
 	{
-		if (!m_IsEnumerating)
+		if (templateType != NoAtom)
 		{
-			return 0;
+			return TypeRange<CEntity>( templateType, SEntityNameFilter( name, templateName ) );
 		}
+		return TEntityRange( &m_Entities, 0, SEntityNameFilter( name, templateName ) );
+	}
 
-		while (m_EnumEntity != m_Entities.end())
-		{
-			if ((m_EnumName.length() == 0 || (*m_EnumEntity)->GetName() == m_EnumName) && 
-				(m_EnumTemplateName.length() == 0 ||
-				 (*m_EnumEntity)->Template()->GetName() == m_EnumTemplateName) &&
-				(m_EnumTemplateType.length() == 0 ||
-				 (*m_EnumEntity)->Template()->GetType() == m_EnumTemplateType))
-			{
-				CEntity* foundEntity = *m_EnumEntity;
-				++m_EnumEntity;
-				return foundEntity;
-			}
-			++m_EnumEntity;
-		}
-		
-		m_IsEnumerating = false;
-		return 0;
+	// Tanks passing the given filter (all tanks by default)
+	TTankRange Tanks( const STankFilter& filter = STankFilter() )
+	{
+		return TypeRange<CTankEntity>( TankTypeAtom, filter );
+	}
+
+	// Crates of the given type ("Ammo" or "Health") that are alive and not targeted by a tank
+	TCrateRange AvailableCrates( const string& crateType )
+	{
+		return AvailableCrates( FindAtom( crateType ) );
+	}
+	TCrateRange AvailableCrates( TAtom crateType )
+	{
+		return TypeRange<CCRateEntity>( crateType, SAvailableCrateFilter() );
+	}
+
+
+	/////////////////////////////////////
+	// Spatial queries
+	// Use the spatial grid to find entities near a point. Only the grid cells overlapping the
+	// query are visited, so these are far cheaper than enumerating all entities. See
+	// SpatialGrid.h for details. Results are written to the given vector (cleared first)
+
+	// Entities closer than the given distance to a point, or at the distance too if inclusive,
+	// matching the filter
+	void QueryRadius( const CVector3& centre, TFloat32 radius, const SEntityFilter& filter,
+	                  vector<CEntity*>& results, bool isInclusive = false )
+	{
+		m_SpatialGrid.QueryRadius( centre, radius, filter, results, isInclusive );
+	}
+
+	// Entities with positions inside the given axis-aligned box, matching the filter
+	void QueryBox( const CVector3& minBounds, const CVector3& maxBounds, const SEntityFilter& filter,
+	               vector<CEntity*>& results )
+	{
+		m_SpatialGrid.QueryBox( minBounds, maxBounds, filter, results );
+	}
+
+	// The k nearest entities to a point matching the filter, nearest first
+	void QueryNearest( const CVector3& centre, TUInt32 k, const SEntityFilter& filter,
+	                   vector<CEntity*>& results, TFloat32 maxDistance = D3D10_FLOAT32_MAX )
+	{
+		m_SpatialGrid.QueryNearest( centre, k, filter, results, maxDistance );
 	}
 
 
@@ -435,12 +504,96 @@ public:
 	// Update / Rendering
 
 	// Call all entity update functions - not the ideal method, OK for this example
-	// Pass the time since last update
+	// Pass the time since last update. Entities created or destroyed during the update (including
+	// entities whose update returns false) are held in a command buffer and added or removed
+	// together at the end, so the entity list does not change while it is being updated
+	//
+	// Only active entities are updated. Base class entities (scenery) are static and never
+	// updated. Other entities can ask to sleep from their update (see CEntity::Sleep), and are
+	// not updated again until their sleep time has passed or they are sent a message, so the
+	// cost of the update depends only on the number of active entities
+	//
+	// The update has two phases. First every entity is updated, split across the update threads
+	// (see SetUpdateThreads). Entities only change their own state, read other entities from a
+	// snapshot taken at the start of the update and send messages for any other change, which
+	// are held until the phase ends. Then the results are applied in entity order: messages
+	// delivered, entities destroyed and the spatial grid updated. Entities fetch the messages sent
+	// in the previous update. Entities cannot be created or destroyed directly during the first
+	// phase (return false from Update to be destroyed)
 	void UpdateAllEntities( float updateTime );
 
+	// Set the number of threads used by UpdateAllEntities (including the calling thread), minimum
+	// 1. The result of the update is identical for any number of threads, a single thread runs
+	// the same two phases on the calling thread
+	void SetUpdateThreads( TUInt32 numThreads );
+
+	TUInt32 GetUpdateThreads()
+	{
+		return m_UpdateThreads;
+	}
+
+	// Wake a sleeping entity so it is updated from the next update. Returns false if the entity
+	// does not exist or is not asleep. Entities are also woken when they are sent a message
+	bool WakeEntity( SEntityHandle handle );
+
+	// Number of entities updated each frame, asleep, and static (never updated)
+	TUInt32 NumActiveEntities()
+	{
+		return static_cast<TUInt32>(m_ActiveEntities.size());
+	}
+
+	TUInt32 NumSleepingEntities()
+	{
+		return m_NumSleeping;
+	}
+
+	TUInt32 NumStaticEntities()
+	{
+		return static_cast<TUInt32>(m_Entities.size() - m_ActiveEntities.size()) - m_NumSleeping;
+	}
+
+	// Return true while UpdateAllEntities is running, i.e. structural changes are deferred
+	bool IsUpdating()
+	{
+		return m_IsUpdating;
+	}
+
+	// Apply all deferred entity creation and destruction in the order it was requested. Called
+	// at the end of UpdateAllEntities
+	void CommitCommands();
+
 	// Render all entities - not the ideal method, OK for this example
 	void RenderAllEntities();
 
+
+	/////////////////////////////////////
+	// Pooled memory
+
+	// Storage for the node matrices of all entities, used by entity constructors
+	CTransformStore& Transforms()
+	{
+		return m_Transforms;
+	}
+
+	// Get occupancy statistics for each entity class pool, along with the pool names
+	void GetEntityPoolStats( vector<string>& names, vector<SPoolStats>& stats );
+
+
+	/////////////////////////////////////
+	// Diagnostics
+
+	// Output entity pool and transform store occupancy
+	void OutputPoolStats();
+
+	// Output timings comparing type-filtered enumeration using the per-type index lists against
+	// the previous method, a scan of all entities comparing type strings that returns a vector.
+	// Temporarily adds the given number of entities using a scenery template, the handle table,
+	// transform store and spatial grid are returned to their previous size afterwards
+	void OutputEnumerationBenchmark( const string& sceneryTemplate, TUInt32 numScenery = 10000 );
+
+	// Entity generator placing entities on a grid, used by the benchmarks
+	static void SceneryGridGenerator( void* data, TUInt32 index, SEntityPlacement& placement );
+
 		
 /////////////////////////////////////
 //	Private interface
@@ -457,6 +610,166 @@ private:
 	typedef vector<CEntity*> TEntities;
 	typedef TEntities::iterator TEntityIter;
 
+	// Packed lists of entity indexes for each template type
+	typedef vector<TUInt32> TEntityIndices;
+	typedef map<TAtom, TEntityIndices> TEntityTypes;
+	typedef TEntityTypes::iterator TEntityTypeIter;
+
+	// How an entity takes part in UpdateAllEntities
+	enum EEntityActivity
+	{
+		Activity_Static,   // Never updated (base class entities, whose update does nothing)
+		Activity_Sleeping, // Not updated until woken by a timer or a message
+		Activity_Active,   // Updated every frame
+	};
+
+	// Per-entity data kept by the manager: where the entity's index is stored in the type lists
+	// above, the pool the entity was allocated from, the entity's place in its team roster and
+	// whether it is updated
+	struct SEntitySlot
+	{
+		TEntityIndices*  indices;  // Index list for the entity's template type
+		TUInt32          position; // Position of the entity's index in that list
+		CEntityPoolBase* pool;
+		TInt32           team;     // NoTeam if not on a team
+		TUInt32          teamPosition; // Position in the team's roster
+		EEntityActivity  activity;
+		TUInt32          activePosition; // Position in the active list if active
+		TUInt32          sleepCount;     // Number of times the entity has slept, to spot old wake timers
+		TFloat32         sleepStart;     // Time the entity last fell asleep (see m_ElapsedTime)
+	};
+
+	// Timer to wake a sleeping entity, ordered by wake time
+	struct SWakeTimer
+	{
+		TFloat32      wakeTime;
+		SEntityHandle handle;
+		TUInt32       sleepCount; // Timer is ignored if the entity has slept again since
+
+		bool operator>( const SWakeTimer& timer ) const
+		{
+			return wakeTime > timer.wakeTime;
+		}
+	};
+
+	// Team roster entry, recording whether the tank was counted as alive
+	struct STeamMember
+	{
+		CTankEntity* tank;
+		bool         isAlive;
+	};
+	struct STeam
+	{
+		vector<STeamMember> members;
+		TUInt32             numAlive;
+	};
+
+	// Flags in the result of each entity's update in the parallel update
+	enum EUpdateResult
+	{
+		UpdateResult_Keep = 1,         // Entity's update returned true
+		UpdateResult_AliveChanged = 2, // Tank entered or left the Destruct state
+	};
+
+
+	/////////////////////////////////////
+	// Support functions
+
+	// Take a handle slot for a new entity and return the UID (packed handle) to construct it with
+	TEntityUID NewUID();
+
+	// Add a newly constructed entity to the manager, or queue it to be added if updating. Pass
+	// the pool the entity was constructed in, the team for entities that are on one and whether
+	// the entity is static (never updated). Returns the UID of the entity
+	TEntityUID AddEntity( CEntity* newEntity, CEntityPoolBase* pool, TInt32 team = NoTeam,
+	                      bool isStatic = false );
+
+	// Add a newly constructed entity to the entity list, handle table, type lists, active list
+	// and spatial grid (see AddEntity)
+	void InsertEntity( CEntity* newEntity, CEntityPoolBase* pool, TInt32 team, bool isStatic );
+
+	// Remove and destroy the entity with the given handle, which must exist
+	void RemoveEntity( SEntityHandle handle );
+
+	// Destroy all entities as DestroyAllEntities, but leave the messenger alone (see destructor)
+	void FreeAllEntities();
+
+	// Invalidate handles to the entity in the given handle slot and add the slot to the free list
+	void FreeHandleSlot( TUInt32 slot );
+
+	// Remove free slots from the end of the handle table, e.g. after destroying entities created
+	// in bulk. Visits every free slot
+	void TrimHandleSlots();
+
+	// Return a new vector of the entities with the given template type, found by scanning all
+	// entities (the enumeration method replaced by the type index lists, for the benchmark)
+	vector<CEntity*> ScanEntitiesOfType( const string& templateType );
+
+	// Reserve space in the entity lists for the given number of new entities of a template type
+	void ReserveEntities( TUInt32 numEntities, TAtom templateType );
+
+	// Remove the entity at the given index from the index list for its template type
+	void RemoveFromTypeIndices( TUInt32 entityIndex );
+
+	// Return true if the given team number has a roster
+	bool IsTeam( TInt32 team )
+	{
+		return team >= 0 && team < static_cast<TInt32>(m_Teams.size());
+	}
+
+	// Add the tank at the given entity index to the roster of its team / remove it
+	void AddToTeam( TUInt32 entityIndex );
+	void RemoveFromTeam( TUInt32 entityIndex );
+
+	// Update the alive count of a tank's team if the tank has entered or left the Destruct state
+	void UpdateTeamAlive( CTankEntity* tank );
+
+	// Call the team listeners with an event for the given team and tank
+	void NotifyTeamListeners( ETeamEvent type, TInt32 team, CTankEntity* tank );
+
+	// Return the index list for the given template type, empty for an unknown type
+	const TEntityIndices& EntitiesOfType( TAtom templateType )
+	{
+		TEntityTypeIter typeIndices = m_EntityTypes.find( templateType );
+		return (typeIndices != m_EntityTypes.end()) ? typeIndices->second : m_NoEntities;
+	}
+
+	// Range over the entities of a template type passing a filter
+	template <class TEntityClass, class TFilter>
+	CEntityRange<TEntityClass, TFilter> TypeRange( TAtom templateType, const TFilter& filter )
+	{
+		return CEntityRange<TEntityClass, TFilter>( &m_Entities, &EntitiesOfType( templateType ), filter );
+	}
+
+	// Add the entity at the given index to the active list / remove it
+	void Activate( TUInt32 entityIndex );
+	void Deactivate( TUInt32 entityIndex );
+
+	// Put the active entity at the given index to sleep as requested by its update
+	void PutToSleep( TUInt32 entityIndex );
+
+	// Wake the sleeping entity at the given index
+	void WakeIndex( TUInt32 entityIndex );
+
+	// Messenger delivery listener, wakes the entity a message is sent to. Data is the manager
+	static void MessageDelivered( TEntityUID to, void* data );
+
+	// Wake the entities whose timers expire by the end of the current update, and prepare the
+	// list of entities to update
+	void StartEntityUpdates();
+
+	// Apply the result of an entity's update: destroy it if its update returned false, otherwise
+	// refile it in the spatial grid and put it to sleep if it asked to
+	void FinishEntityUpdate( TUInt32 entityIndex, bool keepEntity );
+
+	// Update entities in two phases (see UpdateAllEntities)
+	void ParallelUpdate( float updateTime );
+
+	// Worker pool jobs for the parallel update, data is the entity manager. Take the snapshot
+	// of each entity and update each entity
+	static void SnapshotJob( void* data, TUInt32 first, TUInt32 last, TUInt32 threadIndex );
+	static void UpdateJob( void* data, TUInt32 first, TUInt32 last, TUInt32 threadIndex );
+
 
 	/////////////////////////////////////
 	// Template Data
@@ -473,21 +786,86 @@ private:
 	// fill its space
 	TEntities m_Entities;
 
-	// A mapping from UIDs to indexes into the above array
-	CHashTable<TEntityUID, TUInt32>* m_EntityUIDMap;
-
-	// Entity IDs are provided using a single increasing integer
-	TEntityUID m_NextUID;
-
+	// Handle table mapping handle slots to indexes into the above array. A slot's generation
+	// is increased when its entity is destroyed so old handles to it no longer match. Free
+	// slots are linked in a FIFO list through entityIndex so that slots (and so generations)
+	// are reused as slowly as possible
+	struct SHandleSlot
+	{
+		TUInt32 entityIndex; // Index of entity in m_Entities, or next free slot if unused
+		TUInt32 generation;
+	};
+	vector<SHandleSlot> m_HandleSlots;
+	TUInt32             m_FirstFreeSlot; // NoFreeSlot if none
+	TUInt32             m_LastFreeSlot;
+	TUInt32             m_NewSlotGeneration; // For slots added to the table, above that of any removed slot
+	static const TUInt32 NoFreeSlot = 0xffffffff;
+	static const TUInt32 PendingEntity = 0xfffffffe; // Entity index for entities created but not yet added
+
+	// Deferred structural changes requested during UpdateAllEntities
+	enum EEntityCommand
+	{
+		EntityCommand_Create,
+		EntityCommand_Destroy,
+	};
+	struct SEntityCommand
+	{
+		EEntityCommand   type;
+		SEntityHandle    handle;
+		CEntity*         entity; // Create only: constructed entity, its pool, team and whether static
+		CEntityPoolBase* pool;
+		TInt32           team;
+		bool             isStatic;
+	};
+	vector<SEntityCommand> m_Commands;
+	bool                   m_IsUpdating;
+
+	// Indexes of the active entities, and the copy of this list being updated. Sleeping entities
+	// have a wake timer unless waiting for a message. Woken entities are recorded until their
+	// next update to find how long they slept
+	TEntityIndices        m_ActiveEntities;
+	TEntityIndices        m_UpdateList;
+	TUInt32               m_NumSleeping;
+	priority_queue<SWakeTimer, vector<SWakeTimer>, greater<SWakeTimer> > m_WakeTimers;
+	vector<SEntityHandle> m_WokenEntities;
+	TFloat32              m_ElapsedTime; // Total update time before the current update
+	bool                  m_IsDeliveryListener; // Set as the messenger's delivery listener
+
+	// Threads for the parallel update and data passed to its jobs
+	CWorkerPool    m_WorkerPool;
+	TUInt32        m_UpdateThreads;
+	bool           m_IsParallelPhase;
+	TFloat32       m_UpdateTime;
+	vector<TUInt8> m_UpdateResults;  // EUpdateResult flags for each entity in the update list
+
+	// For each template type, a packed list of the indexes of the entities of that type, so
+	// type-filtered enumeration need not visit (and string compare) every entity. Along with
+	// a slot for each entity (parallel to m_Entities) to locate it in these lists
+	TEntityTypes            m_EntityTypes;
+	vector<SEntitySlot>     m_EntitySlots;
+	TEntityIndices          m_NoEntities; // Always empty, used for unknown types
+
+	// Tank rosters and alive counts indexed by team number, and the team listeners
+	vector<STeam>                       m_Teams;
+	vector<pair<TTeamListener, void*> > m_TeamListeners;
+
+	// Spatial hash grid of entity positions for proximity queries
+	CSpatialGrid m_SpatialGrid;
+
+	// Free-list pools for each entity class. Entities are constructed in pool memory so
+	// creation and destruction reuse memory rather than using the heap once the pools have
+	// grown to the peak number of entities
+	CEntityPool<CEntity>            m_EntityPool;
+	CEntityPool<CTankEntity>        m_TankPool;
+	CEntityPool<CShellEntity>       m_ShellPool;
+	CEntityPool<CAmmoCrateEntity>   m_AmmoCratePool;
+	CEntityPool<CHealthCrateEntity> m_HealthCratePool;
+	CEntityPool<CMineEntity>        m_MinePool;
+
+	// Relative and world node matrices for all entities in contiguous arrays
+	CTransformStore m_Transforms;
 
-	/////////////////////////////////////
-	// Data for Entity Enumeration
 
-	bool        m_IsEnumerating;
-	TEntityIter m_EnumEntity;
-	string      m_EnumName;
-	string      m_EnumTemplateName;
-	string      m_EnumTemplateType;
 };
 
 
@@ -0,0 +1,82 @@
+/*******************************************
+	EntityPool.h
+
+	Pools for entity objects
+********************************************/
+
+#pragma once
+
+#include <new>
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CFreeListPool.h"
+#include "Entity.h"
+
+namespace gen
+{
+
+// Interface for pools of entities, allowing the entity manager to destroy an entity without
+// knowing its class
+class CEntityPoolBase
+{
+public:
+	CEntityPoolBase( const string& name ) : m_Name( name ) {}
+	virtual ~CEntityPoolBase() {}
+
+	// Destroy an entity that was constructed in this pool and return its memory
+	virtual void Destroy( CEntity* entity ) = 0;
+
+	virtual const SPoolStats& GetStats() = 0;
+
+	const string& GetName()
+	{
+		return m_Name;
+	}
+
+private:
+	string m_Name;
+};
+
+
+// Pool of entities of a single class. Memory is allocated with Allocate, the entity is then
+// constructed in it with placement new, and Destroy calls the destructor and frees the memory
+template <class TEntityClass>
+class CEntityPool : public CEntityPoolBase
+{
+public:
+	CEntityPool( const string& name, TUInt32 entitiesPerChunk = 64 )
+		: CEntityPoolBase( name ), m_Pool( sizeof(TEntityClass), entitiesPerChunk ) {}
+
+	// Return uninitialised memory for one entity
+	void* Allocate()
+	{
+		return m_Pool.Allocate();
+	}
+
+	// Ensure the given number of entities can be allocated without using the heap
+	void Reserve( TUInt32 numEntities )
+	{
+		m_Pool.Reserve( numEntities );
+	}
+
+	// Destroy an entity that was constructed in this pool and return its memory
+	void Destroy( CEntity* entity )
+	{
+		TEntityClass* poolEntity = static_cast<TEntityClass*>(entity);
+		poolEntity->~TEntityClass();
+		m_Pool.Free( poolEntity );
+	}
+
+	const SPoolStats& GetStats()
+	{
+		return m_Pool.GetStats();
+	}
+
+private:
+	CFreeListPool m_Pool;
+};
+
+
+} // namespace gen
@@ -0,0 +1,196 @@
+/*******************************************
+	EntityRange.h
+
+	Allocation-free ranges over the entities
+	matching a filter
+********************************************/
+
+#pragma once
+
+#include <vector>
+#include <iterator>
+using namespace std;
+
+#include "Defines.h"
+#include "Atom.h"
+#include "Entity.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+//	Filters
+// A filter is a function object taking an entity pointer and returning true if the entity
+// should be visited
+
+// Visit every entity
+struct SAnyEntity
+{
+	bool operator()( CEntity* entity ) const
+	{
+		return true;
+	}
+};
+
+// Visit entities with the given name and template name (NoAtom to match anything)
+struct SEntityNameFilter
+{
+	SEntityNameFilter( TAtom entityName = NoAtom, TAtom entityTemplateName = NoAtom )
+		: name( entityName ), templateName( entityTemplateName ) {}
+
+	bool operator()( CEntity* entity ) const
+	{
+		return (name == NoAtom || entity->GetNameAtom() == name) &&
+		       (templateName == NoAtom || entity->Template()->GetNameAtom() == templateName);
+	}
+
+	TAtom name;
+	TAtom templateName;
+};
+
+
+/////////////////////////////////////
+//	Entity range
+
+// A range over the entities in the entity manager's list, or over those at the indexes in one of
+// its type index lists, that pass a filter. Use with a range-based for loop:
+//     for (CTankEntity* tank : EntityManager.Tanks( filter )) ...
+// A range holds its own position so ranges can be nested and used on several threads at once.
+// Nothing is allocated - the filter is applied as the range is stepped through. The range must
+// not be used after entities are added to or removed from the manager
+template <class TEntityClass = CEntity, class TFilter = SAnyEntity>
+class CEntityRange
+{
+/////////////////////////////////////
+//	Constructors
+public:
+	// Range over the given entity list, or the entities at the given indexes into the list if an
+	// index list is passed
+	CEntityRange( const vector<CEntity*>* entities, const vector<TUInt32>* indices = 0,
+	              const TFilter& filter = TFilter() )
+		: m_Entities( entities ), m_Indices( indices ), m_Filter( filter ) {}
+
+
+/////////////////////////////////////
+//	Iterator
+public:
+	class CIterator
+	{
+	public:
+		typedef input_iterator_tag iterator_category;
+		typedef TEntityClass*      value_type;
+		typedef ptrdiff_t          difference_type;
+		typedef TEntityClass**     pointer;
+		typedef TEntityClass*      reference;
+
+		CIterator( const CEntityRange* range, TUInt32 position ) : m_Range( range ), m_Position( position )
+		{
+			SkipFiltered();
+		}
+
+		TEntityClass* operator*() const
+		{
+			return static_cast<TEntityClass*>(m_Range->EntityAt( m_Position ));
+		}
+
+		CIterator& operator++()
+		{
+			++m_Position;
+			SkipFiltered();
+			return *this;
+		}
+
+		CIterator operator++( int )
+		{
+			CIterator previous = *this;
+			++(*this);
+			return previous;
+		}
+
+		bool operator==( const CIterator& other ) const
+		{
+			return m_Position == other.m_Position;
+		}
+
+		bool operator!=( const CIterator& other ) const
+		{
+			return m_Position != other.m_Position;
+		}
+
+	private:
+		// Move forward to the next entity passing the filter, or to the end
+		void SkipFiltered()
+		{
+			TUInt32 count = m_Range->Count();
+			while (m_Position < count && !m_Range->m_Filter( m_Range->EntityAt( m_Position ) ))
+			{
+				++m_Position;
+			}
+		}
+
+		const CEntityRange* m_Range;
+		TUInt32             m_Position;
+	};
+	typedef CIterator iterator;
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	iterator begin() const
+	{
+		return iterator( this, 0 );
+	}
+
+	iterator end() const
+	{
+		return iterator( this, Count() );
+	}
+
+	// Return the first entity in the range, or 0 if it is empty
+	TEntityClass* First() const
+	{
+		iterator first = begin();
+		return (first != end()) ? *first : 0;
+	}
+
+	bool IsEmpty() const
+	{
+		return begin() == end();
+	}
+
+	// Number of entities in the range (steps through the range)
+	TUInt32 Size() const
+	{
+		TUInt32 size = 0;
+		for (iterator entity = begin(); entity != end(); ++entity)
+		{
+			++size;
+		}
+		return size;
+	}
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	// Number of entities (or indexes) to step through before filtering
+	TUInt32 Count() const
+	{
+		return static_cast<TUInt32>(m_Indices ? m_Indices->size() : m_Entities->size());
+	}
+
+	CEntity* EntityAt( TUInt32 position ) const
+	{
+		return m_Indices ? (*m_Entities)[(*m_Indices)[position]] : (*m_Entities)[position];
+	}
+
+	const vector<CEntity*>* m_Entities;
+	const vector<TUInt32>*  m_Indices; // 0 to visit all entities
+	TFilter                 m_Filter;
+};
+
+
+} // namespace gen
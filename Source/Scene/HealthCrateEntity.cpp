@@ -47,27 +47,24 @@ namespace gen
 	{
 		Matrix().RotateLocalY(m_RotationSpeed * updateTime);
 
-		// Find out if any of the tanks is able to pick up this crate
-		EntityManager.BeginEnumEntities("", "", "Tank");
-		CEntity* entity = EntityManager.EnumEntity();
-		while (entity != 0)
+		// Find out if any of the nearby tanks is able to pick up this crate
+		vector<CEntity*> tanks;
+		EntityManager.QueryRadius(Position(), m_PickUpDistance, SEntityFilter(TankTypeAtom), tanks);
+		for each (CEntity* entity in tanks)
 		{
-			if (Distance(Position(), entity->Position()) < m_PickUpDistance)
-			{
-				CTankEntity* tankEntity = static_cast<CTankEntity*>(entity);
-				TInt32 currentTankHPs = tankEntity->GetHP();
-				TInt32 tankMaxHP = tankEntity->GetMaxHP();
-				TInt32 healthToGive = Min(tankMaxHP - currentTankHPs, m_AmountOfHealthToRestore);
+			CTankEntity* tankEntity = static_cast<CTankEntity*>(entity);
+			TInt32 currentTankHPs = tankEntity->GetHP();
+			TInt32 tankMaxHP = tankEntity->GetMaxHP();
+			TInt32 healthToGive = Min(tankMaxHP - currentTankHPs, m_AmountOfHealthToRestore);
 
-				tankEntity->RestoreHealth(healthToGive);
-				tankEntity->SetIsCollectingCrate(false);
-				tankEntity->IncrementCollectedHealthPacks();
-				UpdateState(Collected);
-			}
-
-			entity = EntityManager.EnumEntity();
+			// The tank applies the health itself (it may be updating at the same time)
+			SMessage msg;
+			msg.from = GetUID();
+			msg.type = Msg_RestoreHealth;
+			msg.amount = healthToGive;
+			Messenger.SendMessage(tankEntity->GetUID(), msg);
+			UpdateState(Collected);
 		}
-		EntityManager.EndEnumEntities();
 	}
 
 
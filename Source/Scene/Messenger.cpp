@@ -4,6 +4,8 @@
 	Entity messenger class implementation
 ********************************************/
 
+#include <algorithm>
+#include <fstream>
 #include "Messenger.h"
 
 namespace gen
@@ -15,6 +17,83 @@ namespace gen
 // Define a single messenger object for the program
 CMessenger Messenger;
 
+// Outbox and sender order for messages sent from each thread during deferred delivery
+static thread_local TUInt32 t_SenderThread = 0;
+static thread_local TUInt32 t_SenderOrder = 0;
+
+// Smallest size of the broadcast log that is trimmed
+static const TUInt32 MinTrimSize = 32;
+
+// Time in seconds of each tick of the delayed message timing wheel
+static const TFloat32 DelayTickTime = 0.001f;
+
+// Return true if sequence number a was given out before b, allowing for the numbers wrapping
+static bool SentBefore( TUInt32 a, TUInt32 b )
+{
+	return static_cast<TInt32>(a - b) < 0;
+}
+
+// Names of the message types
+static const char* MessageTypeNames[NumMessageTypes] =
+{
+	"Start", "Stop", "Evade", "Patrol", "Aim", "Hit", "FindAmmo", "FindHealth", "Help", "Destruct",
+	"RestoreShells", "RestoreHealth", "Targeted", "TargetRejected", "Fire"
+};
+
+// Return the name of a message type, e.g. "Hit"
+const char* MessageTypeName( EMessageType type )
+{
+	return (type < NumMessageTypes) ? MessageTypeNames[type] : "Unknown";
+}
+
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Constructor
+CMessenger::CMessenger() : m_BlockPool( sizeof(SMailboxBlock), 64 )
+{
+	m_FirstBroadcast = 0;
+	m_TrimSize = MinTrimSize;
+	m_NextSequence = 0;
+	m_UntickedTime = 0.0f;
+	m_IsDeferred = false;
+
+	// Sum hits and keep only the last of the messages whose handler just sets the state, as the
+	// last one decides the state whatever came before it. Start, Stop and Evade are only acted on
+	// in some states, and Help uses its sender, so dropping one could change the result - they
+	// are all fetched, as is Msg_Destruct
+	for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+	{
+		m_Coalescing[type] = Coalesce_None;
+	}
+	m_Coalescing[Msg_Hit] = Coalesce_SumHits;
+	const EMessageType stateMessages[] = { Msg_Patrol, Msg_Aim, Msg_FindAmmo, Msg_FindHealth };
+	for (TUInt32 state = 0; state < sizeof(stateMessages) / sizeof(stateMessages[0]); ++state)
+	{
+		m_Coalescing[stateMessages[state]] = Coalesce_Replace;
+	}
+
+	m_Frame = 0;
+	memset( &m_Stats, 0, sizeof(m_Stats) );
+#ifdef GEN_MESSENGER_STATS
+	m_FetchCounts.resize( 1 );
+	memset( m_SentCounts, 0, sizeof(m_SentCounts) );
+	m_BroadcastsSent = 0;
+	m_Coalesced = 0;
+	m_SystemSenderCount.uid = SystemUID;
+	m_SystemSenderCount.count = 0;
+#endif
+	m_DeliveryListener = 0;
+	m_DeliveryListenerData = 0;
+}
+
+// Destructor returns all mailbox blocks to the pool
+CMessenger::~CMessenger()
+{
+	DiscardAllMessages();
+}
+
 
 /////////////////////////////////////
 // Message sending/receiving
@@ -22,30 +101,755 @@ CMessenger Messenger;
 // Send the given message to a particular UID, does not check if the UID exists
 void CMessenger::SendMessage( TEntityUID to, const SMessage& msg )
 {
-	// Simply insert the UID/message pair into the message map. It will be inserted next
-	// to any other pairs with the same UID
-	m_Messages.insert( UIDMsgPair( to, msg ) );
+	if (m_IsDeferred)
+	{
+		// Hold the message in this thread's outbox until the end of deferred delivery
+		vector<SDeferredMessage>& outbox = m_Outboxes[t_SenderThread];
+		SDeferredMessage deferredMessage;
+		deferredMessage.senderOrder = t_SenderOrder;
+		deferredMessage.sequence = static_cast<TUInt32>(outbox.size());
+		deferredMessage.to = to;
+		deferredMessage.delayTicks = 0;
+		deferredMessage.isBroadcast = false;
+		deferredMessage.topic = Topic_All;
+		deferredMessage.topicValue = 0;
+		deferredMessage.msg = msg;
+		outbox.push_back( deferredMessage );
+		return;
+	}
+
+#ifdef GEN_MESSENGER_STATS
+	CountSent( msg );
+#endif
+	PostMessage( to, msg );
+	if (m_DeliveryListener)
+	{
+		m_DeliveryListener( to, m_DeliveryListenerData );
+	}
 }
 
 
-// Fetch the next available message for the given UID, returns the message through the given 
+// Fetch the next available message for the given UID, returns the message through the given
 // pointer. Returns false if there are no messages for this UID
 bool CMessenger::FetchMessage( TEntityUID to, SMessage* msg )
 {
-	// Find the first message for this UID in the message map
-	TMessageIter itMessage = m_Messages.find( to );
+	// During deferred delivery messages are only added at the end call, so the mailbox can be
+	// used by the one thread fetching this UID's messages
+	TUInt32 index = SEntityHandle( to ).Index();
+	if (index >= m_Mailboxes.size())
+	{
+		return false;
+	}
+	SMailbox& mailbox = m_Mailboxes[index];
+
+	// Skip messages sent to an earlier UID for the handle slot
+	const SMailboxMessage* frontMessage = FrontMessage( mailbox );
+	while (frontMessage && frontMessage->to != to)
+	{
+		PopMessage( mailbox );
+		frontMessage = FrontMessage( mailbox );
+	}
+
+	// Fetch any broadcast for this UID that was sent before the first message in the mailbox
+	if (mailbox.recipient == to)
+	{
+		const SBroadcast* broadcast =
+			NextBroadcast( mailbox, frontMessage ? frontMessage->sequence : m_NextSequence );
+		if (broadcast)
+		{
+			*msg = broadcast->msg;
+			++mailbox.nextBroadcast;
+#ifdef GEN_MESSENGER_STATS
+			CountFetched( *msg, broadcast->postFrame );
+#endif
+			return true;
+		}
+	}
+
+	if (frontMessage)
+	{
+		*msg = frontMessage->msg;
+#ifdef GEN_MESSENGER_STATS
+		CountFetched( *msg, frontMessage->postFrame );
+#endif
+		PopMessage( mailbox );
+		return true;
+	}
+	return false;
+}
+
+
+// Discard all messages waiting for the given UID
+void CMessenger::DiscardMessages( TEntityUID to )
+{
+	TUInt32 index = SEntityHandle( to ).Index();
+	if (index < m_Mailboxes.size())
+	{
+		EmptyMailbox( m_Mailboxes[index] );
+		m_Mailboxes[index].recipient = SystemUID;
+	}
+}
+
+// Discard all messages waiting for all UIDs, including all broadcasts
+void CMessenger::DiscardAllMessages()
+{
+	for (TUInt32 mailbox = 0; mailbox < m_Mailboxes.size(); ++mailbox)
+	{
+		EmptyMailbox( m_Mailboxes[mailbox] );
+		m_Mailboxes[mailbox].recipient = SystemUID;
+	}
+	m_FirstBroadcast += static_cast<TUInt32>(m_Broadcasts.size());
+	m_Broadcasts.clear();
+	m_TrimSize = MinTrimSize;
+	m_DelayedMessages.Clear();
+	m_UntickedTime = 0.0f;
+}
+
+
+/////////////////////////////////////
+// Broadcasts
+
+// Add the given UID as a recipient of broadcasts, with the team and template type used to match
+// topics. A recipient receives the broadcasts sent after it was added
+void CMessenger::AddRecipient( TEntityUID uid, TInt32 team, TAtom type )
+{
+	TUInt32 index = SEntityHandle( uid ).Index();
+	if (index >= MaxHandleSlots)
+	{
+		return;
+	}
+	SMailbox& mailbox = GetMailbox( index );
+	mailbox.recipient = uid;
+	mailbox.team = team;
+	mailbox.type = type;
+	mailbox.nextBroadcast = m_FirstBroadcast + static_cast<TUInt32>(m_Broadcasts.size());
+}
+
+// Send the given message to all recipients
+void CMessenger::BroadcastMessage( const SMessage& msg )
+{
+	SendBroadcast( Topic_All, 0, msg );
+}
+
+// Send the given message to the recipients on a team
+void CMessenger::SendTeamMessage( TInt32 team, const SMessage& msg )
+{
+	SendBroadcast( Topic_Team, static_cast<TUInt32>(team), msg );
+}
+
+// Send the given message to the recipients of a template type
+void CMessenger::SendTypeMessage( TAtom type, const SMessage& msg )
+{
+	SendBroadcast( Topic_Type, type, msg );
+}
+
+// Send a broadcast, or hold it in the outbox during deferred delivery
+void CMessenger::SendBroadcast( EMessageTopic topic, TUInt32 topicValue, const SMessage& msg )
+{
+	if (m_IsDeferred)
+	{
+		vector<SDeferredMessage>& outbox = m_Outboxes[t_SenderThread];
+		SDeferredMessage deferredMessage;
+		deferredMessage.senderOrder = t_SenderOrder;
+		deferredMessage.sequence = static_cast<TUInt32>(outbox.size());
+		deferredMessage.to = SystemUID;
+		deferredMessage.delayTicks = 0;
+		deferredMessage.isBroadcast = true;
+		deferredMessage.topic = topic;
+		deferredMessage.topicValue = topicValue;
+		deferredMessage.msg = msg;
+		outbox.push_back( deferredMessage );
+		return;
+	}
+
+#ifdef GEN_MESSENGER_STATS
+	CountSent( msg );
+	++m_BroadcastsSent;
+#endif
+	PostBroadcast( topic, topicValue, msg );
+}
+
+// Add a broadcast to the log
+void CMessenger::PostBroadcast( EMessageTopic topic, TUInt32 topicValue, const SMessage& msg )
+{
+	SBroadcast broadcast;
+	broadcast.topic = topic;
+	broadcast.topicValue = topicValue;
+	broadcast.sequence = m_NextSequence++;
+	broadcast.msg = msg;
+#ifdef GEN_MESSENGER_STATS
+	broadcast.postFrame = m_Frame;
+#endif
+	m_Broadcasts.push_back( broadcast );
+
+	if (m_Broadcasts.size() >= m_TrimSize)
+	{
+		TrimBroadcasts();
+	}
+}
+
+// Return the next broadcast for the given mailbox's recipient that was sent before the given
+// sequence number, or 0 if there is none. Moves the mailbox past unmatched broadcasts
+const CMessenger::SBroadcast* CMessenger::NextBroadcast( SMailbox& mailbox, TUInt32 beforeSequence )
+{
+	TUInt32 numBroadcasts = static_cast<TUInt32>(m_Broadcasts.size());
+	while (mailbox.nextBroadcast - m_FirstBroadcast < numBroadcasts)
+	{
+		const SBroadcast& broadcast = m_Broadcasts[mailbox.nextBroadcast - m_FirstBroadcast];
+		if (!SentBefore( broadcast.sequence, beforeSequence ))
+		{
+			return 0;
+		}
+		if (broadcast.topic == Topic_All ||
+		    (broadcast.topic == Topic_Team && broadcast.topicValue == static_cast<TUInt32>(mailbox.team)) ||
+		    (broadcast.topic == Topic_Type && broadcast.topicValue == mailbox.type))
+		{
+			return &broadcast;
+		}
+		++mailbox.nextBroadcast;
+	}
+	return 0;
+}
+
+// Remove the broadcasts from the start of the log that every recipient has passed
+void CMessenger::TrimBroadcasts()
+{
+	TUInt32 numPassed = static_cast<TUInt32>(m_Broadcasts.size());
+	for (TUInt32 mailbox = 0; mailbox < m_Mailboxes.size() && numPassed > 0; ++mailbox)
+	{
+		if (m_Mailboxes[mailbox].recipient != SystemUID)
+		{
+			numPassed = Min( numPassed, m_Mailboxes[mailbox].nextBroadcast - m_FirstBroadcast );
+		}
+	}
+	m_Broadcasts.erase( m_Broadcasts.begin(), m_Broadcasts.begin() + numPassed );
+	m_FirstBroadcast += numPassed;
+
+	// Recipients that are not fetching messages (e.g. sleeping entities) hold broadcasts in the
+	// log. Wait until the log has doubled before checking the mailboxes again, so the cost of
+	// trimming stays proportional to the number of broadcasts sent
+	m_TrimSize = Max( MinTrimSize, static_cast<TUInt32>(m_Broadcasts.size()) * 2 );
+}
+
+
+/////////////////////////////////////
+// Delayed messages
+
+// Send the given message to a particular UID after the given delay in seconds
+void CMessenger::SendMessageDelayed( TEntityUID to, const SMessage& msg, TFloat32 delay )
+{
+	// Round to the nearest tick, but always wait for at least one
+	TUInt32 delayTicks = 1;
+	if (delay > DelayTickTime)
+	{
+		delayTicks = static_cast<TUInt32>(delay / DelayTickTime + 0.5f);
+	}
+
+	if (m_IsDeferred)
+	{
+		// Add the message to the wheel at the end of deferred delivery, time does not advance in
+		// the meantime so the delay is unchanged
+		vector<SDeferredMessage>& outbox = m_Outboxes[t_SenderThread];
+		SDeferredMessage deferredMessage;
+		deferredMessage.senderOrder = t_SenderOrder;
+		deferredMessage.sequence = static_cast<TUInt32>(outbox.size());
+		deferredMessage.to = to;
+		deferredMessage.delayTicks = delayTicks;
+		deferredMessage.isBroadcast = false;
+		deferredMessage.topic = Topic_All;
+		deferredMessage.topicValue = 0;
+		deferredMessage.msg = msg;
+		outbox.push_back( deferredMessage );
+		return;
+	}
+
+#ifdef GEN_MESSENGER_STATS
+	CountSent( msg );
+#endif
+	SDelayedMessage delayedMessage;
+	delayedMessage.to = to;
+	delayedMessage.msg = msg;
+	m_DelayedMessages.AddTimer( delayTicks, delayedMessage );
+}
+
+// Advance the messenger's time, delivering the delayed messages that are due
+void CMessenger::AdvanceTime( TFloat32 updateTime )
+{
+	GEN_ASSERT( !m_IsDeferred, "Cannot advance messenger time during deferred delivery" );
+
+	m_UntickedTime += updateTime;
+	TUInt32 ticks = static_cast<TUInt32>(m_UntickedTime / DelayTickTime);
+	m_UntickedTime -= ticks * DelayTickTime;
+	m_DelayedMessages.Advance( ticks, DelayedMessageDue, this );
+}
+
+// Timing wheel expire function delivering a delayed message, data is the messenger
+void CMessenger::DelayedMessageDue( const SDelayedMessage& delayedMessage, void* data )
+{
+	CMessenger* messenger = static_cast<CMessenger*>(data);
+	messenger->PostMessage( delayedMessage.to, delayedMessage.msg );
+	if (messenger->m_DeliveryListener)
+	{
+		messenger->m_DeliveryListener( delayedMessage.to, messenger->m_DeliveryListenerData );
+	}
+}
+
+
+/////////////////////////////////////
+// Deferred delivery
+
+// Begin deferred delivery with the given number of sending threads
+void CMessenger::BeginDeferredDelivery( TUInt32 numThreads )
+{
+	if (m_Outboxes.size() < numThreads)
+	{
+		m_Outboxes.resize( numThreads );
+	}
+#ifdef GEN_MESSENGER_STATS
+	if (m_FetchCounts.size() < numThreads)
+	{
+		m_FetchCounts.resize( numThreads );
+	}
+#endif
+	m_ReleasedBlocks.assign( numThreads, 0 );
+	m_IsDeferred = true;
+}
+
+// Set the thread index and the sender order for messages sent from the calling thread
+void CMessenger::SetDeferredSender( TUInt32 threadIndex, TUInt32 senderOrder )
+{
+	t_SenderThread = threadIndex;
+	t_SenderOrder = senderOrder;
+}
+
+// End deferred delivery - return the blocks emptied by fetches to the pool and deliver the
+// messages sent
+void CMessenger::EndDeferredDelivery()
+{
+	m_IsDeferred = false;
+
+	for (TUInt32 thread = 0; thread < m_ReleasedBlocks.size(); ++thread)
+	{
+		while (m_ReleasedBlocks[thread])
+		{
+			SMailboxBlock* block = m_ReleasedBlocks[thread];
+			m_ReleasedBlocks[thread] = block->next;
+			m_BlockPool.Free( block );
+		}
+	}
+
+	// Merge the outboxes and deliver in sender order, keeping each sender's messages in the
+	// order they were sent
+	m_Delivery.clear();
+	for (TUInt32 outbox = 0; outbox < m_Outboxes.size(); ++outbox)
+	{
+		m_Delivery.insert( m_Delivery.end(), m_Outboxes[outbox].begin(), m_Outboxes[outbox].end() );
+		m_Outboxes[outbox].clear();
+	}
+	sort( m_Delivery.begin(), m_Delivery.end(),
+	      []( const SDeferredMessage& a, const SDeferredMessage& b )
+	      {
+	          return a.senderOrder < b.senderOrder || (a.senderOrder == b.senderOrder && a.sequence < b.sequence);
+	      } );
+	for (TUInt32 message = 0; message < m_Delivery.size(); ++message)
+	{
+#ifdef GEN_MESSENGER_STATS
+		CountSent( m_Delivery[message].msg );
+		m_BroadcastsSent += m_Delivery[message].isBroadcast ? 1 : 0;
+#endif
+		if (m_Delivery[message].isBroadcast)
+		{
+			PostBroadcast( m_Delivery[message].topic, m_Delivery[message].topicValue, m_Delivery[message].msg );
+			continue;
+		}
+		if (m_Delivery[message].delayTicks)
+		{
+			SDelayedMessage delayedMessage;
+			delayedMessage.to = m_Delivery[message].to;
+			delayedMessage.msg = m_Delivery[message].msg;
+			m_DelayedMessages.AddTimer( m_Delivery[message].delayTicks, delayedMessage );
+			continue;
+		}
+		PostMessage( m_Delivery[message].to, m_Delivery[message].msg );
+		if (m_DeliveryListener)
+		{
+			m_DeliveryListener( m_Delivery[message].to, m_DeliveryListenerData );
+		}
+	}
+	t_SenderThread = t_SenderOrder = 0;
+}
+
+
+/////////////////////////////////////
+// Statistics
+
+// Finish a frame: gather the statistics for the frame and start counting again
+void CMessenger::EndFrame()
+{
+#ifdef GEN_MESSENGER_STATS
+	memset( &m_Stats, 0, sizeof(m_Stats) );
+	m_Stats.frame = m_Frame;
+
+	// Message counts, adding together the fetches made by each thread
+	TUInt32 totalLatency = 0;
+	for (TUInt32 thread = 0; thread < m_FetchCounts.size(); ++thread)
+	{
+		SFetchCounts& counts = m_FetchCounts[thread];
+		for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+		{
+			m_Stats.fetched[type] += counts.fetched[type];
+			m_Stats.totalFetched += counts.fetched[type];
+		}
+		totalLatency += counts.totalLatency;
+		m_Stats.maxLatency = Max( m_Stats.maxLatency, counts.maxLatency );
+		memset( &counts, 0, sizeof(counts) );
+	}
+	for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+	{
+		m_Stats.sent[type] = m_SentCounts[type];
+		m_Stats.totalSent += m_SentCounts[type];
+		m_SentCounts[type] = 0;
+	}
+	m_Stats.meanLatency = m_Stats.totalFetched ? static_cast<TFloat32>(totalLatency) / m_Stats.totalFetched : 0.0f;
+	m_Stats.broadcastsSent = m_BroadcastsSent;
+	m_Stats.coalesced = m_Coalesced;
+	m_BroadcastsSent = m_Coalesced = 0;
+
+	// Mailbox depths
+	TUInt32 totalDepth = 0;
+	for (TUInt32 mailbox = 0; mailbox < m_Mailboxes.size(); ++mailbox)
+	{
+		TUInt32 depth = m_Mailboxes[mailbox].depth;
+		if (depth)
+		{
+			++m_Stats.mailboxesInUse;
+			totalDepth += depth;
+			m_Stats.maxMailboxDepth = Max( m_Stats.maxMailboxDepth, depth );
+		}
+	}
+	m_Stats.meanMailboxDepth = m_Stats.mailboxesInUse ? static_cast<TFloat32>(totalDepth) / m_Stats.mailboxesInUse : 0.0f;
+
+	// Keep the senders with the highest counts in order, most first. Senders with equal counts
+	// are listed in the order they first sent a message
+	m_Senders.push_back( MaxHandleSlots ); // Stands for SystemUID
+	for (TUInt32 sender = 0; sender < m_Senders.size(); ++sender)
+	{
+		SSenderCount& senderCount =
+			(m_Senders[sender] == MaxHandleSlots) ? m_SystemSenderCount : m_SenderCounts[m_Senders[sender]];
+		TUInt32 position = NumTopSenders;
+		while (position > 0 && senderCount.count > m_Stats.topSenderCounts[position - 1])
+		{
+			if (position < NumTopSenders)
+			{
+				m_Stats.topSenders[position] = m_Stats.topSenders[position - 1];
+				m_Stats.topSenderCounts[position] = m_Stats.topSenderCounts[position - 1];
+			}
+			--position;
+		}
+		if (position < NumTopSenders)
+		{
+			m_Stats.topSenders[position] = senderCount.uid;
+			m_Stats.topSenderCounts[position] = senderCount.count;
+		}
+		senderCount.count = 0;
+	}
+	m_Senders.clear();
+#endif
+
+	++m_Frame;
+}
 
-	// See if no messages for this UID
-	if (itMessage == m_Messages.end())
+// Write the statistics for the last frame finished to the given file in the given format
+bool CMessenger::WriteStats( const string& fileName, EStatsFormat format )
+{
+	ofstream file( fileName.c_str() );
+	if (!file)
 	{
 		return false;
 	}
 
-	// Return message, then delete it
-	*msg = itMessage->second;
-	m_Messages.erase( itMessage );
+	const SMessengerStats& stats = m_Stats;
+	if (format == StatsFormat_CSV)
+	{
+		file << "frame," << stats.frame << endl;
+		file << "type,sent,fetched" << endl;
+		for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+		{
+			file << MessageTypeName( static_cast<EMessageType>(type) ) << ","
+			     << stats.sent[type] << "," << stats.fetched[type] << endl;
+		}
+		file << "total," << stats.totalSent << "," << stats.totalFetched << endl;
+		file << "broadcasts sent," << stats.broadcastsSent << endl;
+		file << "coalesced," << stats.coalesced << endl;
+		file << "mailboxes in use," << stats.mailboxesInUse << endl;
+		file << "max mailbox depth," << stats.maxMailboxDepth << endl;
+		file << "mean mailbox depth," << stats.meanMailboxDepth << endl;
+		file << "mean latency," << stats.meanLatency << endl;
+		file << "max latency," << stats.maxLatency << endl;
+		file << "top sender,messages" << endl;
+		for (TUInt32 sender = 0; sender < NumTopSenders && stats.topSenderCounts[sender]; ++sender)
+		{
+			file << stats.topSenders[sender] << "," << stats.topSenderCounts[sender] << endl;
+		}
+	}
+	else
+	{
+		file << "{" << endl;
+		file << "  \"frame\": " << stats.frame << "," << endl;
+		file << "  \"types\": [" << endl;
+		for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+		{
+			file << "    { \"type\": \"" << MessageTypeName( static_cast<EMessageType>(type) )
+			     << "\", \"sent\": " << stats.sent[type] << ", \"fetched\": " << stats.fetched[type]
+			     << " }" << (type + 1 < NumMessageTypes ? "," : "") << endl;
+		}
+		file << "  ]," << endl;
+		file << "  \"totalSent\": " << stats.totalSent << "," << endl;
+		file << "  \"totalFetched\": " << stats.totalFetched << "," << endl;
+		file << "  \"broadcastsSent\": " << stats.broadcastsSent << "," << endl;
+		file << "  \"coalesced\": " << stats.coalesced << "," << endl;
+		file << "  \"mailboxesInUse\": " << stats.mailboxesInUse << "," << endl;
+		file << "  \"maxMailboxDepth\": " << stats.maxMailboxDepth << "," << endl;
+		file << "  \"meanMailboxDepth\": " << stats.meanMailboxDepth << "," << endl;
+		file << "  \"meanLatency\": " << stats.meanLatency << "," << endl;
+		file << "  \"maxLatency\": " << stats.maxLatency << "," << endl;
+		file << "  \"topSenders\": [";
+		for (TUInt32 sender = 0; sender < NumTopSenders && stats.topSenderCounts[sender]; ++sender)
+		{
+			file << (sender ? ", " : " ") << "{ \"uid\": " << stats.topSenders[sender]
+			     << ", \"messages\": " << stats.topSenderCounts[sender] << " }";
+		}
+		file << " ]" << endl;
+		file << "}" << endl;
+	}
+	return file.good();
+}
+
+#ifdef GEN_MESSENGER_STATS
+// Count a message sent in this frame
+void CMessenger::CountSent( const SMessage& msg )
+{
+	++m_SentCounts[msg.type];
+
+	SSenderCount* senderCount = &m_SystemSenderCount;
+	TUInt32 index = SEntityHandle( msg.from ).Index();
+	if (index < MaxHandleSlots)
+	{
+		if (index >= m_SenderCounts.size())
+		{
+			SSenderCount noSender = { SystemUID, 0 };
+			m_SenderCounts.resize( index + 1, noSender );
+		}
+		senderCount = &m_SenderCounts[index];
+		if (senderCount->count == 0)
+		{
+			m_Senders.push_back( index );
+		}
+	}
+	senderCount->uid = msg.from;
+	++senderCount->count;
+}
+
+// Count a message fetched in this frame, with the frame it was put in a mailbox
+void CMessenger::CountFetched( const SMessage& msg, TUInt32 postFrame )
+{
+	// Each thread fetching during deferred delivery has its own counts
+	SFetchCounts& counts = m_FetchCounts[t_SenderThread];
+	++counts.fetched[msg.type];
+	TUInt32 latency = m_Frame - postFrame;
+	counts.totalLatency += latency;
+	counts.maxLatency = Max( counts.maxLatency, latency );
+}
+#endif
+
+
+/////////////////////////////////////
+// Mailboxes
+
+// Return the mailbox for the given handle slot index, adding mailboxes up to the index
+CMessenger::SMailbox& CMessenger::GetMailbox( TUInt32 index )
+{
+	if (index >= m_Mailboxes.size())
+	{
+		SMailbox emptyMailbox = { 0, 0, 0, 0, SystemUID, 0, NoAtom, 0 };
+		m_Mailboxes.resize( index + 1, emptyMailbox );
+	}
+	return m_Mailboxes[index];
+}
+
+// Add a message to the end of the given UID's mailbox, or combine it with a waiting message
+void CMessenger::PostMessage( TEntityUID to, const SMessage& msg )
+{
+	// SystemUID is not a valid handle and has no mailbox
+	TUInt32 index = SEntityHandle( to ).Index();
+	if (index >= MaxHandleSlots)
+	{
+		return;
+	}
+	SMailbox& mailbox = GetMailbox( index );
+
+	// Look for a waiting message to combine with
+	EMessageCoalescing coalescing = m_Coalescing[msg.type];
+	if (coalescing != Coalesce_None)
+	{
+		SMailboxMessage* waitingMessage = FindCoalescedMessage( mailbox, to, msg.type, coalescing );
+		if (waitingMessage && coalescing == Coalesce_SumHits)
+		{
+			SMessage& hit = waitingMessage->msg;
+			hit.damageToApply += msg.damageToApply;
+			if (hit.numHits < MaxHitSources)
+			{
+				hit.hitSources[hit.numHits] = msg.from;
+			}
+			++hit.numHits;
+#ifdef GEN_MESSENGER_STATS
+			++m_Coalesced;
+#endif
+			return;
+		}
+		if (waitingMessage)
+		{
+#ifdef GEN_MESSENGER_STATS
+			++m_Coalesced;
+#endif
+			// Replace the waiting message - it is skipped when fetched, as if sent to an earlier
+			// UID, and the new message is added at the end
+			waitingMessage->to = SystemUID;
+		}
+	}
+
+	// Start a new block if the mailbox is empty or the tail block is full
+	if (!mailbox.tail || mailbox.tailPosition == MessagesPerBlock)
+	{
+		SMailboxBlock* newBlock = static_cast<SMailboxBlock*>(m_BlockPool.Allocate());
+		newBlock->next = 0;
+		if (mailbox.tail)
+		{
+			mailbox.tail->next = newBlock;
+		}
+		else
+		{
+			mailbox.head = newBlock;
+			mailbox.headPosition = 0;
+		}
+		mailbox.tail = newBlock;
+		mailbox.tailPosition = 0;
+	}
+
+	SMailboxMessage& mailboxMessage = mailbox.tail->messages[mailbox.tailPosition++];
+	mailboxMessage.to = to;
+	mailboxMessage.sequence = m_NextSequence++;
+	mailboxMessage.msg = msg;
+#ifdef GEN_MESSENGER_STATS
+	mailboxMessage.postFrame = m_Frame;
+	++mailbox.depth;
+#endif
+	if (coalescing == Coalesce_SumHits)
+	{
+		mailboxMessage.msg.numHits = 1;
+		mailboxMessage.msg.hitSources[0] = msg.from;
+	}
+}
+
+// Return the waiting message for the given UID in the given mailbox that a message of the given
+// type and coalescing policy combines with, or 0 if there is none
+CMessenger::SMailboxMessage* CMessenger::FindCoalescedMessage
+(
+	SMailbox&          mailbox,
+	TEntityUID         to,
+	EMessageType       type,
+	EMessageCoalescing coalescing
+)
+{
+	// Mailboxes rarely hold more than a few messages, so search from the front
+	SMailboxBlock* block = mailbox.head;
+	TUInt32 position = mailbox.headPosition;
+	while (block)
+	{
+		TUInt32 endPosition = (block == mailbox.tail) ? mailbox.tailPosition : MessagesPerBlock;
+		for (; position < endPosition; ++position)
+		{
+			SMailboxMessage& waitingMessage = block->messages[position];
+			if (waitingMessage.to == to &&
+			    (waitingMessage.msg.type == type ||
+			     (coalescing == Coalesce_Replace && m_Coalescing[waitingMessage.msg.type] == Coalesce_Replace)))
+			{
+				return &waitingMessage;
+			}
+		}
+		if (block == mailbox.tail)
+		{
+			break;
+		}
+		block = block->next;
+		position = 0;
+	}
+	return 0;
+}
+
+// Return the message at the front of the given mailbox, or 0 if it is empty
+const CMessenger::SMailboxMessage* CMessenger::FrontMessage( SMailbox& mailbox )
+{
+	if (!mailbox.head)
+	{
+		return 0;
+	}
+
+	// Move to the next block when the head block has been fetched
+	if (mailbox.headPosition == MessagesPerBlock)
+	{
+		SMailboxBlock* nextBlock = mailbox.head->next;
+		ReleaseBlock( mailbox.head );
+		mailbox.head = nextBlock;
+		mailbox.headPosition = 0;
+	}
+	return &mailbox.head->messages[mailbox.headPosition];
+}
+
+// Remove the message at the front of the given mailbox, which must not be empty
+void CMessenger::PopMessage( SMailbox& mailbox )
+{
+	++mailbox.headPosition;
+#ifdef GEN_MESSENGER_STATS
+	--mailbox.depth;
+#endif
+
+	// Release the last block as soon as the mailbox is empty, so empty mailboxes have no blocks
+	if (mailbox.head == mailbox.tail && mailbox.headPosition == mailbox.tailPosition)
+	{
+		ReleaseBlock( mailbox.head );
+		mailbox.head = mailbox.tail = 0;
+	}
+}
+
+// Return the blocks of the given mailbox to the pool, leaving it empty
+void CMessenger::EmptyMailbox( SMailbox& mailbox )
+{
+	while (mailbox.head)
+	{
+		SMailboxBlock* nextBlock = mailbox.head->next;
+		ReleaseBlock( mailbox.head );
+		mailbox.head = nextBlock;
+	}
+	mailbox.tail = 0;
+#ifdef GEN_MESSENGER_STATS
+	mailbox.depth = 0;
+#endif
+}
 
-	return true;
+// Return a block to the pool, or during deferred delivery hold it until the end call (the pool
+// is shared by all threads)
+void CMessenger::ReleaseBlock( SMailboxBlock* block )
+{
+	if (m_IsDeferred)
+	{
+		block->next = m_ReleasedBlocks[t_SenderThread];
+		m_ReleasedBlocks[t_SenderThread] = block;
+	}
+	else
+	{
+		m_BlockPool.Free( block );
+	}
 }
 
 
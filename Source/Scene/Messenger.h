@@ -6,15 +6,26 @@
 
 #pragma once
 
-#include <map>
+#include <vector>
+#include <deque>
 using namespace std;
 
 #include "Defines.h"
+#include "Atom.h"
+#include "CFreeListPool.h"
+#include "CTimerWheel.h"
 #include "Entity.h"
 
 namespace gen
 {
 
+// Messenger statistics are gathered unless GEN_NO_MESSENGER_STATS is defined (e.g. in the project
+// preprocessor definitions), in which case the code counting messages is removed
+#if !defined(GEN_NO_MESSENGER_STATS)
+	#define GEN_MESSENGER_STATS
+#endif
+
+
 /////////////////////////////////////
 //	Public types
 
@@ -30,12 +41,32 @@ enum EMessageType
 	Msg_FindAmmo,
 	Msg_FindHealth,
 	Msg_Help,
-	Msg_Destruct
+	Msg_Destruct,
+	Msg_RestoreShells,  // Sent by an ammo crate to the tank collecting it
+	Msg_RestoreHealth,  // Sent by a health crate to the tank collecting it
+	Msg_Targeted,       // Sent by a tank to the crate it is heading for
+	Msg_TargetRejected, // Sent by a crate to a tank whose Msg_Targeted it turned down
+	Msg_Fire,           // Sent by a tank to its shell to fire it at the target
+
+	NumMessageTypes     // Number of message types, not a message
+};
+
+// How a message is combined with a message of the same kind waiting in the recipient's mailbox,
+// so bursts of messages are fetched as one
+enum EMessageCoalescing
+{
+	Coalesce_None,    // Every message is fetched
+	Coalesce_SumHits, // Added to a waiting message of the same type: damage summed and the senders
+	                  // listed in the hit data (Msg_Hit)
+	Coalesce_Replace, // Replaces any waiting message with this policy, only the last is fetched.
+	                  // Only for messages whose handler sets the state and nothing else
 };
 
-// A message contains a type and the UID that sent it.
-// The message types for this exercise don't currently require extra data, but it is possible
-// to use a union to add additional data for new message types (see the space game code)
+// Number of senders listed in a Msg_Hit that has been coalesced from several hits
+const TUInt32 MaxHitSources = 4;
+
+// A message contains a type and the UID that sent it, along with extra data for some message
+// types held in a union
 struct SMessage
 {
 	// Need to provide copy constructor and assignment operator in case you later add a union to this structure
@@ -56,20 +87,105 @@ struct SMessage
 	//*** Message data
 	EMessageType type;
 	TEntityUID   from;
-	TInt32 damageToApply;
+	union
+	{
+		struct // Msg_Hit
+		{
+			TInt32     damageToApply;
+			TUInt32    numHits;                   // Set by the messenger, hits combined in this message
+			TEntityUID hitSources[MaxHitSources]; // Set by the messenger, senders of the first hits
+		};
+		TInt32     amount;        // Msg_RestoreShells, Msg_RestoreHealth
+		TEntityUID target;        // Msg_Fire
+	};
+};
+
+
+// Groups of entities that a message can be broadcast to
+enum EMessageTopic
+{
+	Topic_All,  // Every recipient
+	Topic_Team, // Recipients on a given team
+	Topic_Type, // Recipients of a given template type
+};
+
+
+// Return the name of a message type, e.g. "Hit"
+const char* MessageTypeName( EMessageType type );
+
+
+// Number of senders listed in the messenger statistics
+const TUInt32 NumTopSenders = 5;
+
+// Messenger statistics for one frame (see CMessenger::EndFrame)
+struct SMessengerStats
+{
+	TUInt32 frame;
+
+	// Messages sent and fetched in the frame, by type. Broadcasts count once when sent and once
+	// for each recipient that fetches them. Delayed messages count when sent
+	TUInt32 sent[NumMessageTypes];
+	TUInt32 fetched[NumMessageTypes];
+	TUInt32 totalSent;
+	TUInt32 totalFetched;
+	TUInt32 broadcastsSent;
+	TUInt32 coalesced; // Messages combined with a waiting message
+
+	// Messages waiting in mailboxes at the end of the frame
+	TUInt32  mailboxesInUse; // Mailboxes with messages waiting
+	TUInt32  maxMailboxDepth;
+	TFloat32 meanMailboxDepth; // Over mailboxes in use
+
+	// Frames from a message being put in a mailbox to being fetched, for messages fetched in the
+	// frame. Messages sent during the entity update (see CEntityManager::UpdateAllEntities) have a
+	// latency of at least 1
+	TFloat32 meanLatency;
+	TUInt32  maxLatency;
+
+	// The UIDs that sent most messages in the frame, most first, and the number each sent.
+	// Unused entries have 0 messages
+	TEntityUID topSenders[NumTopSenders];
+	TUInt32    topSenderCounts[NumTopSenders];
 };
 
+// File formats for CMessenger::WriteStats
+enum EStatsFormat
+{
+	StatsFormat_CSV,
+	StatsFormat_JSON,
+};
+
+
+// Function called when a message is delivered to a UID, data is the pointer given when the
+// function was set
+typedef void (*TDeliveryListener)( TEntityUID to, void* data );
+
 
 // Messenger class allows the sending and receipt of messages between entities - addressed by UID
+//
+// Each entity handle slot (see SEntityHandle) has a mailbox, a first-in first-out queue of
+// messages. A mailbox is a chain of fixed size blocks of messages taken from a pool, messages are
+// added at the end of the last block and fetched from the front of the first, and blocks are
+// returned to the pool as they are emptied. So sending and fetching a message are constant time
+// and make no heap calls once the pool has grown, and an empty mailbox is found immediately
+//
+// Messages can also be broadcast to a topic: all recipients, a team or a template type. A
+// broadcast is stored once in a log rather than copied to each mailbox. Each mailbox keeps its
+// position in the log, and a fetch checks the broadcasts after that position against the
+// recipient's team and type, so sending a broadcast costs the same however many entities receive
+// it. Every message is given a sequence number when sent, so a recipient fetches broadcasts and
+// direct messages in the order they were sent. Broadcasts are removed from the log once every
+// recipient has passed them
 class CMessenger
 {
 /////////////////////////////////////
 //	Constructors/Destructors
 public:
-	// Default constructor
-	CMessenger() {}
+	// Constructor
+	CMessenger();
 
-	// No destructor needed
+	// Destructor returns all mailbox blocks to the pool
+	~CMessenger();
 
 private:
 	// Disallow use of copy constructor and assignment operator (private and not defined)
@@ -91,21 +207,327 @@ public:
 	// pointer. Returns false if there are no messages for this UID
 	bool FetchMessage( TEntityUID to, SMessage* msg );
 
+	// Discard all messages waiting for the given UID / for all UIDs. The entity manager discards
+	// the messages for each entity it destroys. Also removes the UID / all UIDs as recipients of
+	// broadcasts
+	void DiscardMessages( TEntityUID to );
+	void DiscardAllMessages();
+
+
+	/////////////////////////////////////
+	// Coalescing
+	// By default Msg_Hit messages are summed, and the state messages sent by tanks and the user
+	// (start, stop, evade, patrol, aim, find ammo/health, help) replace each other, so an entity
+	// fetches at most one of each per update. Msg_Destruct is never replaced. Broadcasts are not
+	// coalesced
+
+	// Set / get how messages of the given type are combined with waiting messages
+	void SetCoalescing( EMessageType type, EMessageCoalescing coalescing )
+	{
+		m_Coalescing[type] = coalescing;
+	}
+
+	EMessageCoalescing GetCoalescing( EMessageType type )
+	{
+		return m_Coalescing[type];
+	}
+
+
+	/////////////////////////////////////
+	// Broadcasts
+
+	// Add the given UID as a recipient of broadcasts, with the team and template type used to
+	// match topics. The entity manager adds every entity that is updated. A recipient receives the
+	// broadcasts sent after it was added
+	void AddRecipient( TEntityUID uid, TInt32 team, TAtom type );
+
+	// Send the given message to all recipients / the recipients on a team / the recipients of a
+	// template type. Broadcasts do not call the delivery listener, so they do not wake sleeping
+	// entities - they are fetched when the entity next updates
+	void BroadcastMessage( const SMessage& msg );
+	void SendTeamMessage( TInt32 team, const SMessage& msg );
+	void SendTypeMessage( TAtom type, const SMessage& msg );
+
+	// Number of broadcasts held in the log
+	TUInt32 NumBroadcasts()
+	{
+		return static_cast<TUInt32>(m_Broadcasts.size());
+	}
+
+
+	/////////////////////////////////////
+	// Delayed messages
+	// Messages can be sent to arrive after a delay, e.g. for an entity to send itself a message to
+	// act on later, and sleep until it arrives, rather than counting down a time in each update.
+	// Delayed messages are held in a timing wheel, so sending and delivering them takes constant
+	// time however many are waiting
+
+	// Send the given message to a particular UID after the given delay in seconds. It is delivered
+	// when the messenger's time has advanced by the delay (to the nearest millisecond), and no
+	// earlier than the next advance. Messages for UIDs destroyed before the delay has passed are
+	// never fetched
+	void SendMessageDelayed( TEntityUID to, const SMessage& msg, TFloat32 delay );
+
+	// Advance the messenger's time, delivering the delayed messages that are due. Called by the
+	// entity manager at the start of each update with the update time
+	void AdvanceTime( TFloat32 updateTime );
+
+	// Number of delayed messages not yet delivered
+	TUInt32 NumDelayedMessages()
+	{
+		return m_DelayedMessages.NumTimers();
+	}
+
+
+	/////////////////////////////////////
+	// Deferred delivery
+	// Used by the entity manager to deliver messages in phases: the messages sent during one
+	// update are fetched in the next (see CEntityManager::UpdateAllEntities). Between the begin
+	// and end calls, several threads may send messages and fetch messages at once, provided each
+	// UID's messages are only fetched by one thread. Fetches return the messages queued before the
+	// begin call. Sent messages are held in an outbox for each thread, so sending takes no lock, and
+	// delivered at the end call in order of sender, so the delivery order does not depend on how
+	// senders were split between threads or on when recipients were updated
+
+	// Begin deferred delivery with the given number of sending threads
+	void BeginDeferredDelivery( TUInt32 numThreads );
+
+	// Set the thread index (less than the number of threads) and the sender order, e.g. entity
+	// index, for messages sent from the calling thread
+	void SetDeferredSender( TUInt32 threadIndex, TUInt32 senderOrder );
+
+	// End deferred delivery - remove the messages that were fetched and deliver the messages sent
+	void EndDeferredDelivery();
+
+	bool IsDeferred()
+	{
+		return m_IsDeferred;
+	}
+
+
+	/////////////////////////////////////
+	// Statistics
+	// Gathered unless GEN_NO_MESSENGER_STATS is defined, otherwise the statistics are all zero
+
+	// Finish a frame: gather the statistics for the frame and start counting again. Called by the
+	// entity manager at the end of each update
+	void EndFrame();
+
+	// Number of frames finished
+	TUInt32 GetFrame()
+	{
+		return m_Frame;
+	}
+
+	// Statistics for the last frame finished
+	const SMessengerStats& GetStats()
+	{
+		return m_Stats;
+	}
+
+	// Write the statistics for the last frame finished to the given file in the given format.
+	// Returns false if the file cannot be written
+	bool WriteStats( const string& fileName, EStatsFormat format );
+
+
+	/////////////////////////////////////
+	// Delivery listener
+
+	// Set a function to call as each message is delivered, e.g. so the entity manager can wake
+	// a sleeping entity when it is sent a message. Pass 0 for none. Messages sent during
+	// deferred delivery are reported when delivered by the end call, so the function is never
+	// called by several threads at once
+	void SetDeliveryListener( TDeliveryListener listener, void* data = 0 )
+	{
+		m_DeliveryListener = listener;
+		m_DeliveryListenerData = data;
+	}
+
 
 /////////////////////////////////////
 //	Private interface
 private:
 
-	// A multimap has properties similar to a hash map - mapping a key to a value. Here we
-	// have the key as an entity UID and the value as a message for that UID. The stored
-	// key/value pairs in a multimap are sorted by key, which means all the messages for a
-	// particular UID are together. Key look-up is somewhat slower than for a hash map though
-	// Define some types to make usage easier
-	typedef multimap<TEntityUID, SMessage> TMessages;
-	typedef TMessages::iterator TMessageIter;
-    typedef pair<TEntityUID, SMessage> UIDMsgPair; // The type stored by the multimap
+	// A message in a mailbox, with the UID it was sent to and its sequence number. A handle slot is
+	// reused by new entities once its entity is destroyed, so messages sent to an earlier UID for
+	// the slot are skipped
+	struct SMailboxMessage
+	{
+		TEntityUID to;
+		TUInt32    sequence;
+		SMessage   msg;
+#ifdef GEN_MESSENGER_STATS
+		TUInt32    postFrame; // Frame put in the mailbox, for latency
+#endif
+	};
+
+	// A block of messages in a mailbox
+	static const TUInt32 MessagesPerBlock = 8;
+	struct SMailboxBlock
+	{
+		SMailboxBlock*  next;
+		SMailboxMessage messages[MessagesPerBlock];
+	};
+
+	// A mailbox holds the messages in a chain of blocks. Messages are fetched from the first block
+	// (the head) and added to the last (the tail). Empty mailboxes have no blocks. Also holds the
+	// broadcast recipient using the mailbox, if any
+	struct SMailbox
+	{
+		SMailboxBlock* head;
+		SMailboxBlock* tail;
+		TUInt32        headPosition; // Next message to fetch in the head block
+		TUInt32        tailPosition; // Next free message in the tail block
+
+		TEntityUID     recipient;     // SystemUID if the slot's entity does not receive broadcasts
+		TInt32         team;
+		TAtom          type;
+		TUInt32        nextBroadcast; // Number of the next broadcast to check (see m_FirstBroadcast)
+
+#ifdef GEN_MESSENGER_STATS
+		TUInt32        depth; // Messages waiting, including replaced messages not yet skipped
+#endif
+	};
+
+	// A broadcast message with its topic. The topic value is the team or type atom
+	struct SBroadcast
+	{
+		EMessageTopic topic;
+		TUInt32       topicValue;
+		TUInt32       sequence;
+		SMessage      msg;
+#ifdef GEN_MESSENGER_STATS
+		TUInt32       postFrame;
+#endif
+	};
+
+	// A delayed message waiting in the timing wheel
+	struct SDelayedMessage
+	{
+		TEntityUID to;
+		SMessage   msg;
+	};
+
+	// Timing wheel expire function delivering a delayed message, data is the messenger
+	static void DelayedMessageDue( const SDelayedMessage& delayedMessage, void* data );
+
+	// Return the mailbox for the given handle slot index, adding mailboxes up to the index
+	SMailbox& GetMailbox( TUInt32 index );
+
+	// Add a message to the end of the given UID's mailbox, or combine it with a waiting message
+	void PostMessage( TEntityUID to, const SMessage& msg );
+
+	// Return the waiting message for the given UID in the given mailbox that a message of the given
+	// type and coalescing policy combines with, or 0 if there is none
+	SMailboxMessage* FindCoalescedMessage( SMailbox& mailbox, TEntityUID to, EMessageType type,
+	                                       EMessageCoalescing coalescing );
+
+	// Send a broadcast, or hold it in the outbox during deferred delivery / add it to the log
+	void SendBroadcast( EMessageTopic topic, TUInt32 topicValue, const SMessage& msg );
+	void PostBroadcast( EMessageTopic topic, TUInt32 topicValue, const SMessage& msg );
+
+	// Return the next broadcast for the given mailbox's recipient that was sent before the given
+	// sequence number, or 0 if there is none. Moves the mailbox past unmatched broadcasts
+	const SBroadcast* NextBroadcast( SMailbox& mailbox, TUInt32 beforeSequence );
+
+	// Remove the broadcasts from the start of the log that every recipient has passed
+	void TrimBroadcasts();
+
+	// Return the message at the front of the given mailbox, or 0 if it is empty
+	const SMailboxMessage* FrontMessage( SMailbox& mailbox );
+
+	// Remove the message at the front of the given mailbox, which must not be empty
+	void PopMessage( SMailbox& mailbox );
+
+	// Return the blocks of the given mailbox to the pool, leaving it empty
+	void EmptyMailbox( SMailbox& mailbox );
+
+	// Return a block to the pool, or during deferred delivery hold it until the end call (the pool
+	// is shared by all threads)
+	void ReleaseBlock( SMailboxBlock* block );
+
+	// Mailboxes indexed by handle slot index, added as messages are sent to higher indexes
+	vector<SMailbox> m_Mailboxes;
+	CFreeListPool    m_BlockPool;
 
-	TMessages m_Messages;
+	// During deferred delivery, the blocks emptied by each thread, linked through their next
+	// pointers. Returned to the pool at the end call
+	vector<SMailboxBlock*> m_ReleasedBlocks;
+
+	// Broadcasts not yet passed by every recipient, oldest first. Broadcasts are numbered in the
+	// order sent, the first in the log has number m_FirstBroadcast. The log is trimmed when it
+	// reaches m_TrimSize broadcasts
+	deque<SBroadcast> m_Broadcasts;
+	TUInt32           m_FirstBroadcast;
+	TUInt32           m_TrimSize;
+
+	// Sequence number given to the next message or broadcast posted
+	TUInt32 m_NextSequence;
+
+	// Coalescing policy for each message type
+	EMessageCoalescing m_Coalescing[NumMessageTypes];
+
+	// Delayed messages, and the time advanced but not yet a whole tick of the wheel
+	CTimerWheel<SDelayedMessage> m_DelayedMessages;
+	TFloat32                     m_UntickedTime;
+
+	// Messages sent during deferred delivery, with the order to deliver them in. Broadcasts are
+	// held with a topic, direct messages have isBroadcast false
+	struct SDeferredMessage
+	{
+		TUInt32       senderOrder;
+		TUInt32       sequence; // Position in outbox, orders messages from the same sender
+		TEntityUID    to;
+		TUInt32       delayTicks; // Ticks to hold a delayed message for, 0 to deliver at once
+		bool          isBroadcast;
+		EMessageTopic topic;
+		TUInt32       topicValue;
+		SMessage      msg;
+	};
+	vector< vector<SDeferredMessage> > m_Outboxes; // One per thread
+	vector<SDeferredMessage>           m_Delivery; // Outboxes merged at the end call
+	bool                               m_IsDeferred;
+
+	TDeliveryListener m_DeliveryListener;
+	void*             m_DeliveryListenerData;
+
+	// Frames finished and the statistics for the last one
+	TUInt32         m_Frame;
+	SMessengerStats m_Stats;
+
+#ifdef GEN_MESSENGER_STATS
+	// Count a message sent / fetched (with the frame it was put in a mailbox) in this frame
+	void CountSent( const SMessage& msg );
+	void CountFetched( const SMessage& msg, TUInt32 postFrame );
+
+	// Counts of messages fetched in the current frame, one for each thread as several threads
+	// fetch at once during deferred delivery
+	struct SFetchCounts
+	{
+		TUInt32 fetched[NumMessageTypes];
+		TUInt32 totalLatency;
+		TUInt32 maxLatency;
+	};
+	vector<SFetchCounts> m_FetchCounts;
+
+	// Counts of messages sent in the current frame. Messages are only counted as sent by one
+	// thread at a time, including those sent during deferred delivery which are counted at the
+	// end call
+	TUInt32 m_SentCounts[NumMessageTypes];
+	TUInt32 m_BroadcastsSent;
+	TUInt32 m_Coalesced;
+
+	// Messages sent by each handle slot index in the current frame (and by SystemUID), and the
+	// indexes that have sent messages
+	struct SSenderCount
+	{
+		TEntityUID uid;
+		TUInt32    count;
+	};
+	vector<SSenderCount> m_SenderCounts;
+	SSenderCount         m_SystemSenderCount;
+	vector<TUInt32>      m_Senders;
+#endif
 };
 
 
@@ -60,29 +60,26 @@ namespace gen
 
 	void CMineEntity::AliveBehaviour(TFloat32 updateTime)
 	{
-		if (m_ExplodeTime > 0)
+		// The mine sent itself a delayed message when it landed, sleep until it arrives
+		bool explode = false;
+		SMessage msg;
+		while (Messenger.FetchMessage(GetUID(), &msg))
 		{
-			m_ExplodeTime -= updateTime;
+			if (msg.type == Msg_Destruct)
+			{
+				explode = true;
+			}
+		}
+
+		if (!explode)
+		{
+			SleepUntilMessage();
 		}
 		else
 		{
-			vector<CTankEntity*> tanksToDamage;
-			// Find out if any of the tanks is able to pick up this crate
-			EntityManager.BeginEnumEntities("", "", "Tank");
-			CEntity* entity = EntityManager.EnumEntity();
-			while (entity != 0)
-			{
-				if (Distance(Position(), entity->Position()) < m_DamageRadius)
-				{
-					CTankEntity* tankEntity = static_cast<CTankEntity*>(entity);
-					if (tankEntity != 0)
-					{
-						tanksToDamage.push_back(tankEntity); 
-					}
-				}
-				entity = EntityManager.EnumEntity();
-			}
-			EntityManager.EndEnumEntities();
+			// Find the tanks caught in the blast radius
+			vector<CEntity*> tanksToDamage;
+			EntityManager.QueryRadius(Position(), m_DamageRadius, SEntityFilter(TankTypeAtom), tanksToDamage);
 			
 			if (tanksToDamage.size() > 0)
 			{
@@ -91,7 +88,7 @@ namespace gen
 				msg.type = Msg_Hit;
 				msg.damageToApply = m_DamageToApply;
 				
-				for each (CTankEntity* tank in tanksToDamage)
+				for each (CEntity* tank in tanksToDamage)
 				{
 					Messenger.SendMessage(tank->GetUID(), msg);
 				}
@@ -107,7 +104,7 @@ namespace gen
 	{
 		if (Position().y > m_AlivePosition.y)
 		{
-			Position().y -= updateTime * m_Gravity;
+			Matrix().Position().y -= updateTime * m_Gravity;
 		}
 		else
 		{
@@ -119,7 +116,12 @@ namespace gen
 	{
 		if (m_RespawnTime > 0.0f)
 		{
-			m_RespawnTime -= updateTime;
+			// Sleep through the rest of the wait rather than counting it down every update
+			m_RespawnTime -= updateTime + GetTimeAsleep();
+			if (m_RespawnTime > 0.0f)
+			{
+				Sleep(m_RespawnTime);
+			}
 		}
 		else
 		{
@@ -134,7 +136,14 @@ namespace gen
 			default:
 				break;
 			case Alive:
+			{
+				// Explode after the fuse time, the mine does nothing until then
+				SMessage msg;
+				msg.from = GetUID();
+				msg.type = Msg_Destruct;
+				Messenger.SendMessageDelayed(GetUID(), msg, m_ExplodeTime);
 				break;
+			}
 			case Collected:
 				// In this state the crate is hidden bellow the floor
 				m_CollectedPosition = CVector3(0.0f, -10.0f, 0.0f);
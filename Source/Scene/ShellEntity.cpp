@@ -58,6 +58,20 @@ CShellEntity::CShellEntity
 // Return false if the entity is to be destroyed
 bool CShellEntity::Update( TFloat32 updateTime )
 {
+	// Fetch any messages
+	SMessage msg;
+	while (Messenger.FetchMessage(GetUID(), &msg))
+	{
+		if (msg.type == Msg_Fire)
+		{
+			CEntity* target = EntityManager.GetEntity(msg.target);
+			if (target != 0)
+			{
+				FireShell(target);
+			}
+		}
+	}
+
 	switch (m_State)
 	{
 		default:
@@ -90,23 +104,22 @@ void CShellEntity::AliveBehaviour(TFloat32 updateTime)
 	{
 		Matrix().MoveLocalZ(m_TravelSpeed * updateTime);
 		
-		// Check for collision with any tank (excluding owning tank)
-		vector<CTankEntity*> tanks = EntityManager.GetTankEntities(m_Owner);
-		for each (CTankEntity * tank in tanks)
+		// Check for collision with any nearby tank (excluding owning tank), a tank exactly at the
+		// radius is hit
+		vector<CEntity*> tanks;
+		EntityManager.QueryRadius(Position(), m_Radius, SEntityFilter(TankTypeAtom, Team_Any, NoTeam, m_Owner), tanks, true);
+		for each (CEntity* entity in tanks)
 		{
-			TFloat32 distance = Distance(tank->Position(), Matrix().Position());
-			if (distance <= m_Radius)
+			CTankEntity* tank = static_cast<CTankEntity*>(entity);
+			if (m_Owner->GetTeam() != tank->GetTeam())
 			{
-				if (m_Owner->GetTeam() != tank->GetTeam())
-				{
-					SMessage msg;
-					msg.from = m_Owner->GetUID();
-					msg.type = Msg_Hit;
-					msg.damageToApply = m_Owner->GetShellDamage();
-					Messenger.SendMessage(tank->GetUID(), msg);
-				}
-				UpdateState(Destroyed);
+				SMessage msg;
+				msg.from = m_Owner->GetUID();
+				msg.type = Msg_Hit;
+				msg.damageToApply = m_Owner->GetShellDamage();
+				Messenger.SendMessage(tank->GetUID(), msg);
 			}
+			UpdateState(Destroyed);
 		}
 	}
 	else
@@ -117,6 +130,8 @@ void CShellEntity::AliveBehaviour(TFloat32 updateTime)
 
 void CShellEntity::DestroyedBehaviour(TFloat32 updateTime)
 {
+	// Nothing to do until the owner sends a fire message
+	SleepUntilMessage();
 }
 
 void CShellEntity::UpdateState(EState newState)
@@ -0,0 +1,372 @@
+/*******************************************
+	SpatialGrid.cpp
+
+	Uniform spatial hash grid for entity
+	proximity queries
+********************************************/
+
+#include <algorithm>
+#include <climits>
+#include "SpatialGrid.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Constructor takes the cell size (world units) and number of hash buckets (power of 2)
+CSpatialGrid::CSpatialGrid( TFloat32 cellSize /*= 20.0f*/, TUInt32 numBuckets /*= 1024*/ )
+{
+	m_CellSize = cellSize;
+	m_InvCellSize = 1.0f / cellSize;
+
+	// Round bucket count up to a power of 2 so the hash can be masked
+	m_NumBuckets = 1;
+	while (m_NumBuckets < numBuckets)
+	{
+		m_NumBuckets <<= 1;
+	}
+	m_Buckets = new TBucket[m_NumBuckets];
+	m_NumEntries = 0;
+
+	// Empty extents
+	m_MinCellX = m_MinCellZ = INT_MAX;
+	m_MaxCellX = m_MaxCellZ = INT_MIN;
+	m_IsExtentsStale = false;
+}
+
+// Destructor frees bucket memory
+CSpatialGrid::~CSpatialGrid()
+{
+	delete[] m_Buckets;
+}
+
+
+/////////////////////////////////////
+// Entity registration
+
+// Add an entity to the grid at its current position, with an optional team number
+void CSpatialGrid::Insert( CEntity* entity, TInt32 team /*= NoTeam*/ )
+{
+	if (entity->m_InGrid)
+	{
+		return;
+	}
+
+	SGridEntry entry;
+	entry.entity = entity;
+	entry.cellX = CellCoord( entity->Position().x );
+	entry.cellZ = CellCoord( entity->Position().z );
+	entry.team = team;
+	m_Buckets[BucketIndex( entry.cellX, entry.cellZ )].push_back( entry );
+	++m_NumEntries;
+
+	entity->m_InGrid = true;
+	entity->m_GridCellX = entry.cellX;
+	entity->m_GridCellZ = entry.cellZ;
+
+	// Extend used extents
+	m_MinCellX = Min( m_MinCellX, entry.cellX );
+	m_MinCellZ = Min( m_MinCellZ, entry.cellZ );
+	m_MaxCellX = Max( m_MaxCellX, entry.cellX );
+	m_MaxCellZ = Max( m_MaxCellZ, entry.cellZ );
+}
+
+// Remove an entity from the grid
+void CSpatialGrid::Remove( CEntity* entity )
+{
+	if (!entity->m_InGrid)
+	{
+		return;
+	}
+
+	RemoveFromBucket( BucketIndex( entity->m_GridCellX, entity->m_GridCellZ ), entity );
+	--m_NumEntries;
+	entity->m_InGrid = false;
+
+	// The extents may be wider than needed if the entity was on their edge
+	if (entity->m_GridCellX == m_MinCellX || entity->m_GridCellX == m_MaxCellX ||
+	    entity->m_GridCellZ == m_MinCellZ || entity->m_GridCellZ == m_MaxCellZ)
+	{
+		m_IsExtentsStale = true;
+	}
+}
+
+// Refile an entity after it may have moved - only does work if it has changed cell
+void CSpatialGrid::Move( CEntity* entity )
+{
+	if (!entity->m_InGrid)
+	{
+		return;
+	}
+
+	TInt32 cellX = CellCoord( entity->Position().x );
+	TInt32 cellZ = CellCoord( entity->Position().z );
+	if (cellX == entity->m_GridCellX && cellZ == entity->m_GridCellZ)
+	{
+		return;
+	}
+
+	// Take the entry out of its old bucket and file it under the new cell
+	SGridEntry entry;
+	RemoveFromBucket( BucketIndex( entity->m_GridCellX, entity->m_GridCellZ ), entity, &entry );
+	entry.cellX = cellX;
+	entry.cellZ = cellZ;
+	m_Buckets[BucketIndex( cellX, cellZ )].push_back( entry );
+
+	entity->m_GridCellX = cellX;
+	entity->m_GridCellZ = cellZ;
+
+	m_MinCellX = Min( m_MinCellX, cellX );
+	m_MinCellZ = Min( m_MinCellZ, cellZ );
+	m_MaxCellX = Max( m_MaxCellX, cellX );
+	m_MaxCellZ = Max( m_MaxCellZ, cellZ );
+}
+
+// Remove all entities from the grid
+void CSpatialGrid::Clear()
+{
+	for (TUInt32 bucket = 0; bucket < m_NumBuckets; ++bucket)
+	{
+		for (TUInt32 entry = 0; entry < m_Buckets[bucket].size(); ++entry)
+		{
+			m_Buckets[bucket][entry].entity->m_InGrid = false;
+		}
+		m_Buckets[bucket].clear();
+	}
+	m_NumEntries = 0;
+
+	m_MinCellX = m_MinCellZ = INT_MAX;
+	m_MaxCellX = m_MaxCellZ = INT_MIN;
+	m_IsExtentsStale = false;
+}
+
+// Shrink the extents to the cells in use if entities have been removed from their edges
+void CSpatialGrid::ShrinkExtents()
+{
+	if (!m_IsExtentsStale)
+	{
+		return;
+	}
+
+	m_MinCellX = m_MinCellZ = INT_MAX;
+	m_MaxCellX = m_MaxCellZ = INT_MIN;
+	for (TUInt32 bucket = 0; bucket < m_NumBuckets; ++bucket)
+	{
+		for (TUInt32 entry = 0; entry < m_Buckets[bucket].size(); ++entry)
+		{
+			const SGridEntry& gridEntry = m_Buckets[bucket][entry];
+			m_MinCellX = Min( m_MinCellX, gridEntry.cellX );
+			m_MinCellZ = Min( m_MinCellZ, gridEntry.cellZ );
+			m_MaxCellX = Max( m_MaxCellX, gridEntry.cellX );
+			m_MaxCellZ = Max( m_MaxCellZ, gridEntry.cellZ );
+		}
+	}
+	m_IsExtentsStale = false;
+}
+
+
+/////////////////////////////////////
+// Queries
+
+// Entities closer than the given distance to a point, or at the distance too if inclusive
+void CSpatialGrid::QueryRadius( const CVector3& centre, TFloat32 radius, const SEntityFilter& filter,
+                                vector<CEntity*>& results, bool isInclusive /*= false*/ )
+{
+	results.clear();
+
+	TInt32 minX = CellCoord( centre.x - radius );
+	TInt32 minZ = CellCoord( centre.z - radius );
+	TInt32 maxX = CellCoord( centre.x + radius );
+	TInt32 maxZ = CellCoord( centre.z + radius );
+	ClampToExtents( minX, minZ, maxX, maxZ );
+
+	TFloat32 radiusSquared = radius * radius;
+	for (TInt32 cellZ = minZ; cellZ <= maxZ; ++cellZ)
+	{
+		for (TInt32 cellX = minX; cellX <= maxX; ++cellX)
+		{
+			TBucket& bucket = m_Buckets[BucketIndex( cellX, cellZ )];
+			for (TUInt32 entry = 0; entry < bucket.size(); ++entry)
+			{
+				const SGridEntry& gridEntry = bucket[entry];
+				if (gridEntry.cellX != cellX || gridEntry.cellZ != cellZ)
+				{
+					continue;
+				}
+				TFloat32 distanceSquared = DistanceSquared( centre, gridEntry.entity->Position() );
+				if ((isInclusive ? distanceSquared <= radiusSquared : distanceSquared < radiusSquared) &&
+				    Matches( gridEntry, filter ))
+				{
+					results.push_back( gridEntry.entity );
+				}
+			}
+		}
+	}
+}
+
+// Entities whose positions lie within an axis-aligned box (inclusive)
+void CSpatialGrid::QueryBox( const CVector3& minBounds, const CVector3& maxBounds,
+                             const SEntityFilter& filter, vector<CEntity*>& results )
+{
+	results.clear();
+
+	TInt32 minX = CellCoord( minBounds.x );
+	TInt32 minZ = CellCoord( minBounds.z );
+	TInt32 maxX = CellCoord( maxBounds.x );
+	TInt32 maxZ = CellCoord( maxBounds.z );
+	ClampToExtents( minX, minZ, maxX, maxZ );
+
+	for (TInt32 cellZ = minZ; cellZ <= maxZ; ++cellZ)
+	{
+		for (TInt32 cellX = minX; cellX <= maxX; ++cellX)
+		{
+			TBucket& bucket = m_Buckets[BucketIndex( cellX, cellZ )];
+			for (TUInt32 entry = 0; entry < bucket.size(); ++entry)
+			{
+				const SGridEntry& gridEntry = bucket[entry];
+				if (gridEntry.cellX != cellX || gridEntry.cellZ != cellZ)
+				{
+					continue;
+				}
+
+				const CVector3& position = gridEntry.entity->Position();
+				if (position.x >= minBounds.x && position.x <= maxBounds.x &&
+				    position.y >= minBounds.y && position.y <= maxBounds.y &&
+				    position.z >= minBounds.z && position.z <= maxBounds.z &&
+				    Matches( gridEntry, filter ))
+				{
+					results.push_back( gridEntry.entity );
+				}
+			}
+		}
+	}
+}
+
+// Up to k entities nearest to the given point, sorted nearest first. Optionally limited to
+// a maximum search distance
+void CSpatialGrid::QueryNearest( const CVector3& centre, TUInt32 k, const SEntityFilter& filter,
+                                 vector<CEntity*>& results, TFloat32 maxDistance /*= D3D10_FLOAT32_MAX*/ )
+{
+	results.clear();
+	if (k == 0 || m_NumEntries == 0)
+	{
+		return;
+	}
+
+	// Candidates found so far as (squared distance, entity) pairs, kept sorted
+	vector< pair<TFloat32, CEntity*> > candidates;
+	TFloat32 maxDistanceSquared = (maxDistance < D3D10_FLOAT32_MAX) ? maxDistance * maxDistance : D3D10_FLOAT32_MAX;
+
+	// Search outwards in square rings of cells around the centre cell
+	TInt32 centreX = CellCoord( centre.x );
+	TInt32 centreZ = CellCoord( centre.z );
+	TInt32 maxRing = Max( Max( centreX - m_MinCellX, m_MaxCellX - centreX ),
+	                      Max( centreZ - m_MinCellZ, m_MaxCellZ - centreZ ) );
+	for (TInt32 ring = 0; ring <= maxRing; ++ring)
+	{
+		// Any cell in this ring or beyond is at least this far from the centre (in XZ)
+		TFloat32 ringDistance = (ring - 1) * m_CellSize;
+		if (ring > 0 && ringDistance * ringDistance > maxDistanceSquared)
+		{
+			break;
+		}
+		if (candidates.size() >= k && ring > 0 && ringDistance * ringDistance > candidates[k - 1].first)
+		{
+			break;
+		}
+
+		for (TInt32 cellZ = centreZ - ring; cellZ <= centreZ + ring; ++cellZ)
+		{
+			// Only visit the border cells of the ring
+			bool edgeRow = (cellZ == centreZ - ring || cellZ == centreZ + ring);
+			TInt32 stepX = edgeRow ? 1 : Max( 2 * ring, 1 );
+			for (TInt32 cellX = centreX - ring; cellX <= centreX + ring; cellX += stepX)
+			{
+				TBucket& bucket = m_Buckets[BucketIndex( cellX, cellZ )];
+				for (TUInt32 entry = 0; entry < bucket.size(); ++entry)
+				{
+					const SGridEntry& gridEntry = bucket[entry];
+					if (gridEntry.cellX != cellX || gridEntry.cellZ != cellZ || !Matches( gridEntry, filter ))
+					{
+						continue;
+					}
+
+					TFloat32 distanceSquared = DistanceSquared( centre, gridEntry.entity->Position() );
+					if (distanceSquared <= maxDistanceSquared)
+					{
+						candidates.push_back( make_pair( distanceSquared, gridEntry.entity ) );
+					}
+				}
+			}
+		}
+
+		// Keep the candidate list sorted so the kth distance is available for the early out
+		sort( candidates.begin(), candidates.end() );
+		if (candidates.size() > k)
+		{
+			candidates.resize( k );
+		}
+	}
+
+	for (TUInt32 candidate = 0; candidate < candidates.size(); ++candidate)
+	{
+		results.push_back( candidates[candidate].second );
+	}
+}
+
+
+/////////////////////////////////////
+// Support functions
+
+// Return true if the given entry passes the filter
+bool CSpatialGrid::Matches( const SGridEntry& entry, const SEntityFilter& filter )
+{
+	if (entry.entity == filter.exclude)
+	{
+		return false;
+	}
+	if (filter.teamMatch == Team_Same && entry.team != filter.team)
+	{
+		return false;
+	}
+	if (filter.teamMatch == Team_Other && (entry.team == NoTeam || entry.team == filter.team))
+	{
+		return false;
+	}
+	return filter.templateType == NoAtom || entry.entity->Template()->GetTypeAtom() == filter.templateType;
+}
+
+// Clamp a range of cells to the extents of the cells in use
+void CSpatialGrid::ClampToExtents( TInt32& minX, TInt32& minZ, TInt32& maxX, TInt32& maxZ )
+{
+	minX = Max( minX, m_MinCellX );
+	minZ = Max( minZ, m_MinCellZ );
+	maxX = Min( maxX, m_MaxCellX );
+	maxZ = Min( maxZ, m_MaxCellZ );
+}
+
+// Remove the entry for an entity from the given bucket
+void CSpatialGrid::RemoveFromBucket( TUInt32 bucket, CEntity* entity, SGridEntry* removedEntry /*= 0*/ )
+{
+	TBucket& entries = m_Buckets[bucket];
+	for (TUInt32 entry = 0; entry < entries.size(); ++entry)
+	{
+		if (entries[entry].entity == entity)
+		{
+			if (removedEntry)
+			{
+				*removedEntry = entries[entry];
+			}
+
+			// Order within a bucket does not matter, so swap with the last entry and remove
+			entries[entry] = entries.back();
+			entries.pop_back();
+			return;
+		}
+	}
+}
+
+
+} // namespace gen
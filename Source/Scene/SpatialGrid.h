@@ -0,0 +1,187 @@
+/*******************************************
+	SpatialGrid.h
+
+	Uniform spatial hash grid for entity
+	proximity queries
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "Atom.h"
+#include "CVector3.h"
+#include "Entity.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+//	Public types
+
+// Team value for entities that are not on a team (everything other than tanks)
+const TInt32 NoTeam = -1;
+
+// How the team of an entity is matched in a spatial query
+enum ETeamFilter
+{
+	Team_Any,   // Ignore team
+	Team_Same,  // Entity must be on the filter team
+	Team_Other  // Entity must be on a team, but not the filter team
+};
+
+// Filter applied to the results of a spatial query. An empty template type (NoAtom) matches any type
+struct SEntityFilter
+{
+	SEntityFilter( const string& type = "", ETeamFilter teamFilter = Team_Any,
+	               TInt32 team = NoTeam, CEntity* excludeEntity = 0 )
+		: templateType( FindAtom( type ) ), teamMatch( teamFilter ), team( team ), exclude( excludeEntity ) {}
+
+	SEntityFilter( TAtom type, ETeamFilter teamFilter = Team_Any,
+	               TInt32 team = NoTeam, CEntity* excludeEntity = 0 )
+		: templateType( type ), teamMatch( teamFilter ), team( team ), exclude( excludeEntity ) {}
+
+	TAtom       templateType;
+	ETeamFilter teamMatch;
+	TInt32      team;
+	CEntity*    exclude;
+};
+
+
+// Uniform grid over the XZ plane, hashed into a fixed number of buckets so the world does not
+// need fixed bounds. Entities are filed by their root position - queries visit only the cells
+// overlapping the query region then perform an exact 3D test, so cost is proportional to the
+// local density of entities rather than the total number of entities. Height is not used for
+// cell selection as the game world is essentially flat
+class CSpatialGrid
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor takes the cell size (world units) and number of hash buckets (power of 2)
+	CSpatialGrid( TFloat32 cellSize = 20.0f, TUInt32 numBuckets = 1024 );
+
+	// Destructor frees bucket memory
+	~CSpatialGrid();
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CSpatialGrid( const CSpatialGrid& );
+	CSpatialGrid& operator=( const CSpatialGrid& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Entity registration
+
+	// Add an entity to the grid at its current position, with an optional team number
+	void Insert( CEntity* entity, TInt32 team = NoTeam );
+
+	// Remove an entity from the grid
+	void Remove( CEntity* entity );
+
+	// Refile an entity after it may have moved - only does work if it has changed cell
+	void Move( CEntity* entity );
+
+	// Remove all entities from the grid
+	void Clear();
+
+	// Shrink the extents (see ClampToExtents) to the cells in use if entities have been removed
+	// from their edges. Visits every entry when it does any work. Must not be called during
+	// queries - the entity manager calls it between updates
+	void ShrinkExtents();
+
+
+	/////////////////////////////////////
+	// Queries
+	// Each query clears the results vector then fills it with matching entities (unordered
+	// except for the nearest query)
+
+	// Entities closer than the given distance to a point. An entity exactly at the distance is
+	// only included if the query is inclusive
+	void QueryRadius( const CVector3& centre, TFloat32 radius, const SEntityFilter& filter,
+	                  vector<CEntity*>& results, bool isInclusive = false );
+
+	// Entities whose positions lie within an axis-aligned box (inclusive)
+	void QueryBox( const CVector3& minBounds, const CVector3& maxBounds,
+	               const SEntityFilter& filter, vector<CEntity*>& results );
+
+	// Up to k entities nearest to the given point, sorted nearest first. Optionally limited to
+	// a maximum search distance
+	void QueryNearest( const CVector3& centre, TUInt32 k, const SEntityFilter& filter,
+	                   vector<CEntity*>& results, TFloat32 maxDistance = D3D10_FLOAT32_MAX );
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	/////////////////////////////////////
+	// Types
+
+	// An entity filed in the grid, along with the cell it is in (several cells may share
+	// a bucket) and data used for filtering
+	struct SGridEntry
+	{
+		CEntity* entity;
+		TInt32   cellX;
+		TInt32   cellZ;
+		TInt32   team;
+	};
+	typedef vector<SGridEntry> TBucket;
+
+
+	/////////////////////////////////////
+	// Support functions
+
+	// Cell coordinate containing a world coordinate, clamped so unbounded queries don't overflow
+	TInt32 CellCoord( TFloat32 worldCoord )
+	{
+		TFloat32 cell = Floor( worldCoord * m_InvCellSize );
+		return static_cast<TInt32>(Max( -1.0e9f, Min( cell, 1.0e9f ) ));
+	}
+
+	TUInt32 BucketIndex( TInt32 cellX, TInt32 cellZ )
+	{
+		// Large primes to scatter neighbouring cells across buckets
+		return (static_cast<TUInt32>(cellX) * 73856093u ^ static_cast<TUInt32>(cellZ) * 19349663u) &
+		       (m_NumBuckets - 1);
+	}
+
+	// Return true if the given entry passes the filter
+	bool Matches( const SGridEntry& entry, const SEntityFilter& filter );
+
+	// Clamp a range of cells to the extents of the cells in use (or that were in use before
+	// entities left them, until ShrinkExtents is called)
+	void ClampToExtents( TInt32& minX, TInt32& minZ, TInt32& maxX, TInt32& maxZ );
+
+	// Remove the entry for an entity from the given bucket
+	void RemoveFromBucket( TUInt32 bucket, CEntity* entity, SGridEntry* removedEntry = 0 );
+
+
+	/////////////////////////////////////
+	// Data
+
+	TFloat32 m_CellSize;
+	TFloat32 m_InvCellSize;
+
+	// Hash buckets, each holding the entries for any cells that hash to it
+	TBucket* m_Buckets;
+	TUInt32  m_NumBuckets;
+	TUInt32  m_NumEntries;
+
+	// Range of cells that have been used, to limit the search of large or unbounded queries.
+	// Entities moving or being added only widen it, it is shrunk by ShrinkExtents when entities
+	// have been removed from its edges
+	TInt32 m_MinCellX, m_MinCellZ;
+	TInt32 m_MaxCellX, m_MaxCellZ;
+	bool   m_IsExtentsStale;
+};
+
+
+} // namespace gen
@@ -102,11 +102,21 @@ CTankEntity::CTankEntity
 	m_CanAskForAssist = true;
 	m_IsCollectingCrate = false;
 	m_TankToAssist = 0;
+	m_TargetCrate = SystemUID;
 	m_Shell = 0;
 	m_ChaseCamera = new CCamera(CVector3(Position().x, Position().y + 3.5f, Position().z));
 	m_ChaseCamera->SetNearFarClip(1.0f, 20000.0f);
 	m_CurrentPatrolPoint = 0;
 	m_TargetRange = 5.0f;
+	SnapshotState();
+}
+
+// Copy the state read by other entities (HP, shells, alive status) for a parallel update
+void CTankEntity::SnapshotState()
+{
+	m_Snapshot.state = m_State;
+	m_Snapshot.HP = m_HP;
+	m_Snapshot.shellsAvailable = m_ShellsAvailable;
 }
 
 
@@ -119,6 +129,7 @@ bool CTankEntity::Update( TFloat32 updateTime )
 	UpdateChaseCamera();
 
 	// Fetch any messages
+	bool wasAlive = m_State != Destruct;
 	SMessage msg;
 	while (Messenger.FetchMessage( GetUID(), &msg ))
 	{
@@ -134,7 +145,11 @@ bool CTankEntity::Update( TFloat32 updateTime )
 				}
 				break;
 			case Msg_Stop:
-				m_State = Inactive;
+				// Stop is broadcast to all tanks, a destructing tank must carry on being destroyed
+				if (m_State != Destruct)
+				{
+					m_State = Inactive;
+				}
 				break;
 			case Msg_Evade:
 				if (CanEnterEvadeState())
@@ -149,6 +164,7 @@ bool CTankEntity::Update( TFloat32 updateTime )
 				m_State = Aim;
 				break;
 			case Msg_Hit:
+				// Hits waiting together arrive as one message with the damage summed
 				OnHit(msg.damageToApply);
 				break;
 			case Msg_FindAmmo:
@@ -168,9 +184,32 @@ bool CTankEntity::Update( TFloat32 updateTime )
 			case Msg_Destruct:
 				m_State = Destruct;
 				break;
+			case Msg_RestoreShells:
+				RestoreShells(msg.amount);
+				SetIsCollectingCrate(false);
+				break;
+			case Msg_RestoreHealth:
+				RestoreHealth(msg.amount);
+				SetIsCollectingCrate(false);
+				IncrementCollectedHealthPacks();
+				break;
+			case Msg_TargetRejected:
+				// Another tank claimed the crate first, look for another one if still heading for it
+				if (msg.from == m_TargetCrate && (m_State == FindAmmo || m_State == FindHealth))
+				{
+					m_TargetCrate = SystemUID;
+					FindClosestCrate(m_State == FindAmmo ? AmmoTypeAtom : HealthTypeAtom);
+				}
+				break;
 		}
 	}
 
+	// Keep the team's alive count up to date
+	if ((m_State != Destruct) != wasAlive)
+	{
+		EntityManager.TankAliveChanged(this);
+	}
+
 	// Tank behaviour
 	switch (m_State)
 	{
@@ -189,7 +228,7 @@ bool CTankEntity::Update( TFloat32 updateTime )
 			EvadeBehaviour(updateTime);
 			break;
 		case FindAmmo: case FindHealth:
-			FindCrateBehaviour(updateTime, SplitString(GetState(m_State)));
+			FindCrateBehaviour(updateTime, m_State == FindAmmo ? AmmoTypeAtom : HealthTypeAtom);
 			break;
 		case Assist:
 			AssistBehaviour(updateTime);
@@ -223,11 +262,14 @@ void CTankEntity::PatrolBehaviour(TFloat32 updateTime)
 		m_CurrentPatrolPoint = (m_PatrolPoints.size() - 1 == m_CurrentPatrolPoint) ? m_CurrentPatrolPoint = 0 : m_CurrentPatrolPoint += 1;
 	}
 
+	// Only enemies within firing distance can be aimed at, so use a spatial query
 	TEntityUID potentialEnemyUID;
-	vector<CTankEntity*> enemyTanks = EntityManager.GetEnemyTeamTanks(GetTeam());
-	for each (CTankEntity * enemyTank in enemyTanks)
+	vector<CEntity*> enemyTanks;
+	EntityManager.QueryRadius(Position(), ShellDistance, SEntityFilter(TankTypeAtom, Team_Other, GetTeam()), enemyTanks);
+	for each (CEntity* entity in enemyTanks)
 	{
-		if (CheckTurretAngle(*enemyTank, ConeOfVisionWhenPatrolling, potentialEnemyUID))
+		CTankEntity* enemyTank = static_cast<CTankEntity*>(entity);
+		if (enemyTank->GetAliveStatus() && CheckTurretAngle(*enemyTank, ConeOfVisionWhenPatrolling, potentialEnemyUID))
 		{
 			m_EnemyUID = potentialEnemyUID;
 			UpdateState(Aim);
@@ -271,14 +313,19 @@ void CTankEntity::AimBehaviour(TFloat32 updateTime)
 	else
 	{
 		// Don't bother firing a shell if the distance is long
-		if (Distance(Position(), enemyTank->Position()) < ShellDistance && !ray->RayBoxIntersect(Position(), GetTurretWorldMatrix().ZAxis(), "Building"))
+		if (Distance(Position(), enemyTank->Position()) < ShellDistance && !ray->RayBoxIntersect(Position(), GetTurretWorldMatrix().ZAxis(), BuildingNameAtom))
 		{
 			if (m_Shell == 0)
 			{
 				m_Shell = EntityManager.GetTanksShell(this);
 			}
 
-			m_Shell->FireShell(enemyTank);
+			// Fire by message as the shell may be updating at the same time (see UpdateAllEntities)
+			SMessage msg;
+			msg.from = GetUID();
+			msg.type = Msg_Fire;
+			msg.target = enemyTank->GetUID();
+			Messenger.SendMessage(m_Shell->GetUID(), msg);
 			m_ShellsAvailable--;
 			m_ShellsFired++;
 
@@ -319,7 +366,7 @@ void CTankEntity::EvadeBehaviour(TFloat32 updateTime)
 		
 		// Reached target point make sure turret is facing the direction the tank is facing
 		CMatrix4x4 turretWorldMatrix = GetTurretWorldMatrix();
-		CVector3 tankFacing = Normalise(Matrix().ZAxis());
+		CVector3 tankFacing = Normalise(GetMatrix().ZAxis());
 
 		turretWorldMatrix.FaceDirection(tankFacing);
 		UpdateState(Patrol);
@@ -328,11 +375,11 @@ void CTankEntity::EvadeBehaviour(TFloat32 updateTime)
 	RotateTurretToTarget(updateTime);
 }
 
-void CTankEntity::FindCrateBehaviour(TFloat32 updateTime, string crateType)
+void CTankEntity::FindCrateBehaviour(TFloat32 updateTime, TAtom crateType)
 {
 	if (MoveTank(updateTime, m_TankTemplate->GetTurnSpeed()))
 	{
-		if (crateType == "Ammo")
+		if (crateType == AmmoTypeAtom)
 		{
 			if (m_ShellsAvailable > 0)
 			{
@@ -341,7 +388,7 @@ void CTankEntity::FindCrateBehaviour(TFloat32 updateTime, string crateType)
 			}
 			else
 			{
-				FindClosestCrate("Ammo");
+				FindClosestCrate(AmmoTypeAtom);
 			}
 		}
 		else
@@ -376,7 +423,7 @@ void CTankEntity::AssistBehaviour(TFloat32 updateTime)
 	{
 		// Reached target point make sure turret is facing the direction the tank is facing
 		CMatrix4x4 turretWorldMatrix = GetTurretWorldMatrix();
-		CVector3 tankFacing = Normalise(Matrix().ZAxis());
+		CVector3 tankFacing = Normalise(GetMatrix().ZAxis());
 
 		turretWorldMatrix.FaceDirection(tankFacing);
 		UpdateState(Patrol);
@@ -393,8 +440,8 @@ bool CTankEntity::MoveTank(TFloat32 updateTime, TFloat32 rotatingSpeed)
 	if (targetDist > m_TargetRange)
 	{
 		// Turning algorithm, dot products with local X and Z axes (normalise axes in case matrix is scaled)
-		TFloat32 forwardDot = Dot(Normalise(targetVec), Normalise(Matrix().ZAxis()));
-		TFloat32 rightDot = Dot(Normalise(targetVec), Normalise(Matrix().XAxis()));
+		TFloat32 forwardDot = Dot(Normalise(targetVec), Normalise(GetMatrix().ZAxis()));
+		TFloat32 rightDot = Dot(Normalise(targetVec), Normalise(GetMatrix().XAxis()));
 
 		// Turn if not facing right direction
 		if (forwardDot < Cos(rotatingSpeed * updateTime))
@@ -484,7 +531,7 @@ bool CTankEntity::CheckTurretAngle(CTankEntity& enemyTank, TFloat32 degreesBefor
 	CMatrix4x4 turretWorldMatrix = GetTurretWorldMatrix();
 
 	// Has LOS
-	if (!ray->RayBoxIntersect(Position(), GetTurretWorldMatrix().ZAxis(), "Building"))
+	if (!ray->RayBoxIntersect(Position(), GetTurretWorldMatrix().ZAxis(), BuildingNameAtom))
 	{
 		// Don't bother aiming if the distance is long
 		TFloat32 distance = Distance(Position(), enemyTank.Position());
@@ -523,7 +570,7 @@ bool CTankEntity::CheckTurretAngle(CTankEntity& enemyTank, TFloat32 degreesBefor
 				}
 				
 				// Check for LOS when turret will be facing enemy tank
-				if (!ray->RayBoxIntersect(Position(), simulatedTurretWorldMatrix.ZAxis(), "Building"))
+				if (!ray->RayBoxIntersect(Position(), simulatedTurretWorldMatrix.ZAxis(), BuildingNameAtom))
 				{
 					enemyUID = enemyTank.GetUID();
 					return true;
@@ -555,12 +602,11 @@ bool CTankEntity::CheckTurretAngle(TFloat32 degreesBeforeAim, CTankEntity& enemy
 	return false;
 }
 
-void CTankEntity::FindClosestCrate(string crateType)
+void CTankEntity::FindClosestCrate(TAtom crateType)
 {
 	TFloat32 closestDistanceCrate = D3D10_FLOAT32_MAX;
 	CCRateEntity* closestCrateEntity = 0;
-	vector<CCRateEntity*> crateEntities = EntityManager.GetCrateEntities(crateType);
-	for each (CCRateEntity* crateEntity in crateEntities)
+	for (CCRateEntity* crateEntity : EntityManager.AvailableCrates(crateType))
 	{
 		TFloat32 distance = Distance(crateEntity->Position(), Position());
 		if (distance < closestDistanceCrate)
@@ -572,12 +618,18 @@ void CTankEntity::FindClosestCrate(string crateType)
 
 	if (closestCrateEntity != 0)
 	{
-		closestCrateEntity->SetTargeted(true);
+		// Claim the crate so other tanks look elsewhere. Another tank may claim it in the same
+		// update, the crate replies with Msg_TargetRejected to all but the first
+		SMessage msg;
+		msg.from = GetUID();
+		msg.type = Msg_Targeted;
+		Messenger.SendMessage(closestCrateEntity->GetUID(), msg);
+		m_TargetCrate = closestCrateEntity->GetUID();
 		m_TargetPoint = closestCrateEntity->Position();
 	}
 	else 
 	{
-		if (crateType == "Ammo")
+		if (crateType == AmmoTypeAtom)
 		{
 			if (m_ShellsAvailable > 0)
 			{
@@ -645,11 +697,11 @@ void CTankEntity::UpdateState(EState newState)
 			break;
 		case FindAmmo: 
 			msg.type = Msg_FindAmmo;
-			FindClosestCrate("Ammo");
+			FindClosestCrate(AmmoTypeAtom);
 			break;
 		case FindHealth:
 			msg.type = Msg_FindHealth;
-			FindClosestCrate("Health");
+			FindClosestCrate(HealthTypeAtom);
 			break;
 		case Assist:
 			msg.type = Msg_Help;
@@ -674,12 +726,16 @@ void CTankEntity::OnHit(TInt32 damageToApply)
 			if (m_CanAskForAssist)
 			{
 				// Send a 'help' message to the nearest teammate
-				vector<CTankEntity*> friendlyTanks = EntityManager.GetTeamTanks(GetTeam(), this);
 				CTankEntity* assistingTank = 0;
 				TFloat32 distance = 0.0f;
 				TFloat32 nearestDistance = D3D10_FLOAT32_MAX;
-				for each (CTankEntity * tank in friendlyTanks)
+				for (TUInt32 teamTank = 0; teamTank < EntityManager.GetTeamSize(GetTeam()); ++teamTank)
 				{
+					CTankEntity* tank = EntityManager.GetTeamTank(GetTeam(), teamTank);
+					if (tank == this)
+					{
+						continue;
+					}
 					distance = Distance(Position(), tank->Position());
 					if (distance < nearestDistance)
 					{
@@ -148,23 +148,24 @@ public:
 		return "Unknown";
 	}
 
-	const CMatrix4x4 GetTurretWorldMatrix() { return Matrix(2) * Matrix(); }
+	// Cached world matrix of the turret, only recalculated when the tank or turret moves
+	const CMatrix4x4& GetTurretWorldMatrix() { return WorldMatrix(2); }
 
 	const TInt32 GetTeam() { return m_Team; }
 
-	const TInt32 GetHP() { return  m_HP; }
+	const TInt32 GetHP() { return ReadSnapshot() ? m_Snapshot.HP : m_HP; }
 
 	const TInt32 GetMaxHP() { return m_TankTemplate->GetMaxHP(); }
 
 	const TInt32 GetShellsFired() { return m_ShellsFired; }
 
-	const TInt32 GetShellsAvailable() { return m_ShellsAvailable; }
+	const TInt32 GetShellsAvailable() { return ReadSnapshot() ? m_Snapshot.shellsAvailable : m_ShellsAvailable; }
 
 	const TInt32 GetShellCapacity() { return m_ShellCapacity; }
 
 	const bool CanEnterEvadeState() { return m_State != Inactive && m_State != Destruct; }
 
-	const bool GetAliveStatus() { return m_State != Destruct; }
+	const bool GetAliveStatus() { return (ReadSnapshot() ? m_Snapshot.state : m_State) != Destruct; }
 
 	CCamera* GetChaseCamera() { return m_ChaseCamera; }
 
@@ -178,6 +179,9 @@ public:
 
 	virtual bool Update( TFloat32 updateTime );
 
+	// Copy the state read by other entities (HP, shells, alive status) for a parallel update
+	virtual void SnapshotState();
+
 
 	/////////////////////////////////////
 	// Setters
@@ -237,6 +241,7 @@ private:
 	CVector3 m_TargetPoint;
 	EState   m_State; 
 	TEntityUID m_EnemyUID;
+	TEntityUID m_TargetCrate; // Crate last claimed with Msg_Targeted
 	CCamera* m_ChaseCamera;
 	CEntity* m_TankToAssist;
 	CShellEntity* m_Shell;
@@ -245,6 +250,15 @@ private:
 	bool m_CanAskForAssist;
 	bool m_IsCollectingCrate;
 
+	// State read by other entities during a parallel update (see CEntity::SnapshotState)
+	struct SSnapshot
+	{
+		EState state;
+		TInt32 HP;
+		TInt32 shellsAvailable;
+	};
+	SSnapshot m_Snapshot;
+
 	// State behaviour methods
 	void PatrolBehaviour(TFloat32 updateTime);
 
@@ -252,7 +266,7 @@ private:
 
 	void AimBehaviour(TFloat32 updateTime);
 
-	void FindCrateBehaviour(TFloat32 updateTime, string crateType);
+	void FindCrateBehaviour(TFloat32 updateTime, TAtom crateType);
 
 	void DestructBehaviour(TFloat32 updateTime, bool &shouldDestroy);
 
@@ -288,7 +302,7 @@ private:
 
 	bool CheckTurretAngle(TFloat32 degreesBeforeAim, CTankEntity& enemyTank);
 
-	void FindClosestCrate(string crateType);
+	void FindClosestCrate(TAtom crateType);
 
 	void UpdateChaseCamera();
 
@@ -0,0 +1,132 @@
+/*******************************************
+	TransformStore.cpp
+
+	Contiguous storage of entity node
+	matrices, owned by the entity manager
+********************************************/
+
+#include <algorithm>
+#include "TransformStore.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Constructor reserves space for the given number of nodes
+CTransformStore::CTransformStore( TUInt32 initialNodes /*= 4096*/ )
+{
+	m_RelMatrices.reserve( initialNodes );
+	m_WorldMatrices.reserve( initialNodes );
+	m_DirtyFlags.reserve( initialNodes );
+	m_SnapshotMatrices.reserve( initialNodes );
+	m_SnapshotWorldMatrices.reserve( initialNodes );
+	m_NumFreeNodes = 0;
+
+	m_NodeRecomputes = 0;
+	m_EntityRecomputes = 0;
+	m_LastFrameNodeRecomputes = 0;
+	m_LastFrameEntityRecomputes = 0;
+}
+
+
+/////////////////////////////////////
+// Allocation
+
+// Allocate a range of nodes, returns the index of the first node. Matrices are undefined and
+// nodes are marked dirty
+TUInt32 CTransformStore::Allocate( TUInt32 numNodes )
+{
+	// Reuse a freed range with the same node count if there is one
+	if (numNodes < m_FreeRanges.size() && !m_FreeRanges[numNodes].empty())
+	{
+		TUInt32 firstNode = m_FreeRanges[numNodes].back();
+		m_FreeRanges[numNodes].pop_back();
+		m_NumFreeNodes -= numNodes;
+		fill( m_DirtyFlags.begin() + firstNode, m_DirtyFlags.begin() + firstNode + numNodes, 1 );
+		return firstNode;
+	}
+
+	// Otherwise add the range to the end of the arrays
+	TUInt32 firstNode = static_cast<TUInt32>(m_RelMatrices.size());
+	m_RelMatrices.resize( firstNode + numNodes );
+	m_WorldMatrices.resize( firstNode + numNodes );
+	m_DirtyFlags.resize( firstNode + numNodes, 1 );
+	m_SnapshotMatrices.resize( firstNode + numNodes );
+	m_SnapshotWorldMatrices.resize( firstNode + numNodes );
+	return firstNode;
+}
+
+// Free a range of nodes previously allocated
+void CTransformStore::Free( TUInt32 firstNode, TUInt32 numNodes )
+{
+	// The last range is removed from the end of the arrays, so freeing ranges in the reverse of
+	// the order they were added (e.g. after a bulk creation) returns the store to its old size
+	if (firstNode + numNodes == m_RelMatrices.size())
+	{
+		m_RelMatrices.resize( firstNode );
+		m_WorldMatrices.resize( firstNode );
+		m_DirtyFlags.resize( firstNode );
+		m_SnapshotMatrices.resize( firstNode );
+		m_SnapshotWorldMatrices.resize( firstNode );
+		return;
+	}
+
+	if (numNodes >= m_FreeRanges.size())
+	{
+		m_FreeRanges.resize( numNodes + 1 );
+	}
+	m_FreeRanges[numNodes].push_back( firstNode );
+	m_NumFreeNodes += numNodes;
+}
+
+// Ensure the given number of nodes can be allocated without reallocating the arrays
+void CTransformStore::Reserve( TUInt32 numNodes )
+{
+	// Grow at least geometrically so repeated small reservations do not reallocate each time
+	size_t required = m_RelMatrices.size() + numNodes;
+	if (required > m_RelMatrices.capacity())
+	{
+		required = max( required, m_RelMatrices.capacity() * 2 );
+		m_RelMatrices.reserve( required );
+		m_WorldMatrices.reserve( required );
+		m_DirtyFlags.reserve( required );
+		m_SnapshotMatrices.reserve( required );
+		m_SnapshotWorldMatrices.reserve( required );
+	}
+}
+
+// Free all nodes - any outstanding ranges become invalid
+void CTransformStore::Clear()
+{
+	m_RelMatrices.clear();
+	m_WorldMatrices.clear();
+	m_DirtyFlags.clear();
+	m_SnapshotMatrices.clear();
+	m_SnapshotWorldMatrices.clear();
+	for (TUInt32 numNodes = 0; numNodes < m_FreeRanges.size(); ++numNodes)
+	{
+		m_FreeRanges[numNodes].clear();
+	}
+	m_NumFreeNodes = 0;
+}
+
+// Copy the relative and world matrices of a range of nodes to the snapshot arrays
+void CTransformStore::TakeSnapshot( TUInt32 firstNode, TUInt32 numNodes )
+{
+	copy( m_RelMatrices.begin() + firstNode, m_RelMatrices.begin() + firstNode + numNodes,
+	      m_SnapshotMatrices.begin() + firstNode );
+	copy( m_WorldMatrices.begin() + firstNode, m_WorldMatrices.begin() + firstNode + numNodes,
+	      m_SnapshotWorldMatrices.begin() + firstNode );
+}
+
+// Start counting recalculations for a new frame
+void CTransformStore::NewFrame()
+{
+	m_LastFrameNodeRecomputes = m_NodeRecomputes.exchange( 0 );
+	m_LastFrameEntityRecomputes = m_EntityRecomputes.exchange( 0 );
+}
+
+
+} // namespace gen
@@ -0,0 +1,188 @@
+/*******************************************
+	TransformStore.h
+
+	Contiguous storage of entity node
+	matrices, owned by the entity manager
+********************************************/
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+using namespace std;
+
+#include "Defines.h"
+#include "CMatrix4x4.h"
+
+namespace gen
+{
+
+// Relative and world node matrices for all entities, held as two parallel contiguous arrays
+// (structure of arrays) rather than per-entity heap blocks. Each entity owns a range of nodes
+// identified by the index of its first node. Freed ranges are kept on a free list for their
+// node count and reused by the next entity with the same count, so entity churn (shells,
+// respawns) does not fragment or grow the arrays
+//
+// The arrays may be reallocated when an entity is created, so references to matrices must not
+// be held across entity creation
+//
+// World matrices are a cache calculated from the relative matrices by the owning entity (see
+// CEntity::WorldMatrix). Each node has a dirty flag set when its relative matrix may have
+// changed, and only dirty nodes and their children are recalculated. The store counts how many
+// world matrices are recalculated each frame
+class CTransformStore
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor reserves space for the given number of nodes
+	CTransformStore( TUInt32 initialNodes = 4096 );
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CTransformStore( const CTransformStore& );
+	CTransformStore& operator=( const CTransformStore& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Allocation
+
+	// Allocate a range of nodes, returns the index of the first node. Matrices are undefined and
+	// nodes are marked dirty
+	TUInt32 Allocate( TUInt32 numNodes );
+
+	// Free a range of nodes previously allocated. If it is the last range it is removed from the
+	// end of the arrays, otherwise it is kept for reuse
+	void Free( TUInt32 firstNode, TUInt32 numNodes );
+
+	// Ensure the given number of nodes can be allocated without reallocating the arrays
+	void Reserve( TUInt32 numNodes );
+
+	// Free all nodes - any outstanding ranges become invalid
+	void Clear();
+
+
+	/////////////////////////////////////
+	// Matrix access
+
+	CMatrix4x4& RelMatrix( TUInt32 node )
+	{
+		return m_RelMatrices[node];
+	}
+
+	CMatrix4x4& WorldMatrix( TUInt32 node )
+	{
+		return m_WorldMatrices[node];
+	}
+
+	// Flag set when the node's relative matrix may have changed since its world matrix was
+	// calculated. Flags are bytes so entities on different threads can set their own flags
+	TUInt8& DirtyFlag( TUInt32 node )
+	{
+		return m_DirtyFlags[node];
+	}
+
+	// Relative / world matrix as it was at the last call to TakeSnapshot for the node
+	CMatrix4x4& SnapshotMatrix( TUInt32 node )
+	{
+		return m_SnapshotMatrices[node];
+	}
+
+	CMatrix4x4& SnapshotWorldMatrix( TUInt32 node )
+	{
+		return m_SnapshotWorldMatrices[node];
+	}
+
+	// Copy the relative and world matrices of a range of nodes to the snapshot arrays. World
+	// matrices should be up to date first
+	void TakeSnapshot( TUInt32 firstNode, TUInt32 numNodes );
+
+	// Pointers to the start of the arrays, for linear sweeps over all nodes. Valid until the next
+	// call to Allocate
+	CMatrix4x4* RelMatrices()
+	{
+		return m_RelMatrices.data();
+	}
+
+	CMatrix4x4* WorldMatrices()
+	{
+		return m_WorldMatrices.data();
+	}
+
+
+	/////////////////////////////////////
+	// Statistics
+
+	// Number of nodes in the arrays, including those in free ranges
+	TUInt32 NumNodes()
+	{
+		return static_cast<TUInt32>(m_RelMatrices.size());
+	}
+
+	// Number of nodes in free ranges
+	TUInt32 NumFreeNodes()
+	{
+		return m_NumFreeNodes;
+	}
+
+	// Number of nodes the arrays can hold before reallocation
+	TUInt32 Capacity()
+	{
+		return static_cast<TUInt32>(m_RelMatrices.capacity());
+	}
+
+	// Record that the given number of world matrices were recalculated for one entity. May be
+	// called from any thread
+	void CountRecomputes( TUInt32 numNodes )
+	{
+		m_NodeRecomputes += numNodes;
+		++m_EntityRecomputes;
+	}
+
+	// Start counting recalculations for a new frame
+	void NewFrame();
+
+	// Number of world matrices / entities recalculated in the last complete frame
+	TUInt32 LastFrameNodeRecomputes()
+	{
+		return m_LastFrameNodeRecomputes;
+	}
+
+	TUInt32 LastFrameEntityRecomputes()
+	{
+		return m_LastFrameEntityRecomputes;
+	}
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	// Parallel arrays of relative and world matrices
+	vector<CMatrix4x4> m_RelMatrices;
+	vector<CMatrix4x4> m_WorldMatrices;
+
+	// Dirty flag for each node (see DirtyFlag)
+	vector<TUInt8> m_DirtyFlags;
+
+	// Copy of the relative and world matrices, read by other entities during a parallel update
+	vector<CMatrix4x4> m_SnapshotMatrices;
+	vector<CMatrix4x4> m_SnapshotWorldMatrices;
+
+	// World matrix recalculation counts for the current and last frames
+	atomic<TUInt32> m_NodeRecomputes;
+	atomic<TUInt32> m_EntityRecomputes;
+	TUInt32         m_LastFrameNodeRecomputes;
+	TUInt32         m_LastFrameEntityRecomputes;
+
+	// First node of each free range, indexed by the node count of the range
+	vector< vector<TUInt32> > m_FreeRanges;
+	TUInt32 m_NumFreeNodes;
+};
+
+
+} // namespace gen
@@ -5,6 +5,8 @@
 ********************************************/
 
 #include <sstream>
+#include <fstream>
+#include <iostream>
 #include <string>
 using namespace std;
 
@@ -23,6 +25,10 @@ using namespace std;
 #include "RayCast.h"
 #include "ParseLevel.h"
 #include "CParticleSystem.h"
+#include "CFlatHashTable.h"
+#include "CHashTable.h"
+#include "CConcurrentHashTable.h"
+#include "CTimerWheel.h"
 
 #include "imgui.h"
 #include "imgui_impl_win32.h"
@@ -84,9 +90,16 @@ const INT32 NumOfPatrolPoints = 3;
 TEntityUID tanks[NumOfTanks];
 vector<CTankEntity*> tankEntities;
 map<string, CTankEntity*> tankEntitiesMap;
+bool TankListChanged = true; // Set by the team listener when tanks are added or destroyed
 CEntity* NearestEntity = 0;
 CEntity* SelectedEntity = 0;
 
+// Turret line of sight rays and results for each tank, reused each frame and only grown when there
+// are more tanks than before
+vector<SRay> TurretRays;
+unique_ptr<bool[]> TurretIntersects;
+TUInt32 TurretIntersectsCapacity = 0;
+
 // Other scene elements
 const INT32 NumLights = 2;
 CLight*  Lights[NumLights];
@@ -129,6 +142,15 @@ void UpdateMainCamera(CCamera* camera) { m_MainCamera = camera; SetCamera(m_Main
 // Scene management
 //-----------------------------------------------------------------------------
 
+// Team listener, the tank list is refilled when tanks are added or destroyed
+void OnTeamEvent(const STeamEvent& event, void* data)
+{
+	if (event.type == TeamEvent_TankAdded || event.type == TeamEvent_TankDestroyed)
+	{
+		TankListChanged = true;
+	}
+}
+
 // Creates the scene geometry
 bool SceneSetup()
 {
@@ -136,14 +158,19 @@ bool SceneSetup()
 	// Prepare render methods
 
 	InitialiseMethods();
+	EntityManager.AddTeamListener(OnTeamEvent);
 	if (LevelParser.ParseFile("Entities.xml"))
 	{
-		tankEntities = EntityManager.GetTankEntities();
+		TTankRange tanks = EntityManager.Tanks();
+		tankEntities.assign(tanks.begin(), tanks.end());
 		// Create a map of the tanks key: Tank's name 
 		for each (CTankEntity* tankEntity in tankEntities)
 		{
 			tankEntitiesMap.insert({tankEntity->GetName(), tankEntity});
 		}
+
+		// Line of sight checks test against a tree of the buildings
+		ray->BuildOccluders(BuildingNameAtom);
 	}
 
 	/////////////////////////////
@@ -183,6 +210,7 @@ void SceneShutdown()
 	delete m_MainCamera;
 
 	// Destroy all entities
+	EntityManager.RemoveTeamListener(OnTeamEvent);
 	EntityManager.DestroyAllEntities();
 	EntityManager.DestroyAllTemplates();
 }
@@ -195,7 +223,13 @@ void SceneShutdown()
 // Draw one frame of the scene
 void RenderScene( float updateTime )
 {
-	tankEntities = EntityManager.GetTankEntities();
+	// Refill the tank list in place when tanks have been added or destroyed
+	if (TankListChanged)
+	{
+		TTankRange tanks = EntityManager.Tanks();
+		tankEntities.assign(tanks.begin(), tanks.end());
+		TankListChanged = false;
+	}
 
 	//IMGUI
 	//*******************************
@@ -298,14 +332,7 @@ void RenderSceneText( float updateTime )
 			SMessage msg;
 			msg.from = SystemUID;
 			msg.type = Msg_Stop;
-			for each (CTankEntity* tankEntity in tankEntities)
-			{
-				// In case a tank is destructing do not send a message because its gonna crash
-				if (tankEntity->GetState() != "Destruct")
-				{
-					Messenger.SendMessage(tankEntity->GetUID(), msg);
-				}
-			}
+			Messenger.SendTypeMessage(TankTypeAtom, msg);
 
 			if (TimeToExitGame < 0.0f)
 			{
@@ -339,8 +366,28 @@ void RenderSceneText( float updateTime )
 
 void ShowTankInfo(stringstream& outText)
 {
+	// Check every tank's turret line of sight in one batch
+	TUInt32 numTanks = static_cast<TUInt32>(tankEntities.size());
+	TurretRays.resize(numTanks);
+	if (numTanks > TurretIntersectsCapacity)
+	{
+		TurretIntersects.reset(new bool[numTanks]);
+		TurretIntersectsCapacity = numTanks;
+	}
+	for (TUInt32 tank = 0; tank < numTanks; ++tank)
+	{
+		TurretRays[tank].start = tankEntities[tank]->Position();
+		TurretRays[tank].direction = tankEntities[tank]->GetTurretWorldMatrix().ZAxis();
+	}
+	if (numTanks > 0)
+	{
+		ray->RayBoxIntersectMany(&TurretRays[0], TurretIntersects.get(), numTanks, BuildingNameAtom);
+	}
+
+	TUInt32 tank = 0;
 	for each (CTankEntity* tankEntity in tankEntities)
 	{
+		bool isTurretIntersecting = TurretIntersects[tank++];
 		CVector3 entityPosition = tankEntity->Position();
 		TInt32 X = 0, Y = 0;
 
@@ -351,7 +398,7 @@ void ShowTankInfo(stringstream& outText)
 			TInt32 tankHP = tankEntity->GetHP();
 			TInt32 shellsFired = tankEntity->GetShellsFired();
 			TInt32 shellsAvailable = tankEntity->GetShellsAvailable();
-			string tankIntersects = (ray->RayBoxIntersect(entityPosition, Normalise(tankEntity->GetTurretWorldMatrix().ZAxis()), "Building")) ? "Intersects" : "Not";
+			string tankIntersects = isTurretIntersecting ? "Intersects" : "Not";
 
 			// Display extented info
 			if (ShowExtendedInformation)
@@ -431,10 +478,7 @@ void UpdateScene( float updateTime )
 		SMessage msg;
 		msg.from = SystemUID;
 		msg.type = Msg_Start;
-		for each (CTankEntity* tankEntity in tankEntities)
-		{
-			Messenger.SendMessage(tankEntity->GetUID(), msg);
-		}
+		Messenger.SendTypeMessage(TankTypeAtom, msg);
 	}
 
 	// Stop game
@@ -443,10 +487,7 @@ void UpdateScene( float updateTime )
 		SMessage msg;
 		msg.from = SystemUID;
 		msg.type = Msg_Stop;
-		for each (CTankEntity* tankEntity in tankEntities)
-		{
-			Messenger.SendMessage(tankEntity->GetUID(), msg);
-		}
+		Messenger.SendTypeMessage(TankTypeAtom, msg);
 	}
 
 	// Chase camera functionality (NOTE: I am using a 60% keyboard so I don't have a num pad so I replaced it with other keys)
@@ -520,6 +561,37 @@ void UpdateScene( float updateTime )
 	}
 }
 
+// Sends cout to the given stream buffer until destroyed, so cout is restored however the scope
+// is left
+class CCoutRedirect
+{
+public:
+	CCoutRedirect(streambuf* buffer)
+	{
+		m_OldBuffer = cout.rdbuf(buffer);
+	}
+	~CCoutRedirect()
+	{
+		cout.rdbuf(m_OldBuffer);
+	}
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CCoutRedirect(const CCoutRedirect&);
+	CCoutRedirect& operator=(const CCoutRedirect&);
+
+	streambuf* m_OldBuffer;
+};
+
+// Run a diagnostic check or benchmark, appending what it writes to cout to a file as the program
+// has no console
+void RunDiagnostic(void (*diagnostic)())
+{
+	ofstream diagnosticFile("Diagnostics.txt", ios::app);
+	CCoutRedirect redirect(diagnosticFile.rdbuf());
+	diagnostic();
+}
+
 void TankManagerGUI(bool* p_open)
 {
 	IM_ASSERT(ImGui::GetCurrentContext() != NULL && "Missing dear imgui context. Refer to examples app!"); // Exceptionally add an extra assert here for people confused with initial dear imgui setup
@@ -667,6 +739,122 @@ void TankManagerGUI(bool* p_open)
 		ImGui::Checkbox("No bring to front", &no_bring_to_front);
 	}
 
+	if (ImGui::CollapsingHeader("Entity Update"))
+	{
+		// The two-phase update is split across the threads (same result for any thread count)
+		int updateThreads = EntityManager.GetUpdateThreads();
+		if (ImGui::SliderInt("Update threads", &updateThreads, 1, CWorkerPool::NumHardwareThreads()))
+		{
+			EntityManager.SetUpdateThreads(updateThreads);
+		}
+
+		// World matrices are cached and only recalculated for nodes that have moved
+		CTransformStore& transforms = EntityManager.Transforms();
+		ImGui::Text("World matrices recalculated last frame: %u of %u (%u entities)",
+			transforms.LastFrameNodeRecomputes(), transforms.NumNodes() - transforms.NumFreeNodes(),
+			transforms.LastFrameEntityRecomputes());
+
+		// Only active entities are updated, sleeping entities wake on a timer or a message
+		ImGui::Text("Entities active: %u, sleeping: %u, static: %u", EntityManager.NumActiveEntities(),
+			EntityManager.NumSleepingEntities(), EntityManager.NumStaticEntities());
+	}
+
+	if (ImGui::CollapsingHeader("Messaging"))
+	{
+#ifdef GEN_MESSENGER_STATS
+		// Statistics for the last frame
+		const SMessengerStats& stats = Messenger.GetStats();
+		ImGui::Text("Frame %u: %u sent (%u broadcasts), %u fetched, %u coalesced", stats.frame,
+			stats.totalSent, stats.broadcastsSent, stats.totalFetched, stats.coalesced);
+		ImGui::Text("Mailboxes in use: %u, mean depth: %.2f, max depth: %u", stats.mailboxesInUse,
+			stats.meanMailboxDepth, stats.maxMailboxDepth);
+		ImGui::Text("Latency in frames, mean: %.2f, max: %u", stats.meanLatency, stats.maxLatency);
+		ImGui::Text("Delayed messages waiting: %u, broadcasts in log: %u", Messenger.NumDelayedMessages(),
+			Messenger.NumBroadcasts());
+
+		// Message types used in the frame
+		ImGui::Separator();
+		ImGui::Columns(3, "messagetypes");
+		ImGui::Text("Type"); ImGui::NextColumn();
+		ImGui::Text("Sent"); ImGui::NextColumn();
+		ImGui::Text("Fetched"); ImGui::NextColumn();
+		for (int type = 0; type < NumMessageTypes; type++)
+		{
+			if (stats.sent[type] || stats.fetched[type])
+			{
+				ImGui::Text("%s", MessageTypeName(static_cast<EMessageType>(type))); ImGui::NextColumn();
+				ImGui::Text("%u", stats.sent[type]); ImGui::NextColumn();
+				ImGui::Text("%u", stats.fetched[type]); ImGui::NextColumn();
+			}
+		}
+		ImGui::Columns(1);
+		ImGui::Separator();
+
+		ImGui::Text("Top senders:");
+		for (int sender = 0; sender < NumTopSenders && stats.topSenderCounts[sender]; sender++)
+		{
+			CEntity* entity = EntityManager.GetEntity(stats.topSenders[sender]);
+			string senderName = stats.topSenders[sender] == SystemUID ? "System" : entity ? entity->GetName() : "(destroyed)";
+			ImGui::Text("  %s: %u", senderName.c_str(), stats.topSenderCounts[sender]);
+		}
+
+		if (ImGui::Button("Write CSV"))
+		{
+			Messenger.WriteStats("MessengerStats.csv", StatsFormat_CSV);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Write JSON"))
+		{
+			Messenger.WriteStats("MessengerStats.json", StatsFormat_JSON);
+		}
+#else
+		ImGui::Text("Messenger statistics are compiled out (GEN_NO_MESSENGER_STATS)");
+#endif
+	}
+
+	if (ImGui::CollapsingHeader("Diagnostics"))
+	{
+		// Each runs to completion before the next frame, which may take several seconds
+		ImGui::Text("Results are appended to Diagnostics.txt");
+		if (ImGui::Button("Enumeration"))
+		{
+			RunDiagnostic([]() { EntityManager.OutputEnumerationBenchmark("Tree"); });
+		}
+		if (ImGui::Button("Pool Stats"))
+		{
+			RunDiagnostic([]() { EntityManager.OutputPoolStats(); });
+		}
+		if (ImGui::Button("Hash Table"))
+		{
+			RunDiagnostic([]() { OutputHashTableBenchmark(); });
+		}
+		if (ImGui::Button("Hash Policy"))
+		{
+			RunDiagnostic([]() { OutputHashPolicyBenchmark(); });
+		}
+		if (ImGui::Button("Resize"))
+		{
+			RunDiagnostic([]() { OutputResizeBenchmark(); });
+		}
+		if (ImGui::Button("Concurrent Hash Table"))
+		{
+			RunDiagnostic([]() { OutputConcurrentHashTableBenchmark(); });
+		}
+		if (ImGui::Button("Timer Wheel"))
+		{
+			RunDiagnostic([]() { OutputTimerWheelBenchmark(); });
+		}
+		if (ImGui::Button("Box Packet Check"))
+		{
+			RunDiagnostic([]() { OutputBoxPacketCheck(); });
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Box Tree"))
+		{
+			RunDiagnostic([]() { OutputBoxTreeBenchmark(); });
+		}
+	}
+
 	if (ImGui::CollapsingHeader("Choose Tank - Modify Tank's Properties"))
 	{
 		ImGui::Text("Select Tank");
@@ -699,6 +887,29 @@ void TankManagerGUI(bool* p_open)
 		ImGui::Columns(1);
 		ImGui::Separator();
 
+		// Start or stop a whole team with one message to the team
+		for (int team = 0; team < 2; team++)
+		{
+			SMessage msg;
+			msg.from = SystemUID;
+			ImGui::PushID(team);
+			ImGui::Text(team == 0 ? "Team A" : "Team B");
+			ImGui::SameLine();
+			if (ImGui::Button("Start"))
+			{
+				msg.type = Msg_Start;
+				Messenger.SendTeamMessage(team, msg);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Stop"))
+			{
+				msg.type = Msg_Stop;
+				Messenger.SendTeamMessage(team, msg);
+			}
+			ImGui::PopID();
+		}
+		ImGui::Separator();
+
 		// Tank Properties
 		// If user selected any tank
 		if (selectedTank != -1)